@@ -222,9 +222,9 @@ static void cpu_exec_nocache(CPUState *cpu, int max_cycles,
        We only end up here when an existing TB is too long.  */
     cflags |= MIN(max_cycles, CF_COUNT_MASK);
 
-    tb_lock();
     tb = tb_gen_code(cpu, orig_tb->pc, orig_tb->cs_base,
                      orig_tb->flags, cflags);
+    tb_lock();
     tb->orig_tb = orig_tb;
     tb_unlock();
 
@@ -254,12 +254,10 @@ void cpu_exec_step_atomic(CPUState *cpu)
         tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, cf_mask);
         if (tb == NULL) {
             mmap_lock();
-            tb_lock();
             tb = tb_htable_lookup(cpu, pc, cs_base, flags, cf_mask);
             if (likely(tb == NULL)) {
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
             }
-            tb_unlock();
             mmap_unlock();
         }
 
@@ -404,11 +402,11 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
          * single threaded the locks are NOPs.
          */
         mmap_lock();
-        tb_lock();
-        acquired_tb_lock = true;
 
         /* There's a chance that our desired tb has been translated while
-         * taking the locks so we check again inside the lock.
+         * taking the lock so we check again. tb_gen_code() takes tb_lock
+         * itself and only for publishing the new TB, so vCPUs can
+         * translate in parallel.
          */
         tb = tb_htable_lookup(cpu, pc, cs_base, flags, cf_mask);
         if (likely(tb == NULL)) {
@@ -703,6 +701,10 @@ int cpu_exec(CPUState *cpu)
         return EXCP_HALTED;
     }
 
+    if (qemu_etrace_mask(ETRACE_F_MEM_LD | ETRACE_F_MEM_ST)) {
+        etrace_mem_cpu_init(&qemu_etracer, cpu);
+    }
+
     rcu_read_lock();
 
     cc->cpu_exec_enter(cpu);
@@ -735,7 +737,7 @@ int cpu_exec(CPUState *cpu)
         }
 
         if (qemu_etrace_mask(ETRACE_F_EXEC)
-            && qemu_etracer.exec_start_valid) {
+            && etrace_exec_started(&qemu_etracer, cpu->cpu_index)) {
             target_ulong cs_base, pc;
             uint32_t flags;
 
@@ -782,14 +784,16 @@ int cpu_exec(CPUState *cpu)
                                      cpu->cpu_index, pc);
             }
 
-            qemu_etracer.exec_start_valid = false;
-
             /* Try to align the host and virtual clocks
                if the guest is in advance */
             align_clocks(&sc, cpu);
         }
     }
 
+    if (cpu->etrace_mem.buf) {
+        etrace_mem_flush(&qemu_etracer, cpu);
+    }
+
     cc->cpu_exec_exit(cpu);
     rcu_read_unlock();
 
@@ -25,6 +25,7 @@
 #include "exec/address-spaces.h"
 #include "exec/cpu_ldst.h"
 #include "exec/cputlb.h"
+#include "exec/tb-hash.h"
 #include "exec/memory-internal.h"
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
@@ -33,6 +34,8 @@
 #include "exec/helper-proto.h"
 #include "qemu/atomic.h"
 #include "qemu/etrace.h"
+#include "qemu/timer.h"
+#include "sysemu/accel.h"
 
 /* DEBUG defines, enable DEBUG_TLB_LOG to log to the CPU_LOG_MMU target */
 /* #define DEBUG_TLB */
@@ -93,6 +96,318 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* Length of the window over which the TLB use rate is observed.  */
+#define TLB_WINDOW_NS (100 * SCALE_MS)
+
+static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns, size_t max_entries)
+{
+    desc->window_begin_ns = ns;
+    desc->window_max_entries = max_entries;
+}
+
+static void tlb_dyn_init(CPUArchState *env)
+{
+    int i;
+
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        CPUTLBDesc *desc = &env->tlb_d[i];
+        size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+
+        tlb_window_reset(desc, get_clock_realtime(), 0);
+        desc->n_used_entries = 0;
+        desc->n_evictions = 0;
+        env->tlb_mask[i] = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+        env->tlb_table[i] = g_new(CPUTLBEntry, n_entries);
+        env->iotlb[i] = g_new0(CPUIOTLBEntry, n_entries);
+    }
+}
+
+/* Resize the TLB of MMU_IDX, which is about to be flushed.  This can
+ * only be done on a flush, as the entries would otherwise need to be
+ * rehashed.
+ *
+ * A large TLB is cheap for a memory hungry guest, as a miss costs a
+ * page table walk, but it takes longer to flush and has worse host
+ * cache locality.  As the guest's future behaviour is unknown, the
+ * TLB is grown as soon as its use rate goes above 70%, or above 30%
+ * when many fills since the last flush evicted a valid entry; being
+ * direct mapped, such conflict misses go down as the TLB gets larger.
+ * It is shrunk lazily, to what the window needed, only once a whole
+ * window went by with a use rate below 30%.
+ */
+static void tlb_mmu_resize(CPUArchState *env, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+    size_t old_size = tlb_n_entries(env, mmu_idx);
+    size_t new_size = old_size;
+    int64_t now = get_clock_realtime();
+    bool window_expired = now > desc->window_begin_ns + TLB_WINDOW_NS;
+    bool conflicts = desc->n_evictions > old_size / 2;
+    size_t rate;
+
+    if (desc->n_used_entries > desc->window_max_entries) {
+        desc->window_max_entries = desc->n_used_entries;
+    }
+    rate = desc->window_max_entries * 100 / old_size;
+
+    if (rate > 70 || (rate > 30 && conflicts)) {
+        new_size = MIN(old_size << 1, (size_t)1 << CPU_TLB_DYN_MAX_BITS);
+    } else if (rate < 30 && window_expired && !conflicts) {
+        size_t ceil = pow2ceil(desc->window_max_entries);
+
+        /* Keep the expected use rate below 70%, or the next flush
+         * would grow the TLB right back.
+         */
+        if (desc->window_max_entries * 100 / ceil > 70) {
+            ceil *= 2;
+        }
+        new_size = MAX(ceil, (size_t)1 << CPU_TLB_DYN_MIN_BITS);
+    }
+
+    if (new_size == old_size) {
+        if (window_expired) {
+            tlb_window_reset(desc, now, desc->n_used_entries);
+        }
+        return;
+    }
+
+    qemu_spin_lock(&env->tlb_lock);
+    g_free(env->tlb_table[mmu_idx]);
+    g_free(env->iotlb[mmu_idx]);
+    for (;;) {
+        env->tlb_table[mmu_idx] = g_try_new(CPUTLBEntry, new_size);
+        env->iotlb[mmu_idx] = g_try_new0(CPUIOTLBEntry, new_size);
+        if (env->tlb_table[mmu_idx] && env->iotlb[mmu_idx]) {
+            break;
+        }
+        /* We just freed the old tables, so a smaller size has a good
+         * chance of working.  Give up below the minimum size.
+         */
+        g_free(env->tlb_table[mmu_idx]);
+        g_free(env->iotlb[mmu_idx]);
+        if (new_size == 1 << CPU_TLB_DYN_MIN_BITS) {
+            error_report("%s: cannot allocate the TLB", __func__);
+            abort();
+        }
+        new_size = MAX(new_size >> 1, (size_t)1 << CPU_TLB_DYN_MIN_BITS);
+    }
+    env->tlb_mask[mmu_idx] = (new_size - 1) << CPU_TLB_ENTRY_BITS;
+    qemu_spin_unlock(&env->tlb_lock);
+
+    tlb_window_reset(desc, now, 0);
+    atomic_set(&desc->resizes, desc->resizes + 1);
+    tlb_debug("mmu_idx %d: %zu -> %zu entries\n", mmu_idx, old_size, new_size);
+}
+#endif
+
+void tlb_init(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int i;
+
+    qemu_spin_init(&env->tlb_lock);
+    qemu_spin_init(&env->tlb_pending_lock);
+    env->vtlb_size = tcg_vtlb_size ? tcg_vtlb_size : CPU_VTLB_DEFAULT_SIZE;
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    tlb_dyn_init(env);
+#endif
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        env->tlb_v_table[i] = g_new(CPUTLBEntry, env->vtlb_size);
+        env->iotlb_v[i] = g_new0(CPUIOTLBEntry, env->vtlb_size);
+        memset(env->tlb_table[i], -1,
+               tlb_n_entries(env, i) * sizeof(CPUTLBEntry));
+        memset(env->tlb_v_table[i], -1, env->vtlb_size * sizeof(CPUTLBEntry));
+    }
+    env->tlb_flush_addr = -1;
+    env->tlb_flush_mask = 0;
+}
+
+void tlb_destroy(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int i;
+
+    for (i = 0; i < NB_MMU_MODES; i++) {
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+        CPUTLBContext *c = env->tlb_d[i].ctx;
+
+        for (; c < env->tlb_d[i].ctx + CPU_TLB_DYN_CONTEXTS; c++) {
+            g_free(c->table);
+            g_free(c->iotlb);
+            g_free(c->v_table);
+            g_free(c->iotlb_v);
+        }
+        g_free(env->tlb_table[i]);
+        g_free(env->iotlb[i]);
+#endif
+        g_free(env->tlb_v_table[i]);
+        g_free(env->iotlb_v[i]);
+    }
+}
+
+static inline void tlb_n_used_entries_inc(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    env->tlb_d[mmu_idx].n_used_entries++;
+#endif
+}
+
+static inline void tlb_n_used_entries_dec(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    env->tlb_d[mmu_idx].n_used_entries--;
+#endif
+}
+
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
+}
+
+/* Account for a fill about to replace TE in the main TLB.  */
+static inline void tlb_count_fill(CPUArchState *env, int mmu_idx,
+                                  const CPUTLBEntry *te)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+
+    atomic_set(&desc->fills, desc->fills + 1);
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    if (tlb_entry_is_empty(te)) {
+        desc->n_used_entries++;
+    } else {
+        desc->n_evictions++;
+    }
+#endif
+}
+
+/* Flush the current main and victim TLBs of one MMU mode, resizing the
+ * former first when it is dynamically sized.
+ */
+static void tlb_flush_current_mmuidx(CPUArchState *env, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    tlb_mmu_resize(env, mmu_idx);
+    desc->n_used_entries = 0;
+    desc->n_evictions = 0;
+#endif
+    memset(env->tlb_table[mmu_idx], -1,
+           tlb_n_entries(env, mmu_idx) * sizeof(CPUTLBEntry));
+    memset(env->tlb_v_table[mmu_idx], -1,
+           env->vtlb_size * sizeof(CPUTLBEntry));
+    atomic_set(&desc->flushes, desc->flushes + 1);
+}
+
+/* Flush one MMU mode, including the address spaces set aside.  */
+static void tlb_flush_one_mmuidx(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    int i;
+
+    for (i = 0; i < CPU_TLB_DYN_CONTEXTS; i++) {
+        env->tlb_d[mmu_idx].ctx[i].valid = false;
+    }
+#endif
+    tlb_flush_current_mmuidx(env, mmu_idx);
+}
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* Swap the current TLB of MMU_IDX with the one set aside in C.  The
+ * tables of a context that was never used are allocated here.
+ */
+static void tlb_context_swap(CPUArchState *env, int mmu_idx, CPUTLBContext *c)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+    CPUTLBContext next = *c;
+
+    if (!next.table) {
+        size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+
+        next.mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+        next.table = g_new(CPUTLBEntry, n_entries);
+        next.iotlb = g_new0(CPUIOTLBEntry, n_entries);
+        next.v_table = g_new(CPUTLBEntry, env->vtlb_size);
+        next.iotlb_v = g_new0(CPUIOTLBEntry, env->vtlb_size);
+        next.window_begin_ns = get_clock_realtime();
+    }
+
+    /* tlb_reset_dirty walks the contexts from other threads.  */
+    qemu_spin_lock(&env->tlb_lock);
+    c->mask = env->tlb_mask[mmu_idx];
+    c->table = env->tlb_table[mmu_idx];
+    c->iotlb = env->iotlb[mmu_idx];
+    c->v_table = env->tlb_v_table[mmu_idx];
+    c->iotlb_v = env->iotlb_v[mmu_idx];
+    c->window_begin_ns = desc->window_begin_ns;
+    c->window_max_entries = desc->window_max_entries;
+    c->n_used_entries = desc->n_used_entries;
+    c->n_evictions = desc->n_evictions;
+    c->asid = desc->asid;
+    c->valid = true;
+    c->last_use = desc->asid_switches;
+
+    env->tlb_mask[mmu_idx] = next.mask;
+    env->tlb_table[mmu_idx] = next.table;
+    env->iotlb[mmu_idx] = next.iotlb;
+    env->tlb_v_table[mmu_idx] = next.v_table;
+    env->iotlb_v[mmu_idx] = next.iotlb_v;
+    desc->window_begin_ns = next.window_begin_ns;
+    desc->window_max_entries = next.window_max_entries;
+    desc->n_used_entries = next.n_used_entries;
+    desc->n_evictions = next.n_evictions;
+    qemu_spin_unlock(&env->tlb_lock);
+}
+
+/* Return the context set aside for ASID, or else the one to reuse: a
+ * free one if any, the least recently used otherwise.
+ */
+static CPUTLBContext *tlb_find_context(CPUTLBDesc *desc, uint32_t asid)
+{
+    CPUTLBContext *victim = NULL;
+    int i;
+
+    for (i = 0; i < CPU_TLB_DYN_CONTEXTS; i++) {
+        CPUTLBContext *c = &desc->ctx[i];
+
+        if (c->valid && c->asid == asid) {
+            return c;
+        }
+        if (!victim ||
+            (victim->valid && (!c->valid || c->last_use < victim->last_use))) {
+            victim = c;
+        }
+    }
+    return victim;
+}
+#endif
+
+/* Make ASID the current address space of MMU_IDX.  With a dynamic TLB
+ * the current contents are set aside, and those of ASID are brought
+ * back if it was current recently; otherwise the TLB is flushed.
+ */
+static void tlb_switch_asid(CPUArchState *env, int mmu_idx, uint32_t asid)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    CPUTLBContext *c = tlb_find_context(desc, asid);
+    bool hit = c->valid && c->asid == asid;
+
+    tlb_context_swap(env, mmu_idx, c);
+    desc->asid = asid;
+    atomic_set(&desc->asid_switches, desc->asid_switches + 1);
+    if (hit) {
+        atomic_set(&desc->asid_hits, desc->asid_hits + 1);
+        return;
+    }
+#else
+    desc->asid = asid;
+    atomic_set(&desc->asid_switches, desc->asid_switches + 1);
+#endif
+    tlb_flush_current_mmuidx(env, mmu_idx);
+}
+
 size_t tlb_flush_count(void)
 {
     CPUState *cpu;
@@ -106,6 +421,42 @@ size_t tlb_flush_count(void)
     return count;
 }
 
+void dump_tlb_stats(FILE *f, fprintf_function cpu_fprintf)
+{
+    CPUState *cpu;
+    int mmu_idx;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        cpu_fprintf(f, "CPU#%d: %zu full flushes, victim TLB of %zu entries, "
+                    "%zu queued invalidations merged\n",
+                    cpu->cpu_index, atomic_read(&env->tlb_flush_count),
+                    env->vtlb_size, atomic_read(&env->tlb_pending_merges));
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+            size_t fills = atomic_read(&desc->fills);
+            size_t victim_hits = atomic_read(&desc->victim_hits);
+
+            size_t switches = atomic_read(&desc->asid_switches);
+
+            cpu_fprintf(f, "  mmu_idx %d: %zu entries, %zu fills, "
+                        "%zu victim hits (%zu%%), %zu flushes, "
+                        "%zu page flushes, %zu resizes, "
+                        "%zu asid switches (%zu%% reused)\n",
+                        mmu_idx, tlb_n_entries(env, mmu_idx), fills,
+                        victim_hits,
+                        fills + victim_hits
+                        ? victim_hits * 100 / (fills + victim_hits) : 0,
+                        atomic_read(&desc->flushes),
+                        atomic_read(&desc->page_flushes),
+                        atomic_read(&desc->resizes), switches,
+                        switches
+                        ? atomic_read(&desc->asid_hits) * 100 / switches : 0);
+        }
+    }
+}
+
 /* This is OK because CPU architectures generally permit an
  * implementation to drop entries from the TLB at any time, so
  * flushing more entries than required is only an efficiency issue,
@@ -114,6 +465,7 @@ size_t tlb_flush_count(void)
 static void tlb_flush_nocheck(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
 
     /* The QOM tests will trigger tlb_flushes without setting up TCG
      * so we bug out here in that case.
@@ -128,8 +480,9 @@ static void tlb_flush_nocheck(CPUState *cpu)
 
     tb_lock();
 
-    memset(env->tlb_table, -1, sizeof(env->tlb_table));
-    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_flush_one_mmuidx(env, mmu_idx);
+    }
     cpu_tb_jmp_cache_clear(cpu);
 
     env->vtlb_index = 0;
@@ -190,8 +543,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
         if (test_bit(mmu_idx, &mmu_idx_bitmask)) {
             tlb_debug("%d\n", mmu_idx);
 
-            memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
-            memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+            tlb_flush_one_mmuidx(env, mmu_idx);
         }
     }
 
@@ -244,9 +596,109 @@ void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     async_safe_run_on_cpu(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
 }
 
+static void tlb_set_asid_for_mmuidx_locally(CPUState *cpu, uint32_t asid,
+                                            uint16_t idxmap)
+{
+    CPUArchState *env = cpu->env_ptr;
+    unsigned long mmu_idx_bitmask = idxmap;
+    bool switched = false;
+    int mmu_idx;
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (!test_bit(mmu_idx, &mmu_idx_bitmask) ||
+            env->tlb_d[mmu_idx].asid == asid) {
+            continue;
+        }
+        if (!switched) {
+            tb_lock();
+            switched = true;
+        }
+        tlb_debug("mmu_idx %d: asid 0x%" PRIx32 " -> 0x%" PRIx32 "\n",
+                  mmu_idx, env->tlb_d[mmu_idx].asid, asid);
+        tlb_switch_asid(env, mmu_idx, asid);
+    }
+
+    if (switched) {
+        /* The jump cache is indexed by virtual address only.  */
+        cpu_tb_jmp_cache_clear(cpu);
+        tb_unlock();
+    }
+}
+
+static void tlb_set_asid_for_mmuidx_async_work(CPUState *cpu,
+                                               run_on_cpu_data data)
+{
+    assert_cpu_is_self(cpu);
+
+    tlb_set_asid_for_mmuidx_locally(cpu, data.target_ptr >> 16,
+                                    data.target_ptr & ALL_MMUIDX_BITS);
+}
+
+void tlb_set_asid_for_mmuidx(CPUState *cpu, uint32_t asid, uint16_t idxmap)
+{
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    /* Reset and migration set the ASID from the main thread.  */
+    if (cpu->created && !qemu_cpu_is_self(cpu)) {
+        async_run_on_cpu(cpu, tlb_set_asid_for_mmuidx_async_work,
+                         RUN_ON_CPU_TARGET_PTR((vaddr)asid << 16 | idxmap));
+    } else {
+        tlb_set_asid_for_mmuidx_locally(cpu, asid, idxmap);
+    }
+}
+
+/* The ASID goes above the MMU index bitmap.  */
+static void tlb_flush_asid_by_mmuidx_async_work(CPUState *cpu,
+                                                run_on_cpu_data data)
+{
+    CPUArchState *env = cpu->env_ptr;
+    uint32_t asid = data.target_ptr >> 16;
+    unsigned long mmu_idx_bitmask = data.target_ptr & ALL_MMUIDX_BITS;
+    bool flushed = false;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    tb_lock();
+
+    tlb_debug("asid 0x%" PRIx32 " mmu_idx:0x%04lx\n", asid, mmu_idx_bitmask);
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+
+        if (!test_bit(mmu_idx, &mmu_idx_bitmask)) {
+            continue;
+        }
+        if (desc->asid == asid) {
+            tlb_flush_current_mmuidx(env, mmu_idx);
+            flushed = true;
+        }
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+        else {
+            int i;
+
+            for (i = 0; i < CPU_TLB_DYN_CONTEXTS; i++) {
+                if (desc->ctx[i].asid == asid) {
+                    desc->ctx[i].valid = false;
+                }
+            }
+        }
+#endif
+    }
+
+    if (flushed) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
+    tb_unlock();
+}
+
 
 
-static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
+/* Return true if the entry mapped ADDR and has been flushed.  */
+static inline bool tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
 {
     if (addr == (tlb_entry->addr_read &
                  (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
@@ -255,14 +707,57 @@ static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
         addr == (tlb_entry->addr_code &
                  (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         memset(tlb_entry, -1, sizeof(*tlb_entry));
+        return true;
     }
+    return false;
+}
+
+static void tlb_flush_page_one_mmuidx(CPUArchState *env, int mmu_idx,
+                                      target_ulong addr)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+    size_t k;
+
+    if (tlb_flush_entry(tlb_entry(env, mmu_idx, addr), addr)) {
+        tlb_n_used_entries_dec(env, mmu_idx);
+    }
+
+    /* check whether there are vltb entries that need to be flushed */
+    for (k = 0; k < env->vtlb_size; k++) {
+        tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
+    }
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    /* Without tags on the entries a page is flushed from all address
+     * spaces, which covers both the by-ASID and the global mappings.
+     */
+    {
+        CPUTLBContext *c = desc->ctx;
+
+        for (; c < desc->ctx + CPU_TLB_DYN_CONTEXTS; c++) {
+            size_t index;
+
+            if (!c->valid) {
+                continue;
+            }
+            index = (addr >> TARGET_PAGE_BITS) &
+                    (c->mask >> CPU_TLB_ENTRY_BITS);
+            if (tlb_flush_entry(&c->table[index], addr)) {
+                c->n_used_entries--;
+            }
+            for (k = 0; k < env->vtlb_size; k++) {
+                tlb_flush_entry(&c->v_table[k], addr);
+            }
+        }
+    }
+#endif
+    atomic_set(&desc->page_flushes, desc->page_flushes + 1);
 }
 
 static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
     target_ulong addr = (target_ulong) data.target_ptr;
-    int i;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
@@ -280,17 +775,8 @@ static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
     }
 
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
-    }
-
-    /* check whether there are entries that need to be flushed in the vtlb */
-    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
-        }
+        tlb_flush_page_one_mmuidx(env, mmu_idx, addr);
     }
 
     tb_flush_jmp_cache(cpu, addr);
@@ -320,23 +806,16 @@ static void tlb_flush_page_by_mmuidx_async_work(CPUState *cpu,
     target_ulong addr_and_mmuidx = (target_ulong) data.target_ptr;
     target_ulong addr = addr_and_mmuidx & TARGET_PAGE_MASK;
     unsigned long mmu_idx_bitmap = addr_and_mmuidx & ALL_MMUIDX_BITS;
-    int page = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     int mmu_idx;
-    int i;
 
     assert_cpu_is_self(cpu);
 
-    tlb_debug("page:%d addr:"TARGET_FMT_lx" mmu_idx:0x%lx\n",
-              page, addr, mmu_idx_bitmap);
+    tlb_debug("addr:"TARGET_FMT_lx" mmu_idx:0x%lx\n",
+              addr, mmu_idx_bitmap);
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if (test_bit(mmu_idx, &mmu_idx_bitmap)) {
-            tlb_flush_entry(&env->tlb_table[mmu_idx][page], addr);
-
-            /* check whether there are vltb entries that need to be flushed */
-            for (i = 0; i < CPU_VTLB_SIZE; i++) {
-                tlb_flush_entry(&env->tlb_v_table[mmu_idx][i], addr);
-            }
+            tlb_flush_page_one_mmuidx(env, mmu_idx, addr);
         }
     }
 
@@ -435,6 +914,297 @@ void tlb_flush_page_all_cpus_synced(CPUState *src,
     async_safe_run_on_cpu(src, fn, RUN_ON_CPU_TARGET_PTR(addr));
 }
 
+/* A range covering more than this fraction of the entries of a TLB is
+ * not flushed page by page: each page flush also scans the victim TLB
+ * and the address spaces set aside, so flushing the whole MMU mode is
+ * cheaper by then.
+ */
+#define TLB_FLUSH_RANGE_FRACTION 8
+
+static void tlb_flush_range_by_mmuidx_locally(CPUState *cpu,
+                                              target_ulong start,
+                                              target_ulong last,
+                                              uint16_t idxmap)
+{
+    CPUArchState *env = cpu->env_ptr;
+    unsigned long mmu_idx_bitmap = idxmap;
+    target_ulong n_pages = ((last - start) >> TARGET_PAGE_BITS) + 1;
+    target_ulong addr;
+    uint16_t full_map = 0;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("range:" TARGET_FMT_lx "-" TARGET_FMT_lx " mmu_idx:0x%lx\n",
+              start, last, mmu_idx_bitmap);
+
+    /* Check if we need to flush due to large pages.  */
+    if (env->tlb_flush_addr <= last &&
+        start <= (env->tlb_flush_addr | ~env->tlb_flush_mask)) {
+        tlb_debug("forced full flush ("
+                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  env->tlb_flush_addr, env->tlb_flush_mask);
+
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(idxmap));
+        return;
+    }
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (!test_bit(mmu_idx, &mmu_idx_bitmap)) {
+            continue;
+        }
+        if (n_pages > tlb_n_entries(env, mmu_idx) / TLB_FLUSH_RANGE_FRACTION) {
+            full_map |= 1 << mmu_idx;
+            continue;
+        }
+        for (addr = start; ; addr += TARGET_PAGE_SIZE) {
+            tlb_flush_page_one_mmuidx(env, mmu_idx, addr);
+            if (addr == (last & TARGET_PAGE_MASK)) {
+                break;
+            }
+        }
+    }
+
+    if (full_map) {
+        /* This also clears the whole jump cache */
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full_map));
+    } else if (n_pages > TB_JMP_CACHE_SIZE / TB_JMP_PAGE_SIZE / 2) {
+        /* tb_flush_jmp_cache clears two pages' worth of the cache */
+        cpu_tb_jmp_cache_clear(cpu);
+    } else {
+        for (addr = start; ; addr += TARGET_PAGE_SIZE) {
+            tb_flush_jmp_cache(cpu, addr);
+            if (addr == (last & TARGET_PAGE_MASK)) {
+                break;
+            }
+        }
+    }
+}
+
+/* Run the invalidations other vCPUs queued for us.  DATA is non-zero
+ * for the safe work queued by synced flushes.
+ */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_FLUSHES];
+    unsigned int i, n;
+    uint16_t full;
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&env->tlb_pending_lock);
+    n = env->tlb_n_pending;
+    full = env->tlb_pending_full;
+    memcpy(pending, env->tlb_pending, n * sizeof(pending[0]));
+    env->tlb_n_pending = 0;
+    env->tlb_pending_full = 0;
+    if (data.host_int) {
+        env->tlb_pending_safe_queued = false;
+    } else {
+        env->tlb_pending_queued = false;
+    }
+    qemu_spin_unlock(&env->tlb_pending_lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        CPUTLBPendingFlush *p = &pending[i];
+        uint16_t idxmap = p->idxmap & ~full;
+
+        if (!idxmap) {
+            continue;
+        }
+        if (p->by_asid) {
+            tlb_flush_asid_by_mmuidx_async_work(cpu,
+                RUN_ON_CPU_TARGET_PTR((vaddr)p->asid << 16 | idxmap));
+        } else {
+            tlb_flush_range_by_mmuidx_locally(cpu, p->start, p->last, idxmap);
+        }
+    }
+}
+
+/* Try to fold P into the pending flush Q.  Ranges of the same MMU
+ * modes are merged when they overlap or are adjacent.
+ */
+static bool tlb_pending_merge(CPUTLBPendingFlush *q,
+                              const CPUTLBPendingFlush *p)
+{
+    if (q->idxmap != p->idxmap || q->by_asid != p->by_asid) {
+        return false;
+    }
+    if (p->by_asid) {
+        return q->asid == p->asid;
+    }
+    if ((q->last != (target_ulong)-1 && q->last + 1 < p->start) ||
+        (p->last != (target_ulong)-1 && p->last + 1 < q->start)) {
+        return false;
+    }
+    q->start = MIN(q->start, p->start);
+    q->last = MAX(q->last, p->last);
+    return true;
+}
+
+/* Queue P for CPU, coalescing it with what is already pending.  Only
+ * one run of tlb_flush_pending_async_work is queued at a time, however
+ * many invalidations it ends up doing.  SYNCED needs it to run as safe
+ * work, of which there is likewise at most one outstanding.  When the
+ * queue is full, the MMU modes concerned are flushed entirely instead.
+ */
+static void tlb_queue_pending_flush(CPUState *cpu, const CPUTLBPendingFlush *p,
+                                    bool synced)
+{
+    CPUArchState *env = cpu->env_ptr;
+    bool queue, queue_safe;
+    unsigned int i;
+
+    qemu_spin_lock(&env->tlb_pending_lock);
+    if ((p->idxmap & ~env->tlb_pending_full) == 0) {
+        goto merged;
+    }
+    for (i = 0; i < env->tlb_n_pending; i++) {
+        if (tlb_pending_merge(&env->tlb_pending[i], p)) {
+            goto merged;
+        }
+    }
+    if (env->tlb_n_pending < CPU_TLB_PENDING_FLUSHES) {
+        env->tlb_pending[env->tlb_n_pending++] = *p;
+    } else {
+        uint16_t full = p->idxmap;
+
+        for (i = 0; i < env->tlb_n_pending; i++) {
+            full |= env->tlb_pending[i].idxmap;
+        }
+        env->tlb_pending_full |= full;
+        env->tlb_n_pending = 0;
+    }
+    goto out;
+
+merged:
+    atomic_set(&env->tlb_pending_merges, env->tlb_pending_merges + 1);
+out:
+    queue = !env->tlb_pending_queued && !synced;
+    env->tlb_pending_queued |= queue;
+    queue_safe = !env->tlb_pending_safe_queued && synced;
+    env->tlb_pending_safe_queued |= queue_safe;
+    qemu_spin_unlock(&env->tlb_pending_lock);
+
+    if (queue_safe) {
+        async_safe_run_on_cpu(cpu, tlb_flush_pending_async_work,
+                              RUN_ON_CPU_HOST_INT(1));
+    } else if (queue) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
+    }
+}
+
+/* Queue P on all vCPUs but SRC.  */
+static void tlb_queue_pending_flush_all(CPUState *src,
+                                        const CPUTLBPendingFlush *p)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu != src) {
+            tlb_queue_pending_flush(cpu, p, false);
+        }
+    }
+}
+
+static void tlb_range_pending_flush(CPUTLBPendingFlush *p, target_ulong addr,
+                                    target_ulong len, uint16_t idxmap)
+{
+    p->start = addr & TARGET_PAGE_MASK;
+    p->last = addr + MAX(len, 1) - 1;
+    if (p->last < p->start) {
+        /* Wrapped around the top of the address space */
+        p->last = -1;
+    }
+    p->asid = 0;
+    p->idxmap = idxmap;
+    p->by_asid = false;
+}
+
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap)
+{
+    CPUTLBPendingFlush p;
+
+    tlb_debug("addr: "TARGET_FMT_lx" len: "TARGET_FMT_lx
+              " mmu_idx:%" PRIx16 "\n", addr, len, idxmap);
+
+    tlb_range_pending_flush(&p, addr, len, idxmap);
+    if (!qemu_cpu_is_self(cpu)) {
+        tlb_queue_pending_flush(cpu, &p, false);
+    } else {
+        tlb_flush_range_by_mmuidx_locally(cpu, p.start, p.last, idxmap);
+    }
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap)
+{
+    CPUTLBPendingFlush p;
+
+    tlb_debug("addr: "TARGET_FMT_lx" len: "TARGET_FMT_lx
+              " mmu_idx:%" PRIx16 "\n", addr, len, idxmap);
+
+    tlb_range_pending_flush(&p, addr, len, idxmap);
+    tlb_queue_pending_flush_all(src_cpu, &p);
+    tlb_flush_range_by_mmuidx_locally(src_cpu, p.start, p.last, idxmap);
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap)
+{
+    CPUTLBPendingFlush p;
+
+    tlb_debug("addr: "TARGET_FMT_lx" len: "TARGET_FMT_lx
+              " mmu_idx:%" PRIx16 "\n", addr, len, idxmap);
+
+    /* The source's own flush goes through its queue too, as safe work
+     * that only completes once the other vCPUs ran theirs.
+     */
+    tlb_range_pending_flush(&p, addr, len, idxmap);
+    tlb_queue_pending_flush_all(src_cpu, &p);
+    tlb_queue_pending_flush(src_cpu, &p, true);
+}
+
+void tlb_flush_asid_by_mmuidx(CPUState *cpu, uint32_t asid, uint16_t idxmap)
+{
+    CPUTLBPendingFlush p = {
+        .asid = asid,
+        .idxmap = idxmap,
+        .by_asid = true,
+    };
+
+    tlb_debug("asid 0x%" PRIx32 " mmu_idx:0x%" PRIx16 "\n", asid, idxmap);
+
+    if (!qemu_cpu_is_self(cpu)) {
+        tlb_queue_pending_flush(cpu, &p, false);
+    } else {
+        tlb_flush_asid_by_mmuidx_async_work(cpu,
+            RUN_ON_CPU_TARGET_PTR((vaddr)asid << 16 | idxmap));
+    }
+}
+
+void tlb_flush_asid_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                              uint32_t asid, uint16_t idxmap)
+{
+    CPUTLBPendingFlush p = {
+        .asid = asid,
+        .idxmap = idxmap,
+        .by_asid = true,
+    };
+
+    tlb_debug("asid 0x%" PRIx32 " mmu_idx:0x%" PRIx16 "\n", asid, idxmap);
+
+    tlb_queue_pending_flush_all(src_cpu, &p);
+    tlb_queue_pending_flush(src_cpu, &p, true);
+}
+
 /* update the TLBs so that writes to code in the virtual page 'addr'
    can be detected */
 void tlb_protect_code(ram_addr_t ram_addr)
@@ -535,19 +1305,44 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
     int mmu_idx;
 
     env = cpu->env_ptr;
+    /* Keep the owning vCPU from resizing the tables under us.  */
+    qemu_spin_lock(&env->tlb_lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        unsigned int i;
+        size_t i, n = tlb_n_entries(env, mmu_idx);
 
-        for (i = 0; i < CPU_TLB_SIZE; i++) {
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                   start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        for (i = 0; i < env->vtlb_size; i++) {
             tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
                                   start1, length);
         }
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+        /* Entries set aside must not bypass the notdirty check either
+         * once they are current again.
+         */
+        {
+            CPUTLBContext *c = env->tlb_d[mmu_idx].ctx;
+
+            for (; c < env->tlb_d[mmu_idx].ctx + CPU_TLB_DYN_CONTEXTS; c++) {
+                if (!c->valid) {
+                    continue;
+                }
+                n = (c->mask >> CPU_TLB_ENTRY_BITS) + 1;
+                for (i = 0; i < n; i++) {
+                    tlb_reset_dirty_range(&c->table[i], start1, length);
+                }
+                for (i = 0; i < env->vtlb_size; i++) {
+                    tlb_reset_dirty_range(&c->v_table[i], start1, length);
+                }
+            }
+        }
+#endif
     }
+    qemu_spin_unlock(&env->tlb_lock);
 }
 
 static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
@@ -562,20 +1357,18 @@ static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
     CPUArchState *env = cpu->env_ptr;
-    int i;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
 
     vaddr &= TARGET_PAGE_MASK;
-    i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+        tlb_set_dirty1(tlb_entry(env, mmu_idx, vaddr), vaddr);
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        size_t k;
+        for (k = 0; k < env->vtlb_size; k++) {
             tlb_set_dirty1(&env->tlb_v_table[mmu_idx][k], vaddr);
         }
     }
@@ -636,7 +1429,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     uintptr_t addend;
     CPUTLBEntry *te, *tv, tn;
     hwaddr iotlb, xlat, sz;
-    unsigned vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+    unsigned vidx = env->vtlb_index++ % env->vtlb_size;
     int asidx = cpu_asidx_from_attrs(cpu, attrs);
     /* Xiilnx: Make sure we use this for the attr instead of what
      * mainline uses. Otherwise the XPPU and XMPU don't work.
@@ -672,11 +1465,13 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     iotlb = memory_region_section_get_iotlb(cpu, section, vaddr, paddr, xlat,
                                             prot, &address);
 
-    index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    index = tlb_index(env, mmu_idx, vaddr);
     te = &env->tlb_table[mmu_idx][index];
     /* do not discard the translation in te, evict it into a victim tlb */
     tv = &env->tlb_v_table[mmu_idx][vidx];
 
+    tlb_count_fill(env, mmu_idx, te);
+
     /* addr_write can race with tlb_reset_dirty_range */
     copy_tlb_helper(tv, te, true);
 
@@ -815,7 +1610,7 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     }
 
     if (qemu_etrace_mask(ETRACE_F_MEM)) {
-        etrace_mem_access(&qemu_etracer, 0, 0,
+        etrace_mem_access(&qemu_etracer, cpu->cpu_index, 0,
                           addr, size, MEM_READ, val);
     }
 
@@ -866,7 +1661,7 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     }
 
     if (qemu_etrace_mask(ETRACE_F_MEM)) {
-        etrace_mem_access(&qemu_etracer, 0, 0,
+        etrace_mem_access(&qemu_etracer, cpu->cpu_index, 0,
                           addr, size, MEM_WRITE, val);
     }
 
@@ -885,8 +1680,10 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
     size_t vidx;
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
+
+    for (vidx = 0; vidx < env->vtlb_size; ++vidx) {
         CPUTLBEntry *vtlb = &env->tlb_v_table[mmu_idx][vidx];
         target_ulong cmp = *(target_ulong *)((uintptr_t)vtlb + elt_ofs);
 
@@ -894,6 +1691,10 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &env->tlb_table[mmu_idx][index];
 
+            atomic_set(&desc->victim_hits, desc->victim_hits + 1);
+            if (tlb_entry_is_empty(tlb)) {
+                tlb_n_used_entries_inc(env, mmu_idx);
+            }
             copy_tlb_helper(&tmptlb, tlb, false);
             copy_tlb_helper(tlb, vtlb, true);
             copy_tlb_helper(vtlb, &tmptlb, true);
@@ -926,8 +1727,8 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
     CPUIOTLBEntry *iotlbentry;
     hwaddr physaddr;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     mmu_idx = cpu_mmu_index(env, true);
+    index = tlb_index(env, mmu_idx, addr);
     if (unlikely(env->tlb_table[mmu_idx][index].addr_code !=
                  (addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK)))) {
         if (!VICTIM_TLB_HIT(addr_read, addr)) {
@@ -982,7 +1783,7 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
 void probe_write(CPUArchState *env, target_ulong addr, int mmu_idx,
                  uintptr_t retaddr)
 {
-    int index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    uintptr_t index = tlb_index(env, mmu_idx, addr);
     target_ulong tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
 
     if ((addr & TARGET_PAGE_MASK)
@@ -1001,7 +1802,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
                                NotDirtyInfo *ndi)
 {
     size_t mmu_idx = get_mmuidx(oi);
-    size_t index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    size_t index = tlb_index(env, mmu_idx, addr);
     CPUTLBEntry *tlbe = &env->tlb_table[mmu_idx][index];
     target_ulong tlb_addr = tlbe->addr_write;
     TCGMemOp mop = get_memop(oi);
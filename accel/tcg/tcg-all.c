@@ -33,6 +33,7 @@
 #include "qemu/main-loop.h"
 
 unsigned long tcg_tb_size;
+unsigned int tcg_vtlb_size;
 
 #ifndef CONFIG_USER_ONLY
 /* mask must never be zero, except for A20 change call */
@@ -0,0 +1,186 @@
+/*
+ * Generic vectorized operation runtime
+ *
+ * These are the out-of-line fallbacks for tcg_gen_gvec_*.  When the
+ * compiler supports generic vector types they are written in terms of
+ * 16 byte vectors, which it lowers to the host SIMD unit (SSE2 on x86).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "cpu.h"
+#include "exec/helper-proto.h"
+#include "tcg-gvec-desc.h"
+
+/* The vector registers of the guests are only guaranteed to be 8 byte
+ * aligned, so the vector types must not assume more than that.
+ */
+#ifdef CONFIG_VECTOR16
+#define DEF_VEC(NAME, TYPE) \
+    typedef TYPE NAME __attribute__((vector_size(16), aligned(8)))
+#else
+#define DEF_VEC(NAME, TYPE) typedef TYPE NAME
+#endif
+
+DEF_VEC(vec8, uint8_t);
+DEF_VEC(vec16, uint16_t);
+DEF_VEC(vec32, uint32_t);
+DEF_VEC(vec64, uint64_t);
+DEF_VEC(svec8, int8_t);
+DEF_VEC(svec16, int16_t);
+DEF_VEC(svec32, int32_t);
+DEF_VEC(svec64, int64_t);
+
+static inline void clear_high(void *d, intptr_t oprsz, uint32_t desc)
+{
+    intptr_t maxsz = simd_maxsz(desc);
+
+    if (unlikely(maxsz > oprsz)) {
+        memset(d + oprsz, 0, maxsz - oprsz);
+    }
+}
+
+/* Each helper runs the vector loop as far as whole vectors fit, then
+ * finishes an 8 byte operand (or remainder) element by element.
+ */
+#define DO_GVEC_2(NAME, TYPE, VTYPE, EXPR)                              \
+void HELPER(NAME)(void *d, void *a, uint32_t desc)                      \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i = 0;                                                     \
+                                                                        \
+    for (; i + sizeof(VTYPE) <= oprsz; i += sizeof(VTYPE)) {            \
+        VTYPE A = *(VTYPE *)(a + i);                                    \
+        *(VTYPE *)(d + i) = (EXPR);                                     \
+    }                                                                   \
+    for (; i < oprsz; i += sizeof(TYPE)) {                              \
+        TYPE A = *(TYPE *)(a + i);                                      \
+        *(TYPE *)(d + i) = (EXPR);                                      \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+#define DO_GVEC_2I(NAME, TYPE, VTYPE, OP)                               \
+void HELPER(NAME)(void *d, void *a, uint32_t desc)                      \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    int shift = simd_data(desc);                                        \
+    intptr_t i = 0;                                                     \
+                                                                        \
+    for (; i + sizeof(VTYPE) <= oprsz; i += sizeof(VTYPE)) {            \
+        *(VTYPE *)(d + i) = *(VTYPE *)(a + i) OP shift;                 \
+    }                                                                   \
+    for (; i < oprsz; i += sizeof(TYPE)) {                              \
+        *(TYPE *)(d + i) = *(TYPE *)(a + i) OP shift;                   \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+#define DO_GVEC_3(NAME, TYPE, VTYPE, EXPR)                              \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)             \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i = 0;                                                     \
+                                                                        \
+    for (; i + sizeof(VTYPE) <= oprsz; i += sizeof(VTYPE)) {            \
+        VTYPE A = *(VTYPE *)(a + i);                                    \
+        VTYPE B = *(VTYPE *)(b + i);                                    \
+        *(VTYPE *)(d + i) = (EXPR);                                     \
+    }                                                                   \
+    for (; i < oprsz; i += sizeof(TYPE)) {                              \
+        TYPE A = *(TYPE *)(a + i);                                      \
+        TYPE B = *(TYPE *)(b + i);                                      \
+        *(TYPE *)(d + i) = (EXPR);                                      \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+/* Vector comparisons already produce all-ones lanes for true, scalar
+ * comparisons need to be negated.
+ */
+#ifdef CONFIG_VECTOR16
+#define DO_GVEC_CMP(NAME, TYPE, VTYPE, OP)                              \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)             \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i = 0;                                                     \
+                                                                        \
+    for (; i + sizeof(VTYPE) <= oprsz; i += sizeof(VTYPE)) {            \
+        *(VTYPE *)(d + i) = (VTYPE)(*(VTYPE *)(a + i) OP                \
+                                    *(VTYPE *)(b + i));                 \
+    }                                                                   \
+    for (; i < oprsz; i += sizeof(TYPE)) {                              \
+        *(TYPE *)(d + i) = -(*(TYPE *)(a + i) OP *(TYPE *)(b + i));     \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+#else
+#define DO_GVEC_CMP(NAME, TYPE, VTYPE, OP)                              \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)             \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i;                                                         \
+                                                                        \
+    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                         \
+        *(TYPE *)(d + i) = -(*(TYPE *)(a + i) OP *(TYPE *)(b + i));     \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+#endif
+
+#define DO_GVEC_SIZES(MACRO, NAME, ARG)                  \
+    MACRO(glue(NAME, 8), uint8_t, vec8, ARG)            \
+    MACRO(glue(NAME, 16), uint16_t, vec16, ARG)         \
+    MACRO(glue(NAME, 32), uint32_t, vec32, ARG)         \
+    MACRO(glue(NAME, 64), uint64_t, vec64, ARG)
+
+#define DO_GVEC_SSIZES(MACRO, NAME, ARG)                 \
+    MACRO(glue(NAME, 8), int8_t, svec8, ARG)            \
+    MACRO(glue(NAME, 16), int16_t, svec16, ARG)         \
+    MACRO(glue(NAME, 32), int32_t, svec32, ARG)         \
+    MACRO(glue(NAME, 64), int64_t, svec64, ARG)
+
+DO_GVEC_SIZES(DO_GVEC_3, gvec_add, A + B)
+DO_GVEC_SIZES(DO_GVEC_3, gvec_sub, A - B)
+DO_GVEC_SIZES(DO_GVEC_2, gvec_neg, -A)
+
+DO_GVEC_2(gvec_mov, uint64_t, vec64, A)
+DO_GVEC_2(gvec_not, uint64_t, vec64, ~A)
+DO_GVEC_3(gvec_and, uint64_t, vec64, A & B)
+DO_GVEC_3(gvec_or, uint64_t, vec64, A | B)
+DO_GVEC_3(gvec_xor, uint64_t, vec64, A ^ B)
+DO_GVEC_3(gvec_andc, uint64_t, vec64, A & ~B)
+DO_GVEC_3(gvec_orc, uint64_t, vec64, A | ~B)
+
+DO_GVEC_SIZES(DO_GVEC_2I, gvec_shl, <<)
+DO_GVEC_SIZES(DO_GVEC_2I, gvec_shr, >>)
+DO_GVEC_SSIZES(DO_GVEC_2I, gvec_sar, >>)
+
+DO_GVEC_SIZES(DO_GVEC_CMP, gvec_eq, ==)
+DO_GVEC_SIZES(DO_GVEC_CMP, gvec_ne, !=)
+DO_GVEC_SSIZES(DO_GVEC_CMP, gvec_lt, <)
+DO_GVEC_SSIZES(DO_GVEC_CMP, gvec_le, <=)
+DO_GVEC_SIZES(DO_GVEC_CMP, gvec_ltu, <)
+DO_GVEC_SIZES(DO_GVEC_CMP, gvec_leu, <=)
+
+void HELPER(gvec_bitsel)(void *d, void *a, void *b, void *c, uint32_t desc)
+{
+    intptr_t oprsz = simd_oprsz(desc);
+    intptr_t i = 0;
+
+    for (; i + sizeof(vec64) <= oprsz; i += sizeof(vec64)) {
+        vec64 A = *(vec64 *)(a + i);
+        *(vec64 *)(d + i) = (A & *(vec64 *)(b + i))
+                            | (~A & *(vec64 *)(c + i));
+    }
+    for (; i < oprsz; i += sizeof(uint64_t)) {
+        uint64_t A = *(uint64_t *)(a + i);
+        *(uint64_t *)(d + i) = (A & *(uint64_t *)(b + i))
+                               | (~A & *(uint64_t *)(c + i));
+    }
+    clear_high(d, oprsz, desc);
+}
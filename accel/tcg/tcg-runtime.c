@@ -30,6 +30,7 @@
 #include "exec/tb-lookup.h"
 #include "disas/disas.h"
 #include "exec/log.h"
+#include "qemu/etrace.h"
 
 /* 32-bit helpers */
 
@@ -166,3 +167,8 @@ void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(ENV_GET_CPU(env), GETPC());
 }
+
+void HELPER(etrace_mem_flush)(CPUArchState *env)
+{
+    etrace_mem_flush(&qemu_etracer, ENV_GET_CPU(env));
+}
@@ -817,12 +817,11 @@ void tcg_exec_init(unsigned long tb_size)
  *
  * Called with tb_lock held.
  */
+/* The TB is carved out of this thread's code region, so no lock is needed. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
     TranslationBlock *tb;
 
-    assert_tb_locked();
-
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(tb == NULL)) {
         return NULL;
@@ -1242,14 +1241,24 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
 #endif
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+/* Called with mmap_lock held for user mode emulation, and without tb_lock.
+ *
+ * Translation and code generation only touch this thread's TCGContext and
+ * code region, so vCPUs translate concurrently. tb_lock is only taken to
+ * make the new TB visible. If another vCPU published the same TB in the
+ * meantime, ours is dropped and the existing one returned. If translated
+ * code was written to in the meantime, the guest code we read may be
+ * stale: translate again, this time with tb_lock held throughout.
+ */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags, int cflags)
 {
     CPUArchState *env = cpu->env_ptr;
-    TranslationBlock *tb;
+    TranslationBlock *tb, *existing_tb;
     tb_page_addr_t phys_pc, phys_page2;
+    bool locked = false;
+    unsigned code_write_gen;
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size;
@@ -1257,13 +1266,21 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
 #endif
+#ifdef CONFIG_USER_ONLY
     assert_memory_lock();
+#endif
+    tcg_debug_assert(!have_tb_lock);
 
     phys_pc = get_page_addr_code(env, pc);
 
+ retranslate:
+    code_write_gen = atomic_read(&tb_ctx.code_write_gen);
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
+        if (locked) {
+            tb_unlock();
+        }
         /* flush must be done */
         tb_flush(cpu);
         mmap_unlock();
@@ -1391,11 +1408,28 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
-    /* As long as consistency of the TB stuff is provided by tb_lock in user
-     * mode and is implicit in single-threaded softmmu emulation, no explicit
-     * memory barrier is required before tb_link_page() makes the TB visible
-     * through the physical hash table and physical page list.
+    /* The TB was filled in without tb_lock. Acquiring it orders those
+     * stores before tb_link_page() makes the TB visible through the
+     * physical hash table and physical page list.
      */
+    if (!locked) {
+        tb_lock();
+        locked = true;
+        if (unlikely(atomic_read(&tb_ctx.code_write_gen) != code_write_gen)) {
+            atomic_set(&tcg_ctx->code_gen_ptr, (void *)tb);
+            goto retranslate;
+        }
+    }
+    if (!(cflags & CF_NOCACHE)) {
+        existing_tb = tb_htable_lookup(cpu, pc, cs_base, flags,
+                                       cflags & CF_HASH_MASK);
+        if (unlikely(existing_tb)) {
+            /* Give the space back, nothing else has seen this TB. */
+            atomic_set(&tcg_ctx->code_gen_ptr, (void *)tb);
+            tb_unlock();
+            return existing_tb;
+        }
+    }
     tb_link_page(tb, phys_pc, phys_page2);
     g_tree_insert(tb_ctx.tb_tree, &tb->tc, tb);
 
@@ -1411,6 +1445,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                        tb->pc, phys_addr, tb->size,
                        tb->tc.ptr, gen_code_size);
     }
+    tb_unlock();
 
     return tb;
 }
@@ -1484,6 +1519,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
     if (!p) {
         return;
     }
+    atomic_inc(&tb_ctx.code_write_gen);
 #if defined(TARGET_HAS_PRECISE_SMC)
     if (cpu != NULL) {
         env = cpu->env_ptr;
@@ -1576,6 +1612,10 @@ void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len)
     if (!p) {
         return;
     }
+    /* Also count writes that miss the bitmap, they may hit a TB that is
+     * being translated and isn't in the bitmap yet.
+     */
+    atomic_inc(&tb_ctx.code_write_gen);
     if (!p->code_bitmap &&
         ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
         /* build code bitmap.  FIXME: writes should be protected by
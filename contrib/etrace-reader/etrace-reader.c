@@ -0,0 +1,338 @@
+/*
+ * Reader for compressed etrace files.
+ *
+ * Copyright (c) 2026 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ *
+ * Extracts the records within a guest time window, optionally for a set
+ * of units only, from a trace written with -etrace-flags compress. The
+ * output is a plain etrace stream so existing tools can consume it.
+ * Only the blocks whose index entry overlaps the request are inflated.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/etrace-format.h"
+
+#include <zlib.h>
+
+typedef struct EtraceReaderArgs {
+    const char *in_path;
+    const char *out_path;
+    uint64_t time_start;
+    uint64_t time_end;
+    bool filter_units;
+    struct etrace_zindex units;
+    bool dump_index;
+} EtraceReaderArgs;
+
+typedef struct EtraceReader {
+    FILE *in;
+    FILE *out;
+    struct etrace_zfile_hdr hdr;
+    struct etrace_zindex *index;
+    uint32_t nr_blocks;
+    uint8_t *comp;
+    uint8_t *raw;
+} EtraceReader;
+
+static void
+etrace_reader_usage(const char *name)
+{
+    printf("Usage: %s [opts] FILE\n"
+           "  -h: show this help\n"
+           "  -s <ns>: start of the guest time window\n"
+           "  -e <ns>: end of the guest time window\n"
+           "  -u <unit>: only output records of this unit, may be repeated\n"
+           "  -o <path>: output file, default stdout\n"
+           "  -i: dump the block index instead of records\n", name);
+}
+
+static void
+etrace_reader_parse_args(EtraceReaderArgs *args, int argc, char *argv[])
+{
+    unsigned long long v;
+    int c;
+
+    while ((c = getopt(argc, argv, "hs:e:u:o:i")) != -1) {
+        switch (c) {
+        case 'h':
+            etrace_reader_usage(argv[0]);
+            exit(0);
+            break;
+
+        case 's':
+        case 'e':
+            if (parse_uint_full(optarg, &v, 0) < 0) {
+                fprintf(stderr, "cannot parse time %s\n", optarg);
+                exit(1);
+            }
+            if (c == 's') {
+                args->time_start = v;
+            } else {
+                args->time_end = v;
+            }
+            break;
+
+        case 'u':
+            if (parse_uint_full(optarg, &v, 0) < 0 || v > UINT16_MAX) {
+                fprintf(stderr, "cannot parse unit %s\n", optarg);
+                exit(1);
+            }
+            args->filter_units = true;
+            etrace_zindex_set_unit(&args->units, v);
+            break;
+
+        case 'o':
+            args->out_path = optarg;
+            break;
+
+        case 'i':
+            args->dump_index = true;
+            break;
+
+        default:
+            etrace_reader_usage(argv[0]);
+            exit(1);
+            break;
+        }
+    }
+
+    if (optind != argc - 1) {
+        etrace_reader_usage(argv[0]);
+        exit(1);
+    }
+    args->in_path = argv[optind];
+
+    if (args->time_start > args->time_end) {
+        fprintf(stderr, "empty time window\n");
+        exit(1);
+    }
+}
+
+static bool
+etrace_reader_read_at(EtraceReader *r, uint64_t offset, void *buf, size_t len)
+{
+    if (fseeko(r->in, offset, SEEK_SET) < 0) {
+        return false;
+    }
+    return fread(buf, 1, len, r->in) == len;
+}
+
+/* Rebuild a coarse index by walking the blocks, for unfinished traces.  */
+static void
+etrace_reader_scan_blocks(EtraceReader *r)
+{
+    uint64_t offset = sizeof r->hdr;
+    struct etrace_zblock_hdr bh;
+    GArray *index = g_array_new(false, true, sizeof(struct etrace_zindex));
+
+    fprintf(stderr, "no index found, scanning blocks\n");
+    while (etrace_reader_read_at(r, offset, &bh, sizeof bh)) {
+        struct etrace_zindex ix;
+
+        memset(&ix, 0xff, sizeof ix);
+        ix.offset = offset;
+        ix.time_min = 0;
+        ix.time_max = UINT64_MAX;
+        g_array_append_val(index, ix);
+        offset += sizeof bh + bh.comp_len;
+    }
+
+    r->nr_blocks = index->len;
+    r->index = (void *) g_array_free(index, false);
+}
+
+static void
+etrace_reader_load_index(EtraceReader *r)
+{
+    struct etrace_zfile_trailer tr;
+    size_t len;
+
+    if (fseeko(r->in, -(off_t) sizeof tr, SEEK_END) < 0
+        || fread(&tr, 1, sizeof tr, r->in) != sizeof tr
+        || tr.magic != ETRACE_ZINDEX_MAGIC) {
+        etrace_reader_scan_blocks(r);
+        return;
+    }
+
+    len = tr.nr_blocks * sizeof r->index[0];
+    r->index = g_malloc(len);
+    r->nr_blocks = tr.nr_blocks;
+    if (!etrace_reader_read_at(r, tr.index_offset, r->index, len)) {
+        fprintf(stderr, "truncated index\n");
+        exit(1);
+    }
+}
+
+static bool
+etrace_reader_want_block(EtraceReaderArgs *args, struct etrace_zindex *ix)
+{
+    unsigned int i;
+
+    if (ix->time_max < args->time_start || ix->time_min > args->time_end) {
+        return false;
+    }
+    if (!args->filter_units) {
+        return true;
+    }
+    for (i = 0; i < ARRAY_SIZE(ix->unit_map); i++) {
+        if (ix->unit_map[i] & args->units.unit_map[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+etrace_reader_want_record(EtraceReaderArgs *args, struct etrace_hdr *hdr,
+                          bool first_block)
+{
+    uint64_t time;
+
+    /* The stream preamble is needed to make sense of the rest.  */
+    if (hdr->type == TYPE_INFO || hdr->type == TYPE_ARCH) {
+        return first_block;
+    }
+
+    if (args->filter_units
+        && !etrace_zindex_has_unit(&args->units, hdr->unit_id)) {
+        return false;
+    }
+
+    if (etrace_record_time(hdr, hdr + 1, &time)) {
+        return time >= args->time_start && time <= args->time_end;
+    }
+    return true;
+}
+
+/*
+ * Inflate one block and output the matching records.
+ * Returns false if the block is cut short, as the last block of a trace
+ * whose writer died can be.
+ */
+static bool
+etrace_reader_process_block(EtraceReaderArgs *args, EtraceReader *r,
+                            unsigned int n)
+{
+    struct etrace_zblock_hdr bh;
+    uLongf raw_len;
+    size_t pos;
+
+    if (!etrace_reader_read_at(r, r->index[n].offset, &bh, sizeof bh)) {
+        return false;
+    }
+
+    r->comp = g_realloc(r->comp, bh.comp_len);
+    r->raw = g_realloc(r->raw, bh.raw_len);
+    if (fread(r->comp, 1, bh.comp_len, r->in) != bh.comp_len) {
+        return false;
+    }
+
+    raw_len = bh.raw_len;
+    if (uncompress(r->raw, &raw_len, r->comp, bh.comp_len) != Z_OK
+        || raw_len != bh.raw_len) {
+        fprintf(stderr, "corrupt block %u\n", n);
+        exit(1);
+    }
+
+    pos = 0;
+    while (pos + sizeof(struct etrace_hdr) <= raw_len) {
+        struct etrace_hdr *hdr = (void *) (r->raw + pos);
+        size_t len = sizeof *hdr + hdr->len;
+
+        if (pos + len > raw_len) {
+            fprintf(stderr, "corrupt record in block %u\n", n);
+            exit(1);
+        }
+        if (etrace_reader_want_record(args, hdr, n == 0)) {
+            fwrite(hdr, 1, len, r->out);
+        }
+        pos += len;
+    }
+    return true;
+}
+
+static void
+etrace_reader_dump_index(EtraceReader *r)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < r->nr_blocks; i++) {
+        struct etrace_zindex *ix = &r->index[i];
+
+        printf("block %u offset %" PRIu64 " time %" PRIu64 "-%" PRIu64
+               " units", i, ix->offset, ix->time_min, ix->time_max);
+        for (j = 0; j <= ETRACE_ZINDEX_UNITS; j++) {
+            if (etrace_zindex_has_unit(ix, j)) {
+                printf(j < ETRACE_ZINDEX_UNITS ? " %u" : " %u+", j);
+            }
+        }
+        printf("\n");
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    EtraceReaderArgs args = {
+        .time_end = UINT64_MAX,
+    };
+    EtraceReader r = { 0 };
+    unsigned int i;
+
+    etrace_reader_parse_args(&args, argc, argv);
+
+    r.in = fopen(args.in_path, "rb");
+    if (!r.in) {
+        perror(args.in_path);
+        return 1;
+    }
+
+    if (fread(&r.hdr, 1, sizeof r.hdr, r.in) != sizeof r.hdr
+        || memcmp(r.hdr.magic, ETRACE_ZFILE_MAGIC, sizeof r.hdr.magic)) {
+        fprintf(stderr, "%s: not a compressed etrace file\n", args.in_path);
+        return 1;
+    }
+    if (r.hdr.version != ETRACE_ZFILE_VERSION) {
+        fprintf(stderr, "%s: unsupported version %u\n", args.in_path,
+                r.hdr.version);
+        return 1;
+    }
+
+    etrace_reader_load_index(&r);
+    if (args.dump_index) {
+        etrace_reader_dump_index(&r);
+        return 0;
+    }
+
+    r.out = args.out_path ? fopen(args.out_path, "wb") : stdout;
+    if (!r.out) {
+        perror(args.out_path);
+        return 1;
+    }
+
+    for (i = 0; i < r.nr_blocks; i++) {
+        if (i == 0 || etrace_reader_want_block(&args, &r.index[i])) {
+            if (!etrace_reader_process_block(&args, &r, i)) {
+                fprintf(stderr, "warning: block %u is truncated, "
+                        "stopping at the last complete block\n", i);
+                break;
+            }
+        }
+    }
+
+    if (fclose(r.out)) {
+        perror("write");
+        return 1;
+    }
+    fclose(r.in);
+    g_free(r.index);
+    g_free(r.comp);
+    g_free(r.raw);
+    return 0;
+}
@@ -37,6 +37,7 @@
 #include "sysemu/hw_accel.h"
 #include "sysemu/kvm.h"
 #include "sysemu/hax.h"
+#include "sysemu/accel.h"
 #include "qmp-commands.h"
 #include "exec/exec-all.h"
 
@@ -222,6 +223,17 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    if (qemu_opt_get(opts, "vtlb-size")) {
+        uint64_t n = qemu_opt_get_number(opts, "vtlb-size", 0);
+
+        if (n == 0 || n > TCG_VTLB_MAX_SIZE) {
+            error_setg(errp, "Invalid 'vtlb-size' setting %" PRIu64
+                       ", must be between 1 and %d", n, TCG_VTLB_MAX_SIZE);
+            return;
+        }
+        tcg_vtlb_size = n;
+    }
 }
 
 /* The current number of executed instructions is based on what we
@@ -20,6 +20,7 @@
 #include "qemu/osdep.h"
 
 #include <unistd.h>
+#include <zlib.h>
 #ifndef _WIN32
 #include <sys/socket.h>
 #include <qemu/sockets.h>
@@ -28,90 +29,71 @@
 
 #include "qemu-common.h"
 #include "qemu/etrace.h"
+#include "qemu/etrace-format.h"
 #include "qemu/timer.h"
+#include "qemu/cutils.h"
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
 
-/* Still under development.  */
-#define ETRACE_VERSION_MAJOR 0
-#define ETRACE_VERSION_MINOR 0
-
-enum {
-    TYPE_EXEC = 1,
-    TYPE_TB = 2,
-    TYPE_NOTE = 3,
-    TYPE_MEM = 4,
-    TYPE_ARCH = 5,
-    TYPE_BARRIER = 6,
-    TYPE_OLD_EVENT_U64 = 7,
-    TYPE_EVENT_U64 = 8,
-    TYPE_INFO = 0x4554,
+/* Per unit ring size in bytes, must be a power of 2.  */
+#define ETRACE_RING_SIZE (1 * 1024 * 1024)
+#define EXEC_CACHE_SIZE (16 * 1024)
+/* Raw bytes per block in the compressed container.  */
+#define ETRACE_ZBLOCK_SIZE (1 * 1024 * 1024)
+
+struct etrace_unit {
+    /*
+     * Serializes producers of this unit. Each vCPU has its own unit so
+     * this is normally uncontended, only the shared overflow unit sees
+     * several producers.
+     */
+    QemuSpin lock;
+
+    /*
+     * Ring of encoded records, laid out as in the output stream but each
+     * preceded by its uint64_t sequence number, see etrace_rec_end.
+     * head is only advanced by producers, tail only by the writer thread.
+     * wpos is the producer cursor while a record is being built.
+     */
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t wpos;
+    bool rec_dropped;
+    uint64_t dropped;
+
+    uint64_t exec_start;
+    bool exec_start_valid;
+    int64_t exec_start_time;
+    struct {
+        union {
+            struct etrace_entry64 t64[EXEC_CACHE_SIZE];
+            struct etrace_entry32 t32[2 * EXEC_CACHE_SIZE];
+        };
+        uint64_t start_time;
+        unsigned int pos;
+        unsigned int unit_id;
+    } exec_cache;
 };
 
-struct etrace_hdr {
-    uint16_t type;
-    uint16_t unit_id;
-    uint32_t len;
-} QEMU_PACKED;
-
-enum etrace_info_flags {
-    ETRACE_INFO_F_TB_CHAINING   = (1 << 0),
-};
+struct etrace_zstate {
+    uint32_t block_size;
+    /* Bytes written to the file so far.  */
+    uint64_t offset;
 
-struct etrace_info_data {
-    uint64_t attr;
-    struct {
-        uint16_t major;
-        uint16_t minor;
-    } version;
-} QEMU_PACKED;
+    /* Records waiting to be compressed, parsed is the number of bytes
+       that form whole records.  */
+    GByteArray *raw;
+    uint32_t parsed;
+    struct etrace_zindex cur;
 
-struct etrace_arch {
-    struct {
-        uint32_t arch_id;
-        uint8_t arch_bits;
-        uint8_t big_endian;
-    } guest, host;
-} QEMU_PACKED;
-
-struct etrace_exec {
-    uint64_t start_time;
-} QEMU_PACKED;
-
-struct etrace_note {
-    uint64_t time;
-} QEMU_PACKED;
-
-struct etrace_mem {
-    uint64_t time;
-    uint64_t vaddr;
-    uint64_t paddr;
-    uint64_t value;
-    uint32_t attr;
-    uint8_t size;
-    uint8_t padd[3];
-} QEMU_PACKED;
-
-struct etrace_tb {
-    uint64_t vaddr;
-    uint64_t paddr;
-    uint64_t host_addr;
-    uint32_t guest_code_len;
-    uint32_t host_code_len;
-} QEMU_PACKED;
-
-struct etrace_event_u64 {
-    uint32_t flags;
-    uint16_t unit_id;
-    uint16_t __reserved;
-    uint64_t time;
-    uint64_t val;
-    uint64_t prev_val;
-    uint16_t dev_name_len;
-    uint16_t event_name_len;
-} QEMU_PACKED;
+    uint8_t *comp;
+    size_t comp_size;
+    GArray *index;
+};
 
 const char *qemu_arg_etrace;
 const char *qemu_arg_etrace_flags;
@@ -133,7 +115,11 @@ struct {
     { "mem", ETRACE_F_MEM },
     { "cpu", ETRACE_F_CPU },
     { "gpio", ETRACE_F_GPIO },
-    { "all", ~0 },
+    { "drop", ETRACE_F_DROP },
+    { "compress", ETRACE_F_COMPRESS },
+    { "mem-ld", ETRACE_F_MEM_LD },
+    { "mem-st", ETRACE_F_MEM_ST },
+    { "all", ETRACE_F_ALL },
     { NULL, 0 },
 };
 
@@ -161,7 +147,28 @@ static uint64_t qemu_etrace_str2flags(const char *str, size_t len)
     return flags;
 }
 
-static uint64_t qemu_etrace_opts2flags(const char *opts)
+#define MEM_RANGE_PREFIX "mem-range="
+
+/* Parse mem-range=START-END, both inclusive.  */
+static void qemu_etrace_parse_mem_range(struct etracer *t,
+                                        const char *str, size_t len)
+{
+    char *s = g_strndup(str + strlen(MEM_RANGE_PREFIX),
+                        len - strlen(MEM_RANGE_PREFIX));
+    const char *end;
+    uint64_t start, last;
+
+    if (qemu_strtou64(s, &end, 0, &start) < 0 || *end != '-'
+        || qemu_strtou64(end + 1, NULL, 0, &last) < 0 || start > last) {
+        fprintf(stderr, "Invalid etrace memory range %s\n", s);
+        exit(EXIT_FAILURE);
+    }
+    t->mem_range_start = start;
+    t->mem_range_end = last;
+    g_free(s);
+}
+
+static uint64_t qemu_etrace_opts2flags(struct etracer *t, const char *opts)
 {
     uint64_t flags = 0;
     const char *prev = opts, *end = opts;
@@ -170,7 +177,11 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
         while (*end != ',' && *end != 0) {
             end++;
         }
-        flags |= qemu_etrace_str2flags(prev, end - prev);
+        if (!strncmp(prev, MEM_RANGE_PREFIX, strlen(MEM_RANGE_PREFIX))) {
+            qemu_etrace_parse_mem_range(t, prev, end - prev);
+        } else {
+            flags |= qemu_etrace_str2flags(prev, end - prev);
+        }
         while (*end == ',') {
             end++;
         }
@@ -179,20 +190,173 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
     return flags;
 }
 
-static void etrace_write(struct etracer *t, const void *buf, size_t len)
+static void etrace_disable(struct etracer *t)
+{
+    fclose(t->fp);
+    t->fp = NULL;
+    atomic_set(&qemu_etrace_enabled, false);
+
+    /* Nothing will be written anymore, don't keep what is queued.  */
+    if (t->z) {
+        g_byte_array_set_size(t->z->raw, 0);
+        t->z->parsed = 0;
+    }
+}
+
+/*
+ * Write to the file. Only called at init, from the writer thread and
+ * at close. If the peer goes away, tracing is disabled and the rest of
+ * the records are discarded.
+ */
+static void etrace_file_write(struct etracer *t, const void *buf, size_t len)
 {
     size_t r;
 
+    if (!t->fp) {
+        return;
+    }
+
     r = fwrite(buf, 1, len, t->fp);
-    if (feof(t->fp) || ferror(t->fp)) {
-        fprintf(stderr, "Etrace peer EOF/disconnected!\n");
-        /* FIXME: Allow qemu to continue?  */
-        fclose(t->fp);
-        t->fp = NULL;
-        exit(1);
+    if (r != len || feof(t->fp) || ferror(t->fp)) {
+        fprintf(stderr, "Etrace peer EOF/disconnected! Tracing disabled.\n");
+        etrace_disable(t);
+        return;
+    }
+    if (t->z) {
+        t->z->offset += len;
+    }
+}
+
+static void etrace_zblock_reset(struct etrace_zstate *z)
+{
+    memset(&z->cur, 0, sizeof z->cur);
+    z->cur.time_min = UINT64_MAX;
+}
+
+static void etrace_zflush_block(struct etracer *t)
+{
+    struct etrace_zstate *z = t->z;
+    struct etrace_zblock_hdr bh;
+    uLongf comp_len = compressBound(z->parsed);
+    int r;
+
+    if (!z->parsed || !t->fp) {
+        return;
+    }
+
+    if (z->comp_size < comp_len) {
+        z->comp_size = comp_len;
+        z->comp = g_realloc(z->comp, z->comp_size);
+    }
+
+    /* Favour speed, the writer has to keep up with all the vCPUs.  */
+    r = compress2(z->comp, &comp_len, z->raw->data, z->parsed, 1);
+    if (r != Z_OK) {
+        fprintf(stderr, "etrace: compression failed (%d)! Tracing disabled.\n",
+                r);
+        etrace_disable(t);
+        return;
+    }
+
+    if (z->cur.time_min > z->cur.time_max) {
+        /* Nothing with a time in this block, it matches any window.  */
+        z->cur.time_min = 0;
+        z->cur.time_max = UINT64_MAX;
+    }
+    z->cur.offset = z->offset;
+    g_array_append_val(z->index, z->cur);
+
+    bh.raw_len = z->parsed;
+    bh.comp_len = comp_len;
+    etrace_file_write(t, &bh, sizeof bh);
+    etrace_file_write(t, z->comp, comp_len);
+
+    g_byte_array_remove_range(z->raw, 0, z->parsed);
+    z->parsed = 0;
+    etrace_zblock_reset(z);
+}
+
+/* Queue records for compression, cutting blocks at record boundaries.  */
+static void etrace_zwrite(struct etracer *t, const void *buf, size_t len)
+{
+    struct etrace_zstate *z = t->z;
+
+    g_byte_array_append(z->raw, buf, len);
+    while (z->raw->len - z->parsed >= sizeof(struct etrace_hdr)) {
+        struct etrace_hdr *hdr = (void *) (z->raw->data + z->parsed);
+        uint64_t time;
+
+        if (z->raw->len - z->parsed - sizeof *hdr < hdr->len) {
+            /* The rest of this record is yet to come.  */
+            break;
+        }
+
+        etrace_zindex_set_unit(&z->cur, hdr->unit_id);
+        if (etrace_record_time(hdr, hdr + 1, &time)) {
+            z->cur.time_min = MIN(z->cur.time_min, time);
+            z->cur.time_max = MAX(z->cur.time_max, time);
+        }
+        z->parsed += sizeof *hdr + hdr->len;
+
+        if (z->parsed >= z->block_size) {
+            etrace_zflush_block(t);
+        }
+    }
+}
+
+static void etrace_zinit(struct etracer *t)
+{
+    struct etrace_zstate *z = g_new0(struct etrace_zstate, 1);
+    struct etrace_zfile_hdr fh = {
+        .magic = ETRACE_ZFILE_MAGIC,
+        .version = ETRACE_ZFILE_VERSION,
+        .block_size = ETRACE_ZBLOCK_SIZE,
+    };
+
+    z->block_size = ETRACE_ZBLOCK_SIZE;
+    z->raw = g_byte_array_sized_new(z->block_size * 2);
+    z->index = g_array_new(false, false, sizeof(struct etrace_zindex));
+    etrace_zblock_reset(z);
+    t->z = z;
+
+    etrace_file_write(t, &fh, sizeof fh);
+}
+
+/* Flush the last block and append the index.  */
+static void etrace_zfinish(struct etracer *t)
+{
+    struct etrace_zstate *z = t->z;
+    struct etrace_zfile_trailer tr;
+
+    etrace_zflush_block(t);
+
+    tr.index_offset = z->offset;
+    tr.nr_blocks = z->index->len;
+    tr.magic = ETRACE_ZINDEX_MAGIC;
+    etrace_file_write(t, z->index->data,
+                      z->index->len * sizeof(struct etrace_zindex));
+    etrace_file_write(t, &tr, sizeof tr);
+
+    g_byte_array_free(z->raw, true);
+    g_array_free(z->index, true);
+    g_free(z->comp);
+    g_free(z);
+    t->z = NULL;
+}
+
+/* Write records to the output stream.  */
+static void etrace_write(struct etracer *t, const void *buf, size_t len)
+{
+    if (!t->fp) {
+        /* Tracing was disabled, the writer still drains the rings.  */
+        return;
+    }
+
+    if (t->z) {
+        etrace_zwrite(t, buf, len);
+    } else {
+        etrace_file_write(t, buf, len);
     }
-    /* FIXME: Make this more robust.  */
-    assert(r == len);
 }
 
 static void etrace_write_header(struct etracer *t, uint16_t type,
@@ -206,6 +370,230 @@ static void etrace_write_header(struct etracer *t, uint16_t type,
     etrace_write(t, &hdr, sizeof hdr);
 }
 
+static void etrace_kick_writer(struct etracer *t)
+{
+    if (!atomic_xchg(&t->writer_kicked, true)) {
+        qemu_sem_post(&t->writer_sem);
+    }
+}
+
+static struct etrace_unit *etrace_unit_get(struct etracer *t,
+                                           unsigned int unit_id)
+{
+    unsigned int idx = MIN(unit_id, ETRACE_MAX_UNITS);
+    struct etrace_unit *u, *old;
+
+    u = atomic_rcu_read(&t->units[idx]);
+    if (likely(u)) {
+        return u;
+    }
+
+    u = g_new0(struct etrace_unit, 1);
+    qemu_spin_init(&u->lock);
+    u->size = ETRACE_RING_SIZE;
+    u->buf = g_malloc(u->size);
+    u->exec_cache.unit_id = unit_id;
+
+    old = atomic_cmpxchg(&t->units[idx], NULL, u);
+    if (old) {
+        /* Someone else beat us to it.  */
+        g_free(u->buf);
+        g_free(u);
+        u = old;
+    }
+    return u;
+}
+
+/*
+ * Wait for len bytes of space in the ring, unless we're asked to drop
+ * records or nobody is draining the ring anymore. Called with the unit
+ * lock held. The lock is dropped while backing off, so the unit may have
+ * changed under the caller when this returns.
+ */
+static bool etrace_ring_reserve(struct etracer *t, struct etrace_unit *u,
+                                size_t len)
+{
+    if (len > u->size) {
+        return false;
+    }
+
+    while (u->size - (u->head - atomic_load_acquire(&u->tail)) < len) {
+        if ((t->flags & ETRACE_F_DROP) || !atomic_read(&t->writer_running)) {
+            return false;
+        }
+        etrace_kick_writer(t);
+        qemu_spin_unlock(&u->lock);
+        g_usleep(10);
+        qemu_spin_lock(&u->lock);
+    }
+    return true;
+}
+
+static void etrace_ring_store(struct etrace_unit *u, uint32_t pos,
+                              const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t offset = pos & (u->size - 1);
+    uint32_t chunk = MIN(len, u->size - offset);
+
+    memcpy(u->buf + offset, p, chunk);
+    memcpy(u->buf, p + chunk, len - chunk);
+}
+
+static void etrace_ring_load(struct etrace_unit *u, uint32_t pos,
+                             void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    uint32_t offset = pos & (u->size - 1);
+    uint32_t chunk = MIN(len, u->size - offset);
+
+    memcpy(p, u->buf + offset, chunk);
+    memcpy(p + chunk, u->buf, len - chunk);
+}
+
+static void etrace_rec_put(struct etrace_unit *u, const void *buf, size_t len)
+{
+    if (u->rec_dropped) {
+        return;
+    }
+
+    etrace_ring_store(u, u->wpos, buf, len);
+    u->wpos += len;
+}
+
+/*
+ * Start a record of len payload bytes. The payload is then added with
+ * etrace_rec_put and published with etrace_rec_end. Must be called with
+ * the unit lock held.
+ */
+static void etrace_rec_begin(struct etracer *t, struct etrace_unit *u,
+                             uint16_t type, uint16_t unit_id, uint32_t len)
+{
+    struct etrace_hdr hdr = {
+        .type = type,
+        .unit_id = unit_id,
+        .len = len
+    };
+
+    u->rec_dropped = !etrace_ring_reserve(t, u, sizeof(uint64_t)
+                                                + sizeof hdr + len);
+    /* The sequence number is filled in when the record is published.  */
+    u->wpos = u->head + sizeof(uint64_t);
+    if (u->rec_dropped) {
+        u->dropped++;
+        return;
+    }
+    etrace_rec_put(u, &hdr, sizeof hdr);
+}
+
+/*
+ * Publish a record. Sequence numbers are taken from a counter shared by
+ * all units right before publishing, so the writer can interleave the
+ * rings in the order the records completed.
+ */
+static void etrace_rec_end(struct etracer *t, struct etrace_unit *u)
+{
+    uint64_t seq;
+
+    if (u->rec_dropped) {
+        u->rec_dropped = false;
+        return;
+    }
+
+    seq = atomic_fetch_inc(&t->seq);
+    etrace_ring_store(u, u->head, &seq, sizeof seq);
+    atomic_store_release(&u->head, u->wpos);
+    if (u->head - atomic_read(&u->tail) >= u->size / 2) {
+        etrace_kick_writer(t);
+    }
+}
+
+/* Write out the record at the tail of a ring, without its sequence.  */
+static void etrace_drain_rec(struct etracer *t, struct etrace_unit *u)
+{
+    struct etrace_hdr hdr;
+    uint32_t tail = u->tail + sizeof(uint64_t);
+    uint32_t end;
+
+    etrace_ring_load(u, tail, &hdr, sizeof hdr);
+    end = tail + sizeof hdr + hdr.len;
+    while (tail != end) {
+        uint32_t offset = tail & (u->size - 1);
+        uint32_t chunk = MIN(end - tail, u->size - offset);
+
+        etrace_write(t, u->buf + offset, chunk);
+        tail += chunk;
+    }
+    atomic_store_release(&u->tail, tail);
+}
+
+/*
+ * Merge the records published so far into the stream, lowest sequence
+ * number first. A record that is published while we drain may have a
+ * lower number than one we already wrote, it then comes out a little
+ * late.
+ */
+static void etrace_drain(struct etracer *t)
+{
+    struct {
+        struct etrace_unit *u;
+        uint32_t head;
+        uint64_t seq;
+    } act[ARRAY_SIZE(t->units)];
+    unsigned int nr_act = 0;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(t->units); i++) {
+        struct etrace_unit *u = atomic_rcu_read(&t->units[i]);
+
+        if (u) {
+            act[nr_act].u = u;
+            act[nr_act].head = atomic_load_acquire(&u->head);
+            if (act[nr_act].head != u->tail) {
+                etrace_ring_load(u, u->tail, &act[nr_act].seq,
+                                 sizeof act[nr_act].seq);
+                nr_act++;
+            }
+        }
+    }
+
+    while (nr_act) {
+        unsigned int min = 0;
+
+        for (i = 1; i < nr_act; i++) {
+            if (act[i].seq < act[min].seq) {
+                min = i;
+            }
+        }
+
+        etrace_drain_rec(t, act[min].u);
+        if (act[min].u->tail != act[min].head) {
+            etrace_ring_load(act[min].u, act[min].u->tail, &act[min].seq,
+                             sizeof act[min].seq);
+        } else {
+            act[min] = act[--nr_act];
+        }
+    }
+    if (t->fp) {
+        fflush(t->fp);
+    }
+}
+
+static void *etrace_writer_thread(void *opaque)
+{
+    struct etracer *t = opaque;
+
+    while (!atomic_read(&t->writer_quit)) {
+        /* Producers kick us when a ring gets half full, otherwise we
+           drain periodically to keep streaming peers fed.  */
+        qemu_sem_timedwait(&t->writer_sem, 10);
+        atomic_set(&t->writer_kicked, false);
+        etrace_drain(t);
+    }
+    etrace_drain(t);
+    return NULL;
+}
+
 #define UNIX_PREFIX "unix:"
 
 static int sk_unix_client(const char *descr)
@@ -279,6 +667,12 @@ bool etrace_init(struct etracer *t, const char *filename,
         return false;
     }
 
+    t->mem_range_end = UINT64_MAX;
+    t->flags = qemu_etrace_opts2flags(t, opts);
+    if (t->flags & ETRACE_F_COMPRESS) {
+        etrace_zinit(t);
+    }
+
     memset(&id, 0, sizeof id);
     id.version.major = ETRACE_VERSION_MAJOR;
     id.version.minor = ETRACE_VERSION_MINOR;
@@ -299,32 +693,53 @@ bool etrace_init(struct etracer *t, const char *filename,
     etrace_write_header(t, TYPE_ARCH, 0, sizeof arch);
     etrace_write(t, &arch, sizeof arch);
 
-    t->flags = qemu_etrace_opts2flags(opts);
+    qemu_sem_init(&t->writer_sem, 0);
+    t->writer_running = true;
+    qemu_thread_create(&t->writer, "etrace", etrace_writer_thread, t,
+                       QEMU_THREAD_JOINABLE);
     return true;
 }
 
-static void etrace_flush_exec_cache(struct etracer *t)
+/* Must be called with the unit lock held.  */
+static void etrace_flush_exec_cache(struct etracer *t, struct etrace_unit *u)
 {
-    size_t size64 = t->exec_cache.pos * sizeof t->exec_cache.t64[0];
-    size_t size32 = t->exec_cache.pos * sizeof t->exec_cache.t32[0];
-    size_t size = t->arch_bits == 32 ? size32 : size64;
+    size_t size64, size32, size;
     struct etrace_exec ex;
 
+    if (!u->exec_cache.pos) {
+        return;
+    }
+
+    /*
+     * Make room for the largest flush up front. This may drop the lock,
+     * so only look at the cache once it returns. The records below then
+     * fit without waiting again.
+     */
+    etrace_ring_reserve(t, u, 2 * (sizeof(uint64_t)
+                                   + sizeof(struct etrace_hdr))
+                              + sizeof ex + sizeof u->exec_cache.t64);
+
+    size64 = u->exec_cache.pos * sizeof u->exec_cache.t64[0];
+    size32 = u->exec_cache.pos * sizeof u->exec_cache.t32[0];
+    size = t->arch_bits == 32 ? size32 : size64;
     if (!size) {
         return;
     }
 
-    ex.start_time = t->exec_cache.start_time;
+    ex.start_time = u->exec_cache.start_time;
 
-    etrace_write_header(t, TYPE_EXEC, t->exec_cache.unit_id, size + sizeof ex);
-    etrace_write(t, &ex, sizeof ex);
-    etrace_write(t, &t->exec_cache.t64[0], size);
-    t->exec_cache.pos = 0;
-    memset(&t->exec_cache.t64[0], 0, sizeof t->exec_cache.t64);
+    etrace_rec_begin(t, u, TYPE_EXEC, u->exec_cache.unit_id, size + sizeof ex);
+    etrace_rec_put(u, &ex, sizeof ex);
+    etrace_rec_put(u, &u->exec_cache.t64[0], size);
+    etrace_rec_end(t, u);
+    u->exec_cache.pos = 0;
+    /* Only the entries we used can be dirty.  */
+    memset(&u->exec_cache.t64[0], 0, size);
 
     /* A barrier indicates that the other side can assume order across the
        the barrier.  */
-    etrace_write_header(t, TYPE_BARRIER, t->exec_cache.unit_id, 0);
+    etrace_rec_begin(t, u, TYPE_BARRIER, u->exec_cache.unit_id, 0);
+    etrace_rec_end(t, u);
 }
 
 #define PROXIMITY_MASK (~0xfff)
@@ -362,21 +777,23 @@ static bool qualify_merge(uint64_t start, uint64_t end,
 /* Exec cache accessors. To avoid duplicating src code we use the cpp.  */
 #define XC_ACCESSOR(field)                                                \
 static inline void execache_set_ ## field(struct etracer *t,              \
+                                          struct etrace_unit *u,          \
                                           unsigned int pos, uint64_t v)   \
 {                                                                         \
     if (t->arch_bits == 32) {                                             \
-        t->exec_cache.t32[pos].field = v;                                 \
+        u->exec_cache.t32[pos].field = v;                                 \
     } else {                                                              \
-        t->exec_cache.t64[pos].field = v;                                 \
+        u->exec_cache.t64[pos].field = v;                                 \
     }                                                                     \
 }                                                                         \
 static inline uint64_t execache_get_ ## field(struct etracer *t,          \
+                                              struct etrace_unit *u,      \
                                               unsigned int pos)           \
 {                                                                         \
     if (t->arch_bits == 32) {                                             \
-        return t->exec_cache.t32[pos].field;                              \
+        return u->exec_cache.t32[pos].field;                              \
     } else {                                                              \
-        return t->exec_cache.t64[pos].field;                              \
+        return u->exec_cache.t64[pos].field;                              \
     }                                                                     \
 }
 
@@ -394,49 +811,54 @@ void etrace_dump_exec(struct etracer *t, unsigned int unit_id,
                       uint64_t start, uint64_t end,
                       uint64_t start_time, uint32_t duration)
 {
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
     unsigned int pos;
 
-    if (unit_id != t->exec_cache.unit_id) {
-        etrace_flush_exec_cache(t);
-        t->exec_cache.unit_id = unit_id;
+    qemu_spin_lock(&u->lock);
+    if (unit_id != u->exec_cache.unit_id) {
+        etrace_flush_exec_cache(t, u);
+        u->exec_cache.unit_id = unit_id;
     }
 
-    pos = t->exec_cache.pos;
+    pos = u->exec_cache.pos;
     if (pos == 0) {
-        t->exec_cache.start_time = start_time;
+        u->exec_cache.start_time = start_time;
     }
 
     assert(t->arch_bits == 32 || t->arch_bits == 64);
     if (pos &&
-        qualify_merge(execache_get_start(t, pos), execache_get_end(t, pos),
+        qualify_merge(execache_get_start(t, u, pos),
+                      execache_get_end(t, u, pos),
                       start, end)) {
         /* Reuse the old entry.  */
         pos -= 1;
-        execache_set_duration(t, pos, execache_get_duration(t, pos) + duration);
+        execache_set_duration(t, u, pos,
+                              execache_get_duration(t, u, pos) + duration);
     } else {
         /* Advance.  */
-        t->exec_cache.pos += 1;
-        execache_set_start(t, pos, start);
-        execache_set_duration(t, pos, duration);
+        u->exec_cache.pos += 1;
+        execache_set_start(t, u, pos, start);
+        execache_set_duration(t, u, pos, duration);
     }
 
-    execache_set_end(t, pos, end);
+    execache_set_end(t, u, pos, end);
     if (!qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
-        assert(execache_get_start(t, pos) <= execache_get_end(t, pos));
+        assert(execache_get_start(t, u, pos) <= execache_get_end(t, u, pos));
     }
 
-    if (t->exec_cache.pos == EXEC_CACHE_SIZE) {
-        etrace_flush_exec_cache(t);
+    if (u->exec_cache.pos == EXEC_CACHE_SIZE) {
+        etrace_flush_exec_cache(t, u);
     }
+    qemu_spin_unlock(&u->lock);
 }
 
-static void etrace_dump_guestmem(struct etracer *t, AddressSpace *as,
+static void etrace_dump_guestmem(struct etrace_unit *u, AddressSpace *as,
                                  uint64_t guest_vaddr, uint64_t guest_paddr,
                                  size_t guest_len)
 {
 #if defined(CONFIG_USER_ONLY)
     /* Currently, user mode address are directly addressable.  */
-    etrace_write(t, (void *) (uintptr_t) guest_vaddr, guest_len);
+    etrace_rec_put(u, (void *) (uintptr_t) guest_vaddr, guest_len);
 #else
     unsigned char buf[8 * 1024];
 
@@ -452,7 +874,7 @@ static void etrace_dump_guestmem(struct etracer *t, AddressSpace *as,
         unsigned int copylen = guest_len > sizeof buf ? sizeof buf : guest_len;
 
         address_space_rw(as, guest_paddr, MEMTXATTRS_UNSPECIFIED, buf, copylen, 0);
-        etrace_write(t, buf, copylen);
+        etrace_rec_put(u, buf, copylen);
         guest_len -= copylen;
     }
 #endif
@@ -472,6 +894,7 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
                     size_t guest_len,
                     void *host_buf, size_t host_len)
 {
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
     struct etrace_tb tb;
     size_t size;
 
@@ -482,13 +905,18 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
     tb.host_code_len = host_len;
 
     size = sizeof tb + guest_len + host_len;
+    qemu_spin_lock(&u->lock);
     /* Write headers.  */
-    etrace_write_header(t, TYPE_TB, unit_id, size);
-    etrace_write(t, &tb, sizeof tb);
+    etrace_rec_begin(t, u, TYPE_TB, unit_id, size);
+    etrace_rec_put(u, &tb, sizeof tb);
     /* Guest code.  */
-    etrace_dump_guestmem(t, as, guest_vaddr, guest_paddr, guest_len);
+    if (!u->rec_dropped) {
+        etrace_dump_guestmem(u, as, guest_vaddr, guest_paddr, guest_len);
+    }
     /* Host/native code.  */
-    etrace_write(t, host_buf, host_len);
+    etrace_rec_put(u, host_buf, host_len);
+    etrace_rec_end(t, u);
+    qemu_spin_unlock(&u->lock);
 }
 
 static uint64_t etrace_time(void)
@@ -504,9 +932,9 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val)
 {
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
     struct etrace_mem mem;
 
-    etrace_flush_exec_cache(t);
     mem.time = etrace_time();
     mem.vaddr = guest_vaddr;
     mem.paddr = guest_paddr;
@@ -514,51 +942,125 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
     mem.size = size;
     mem.value = val;
 
+    qemu_spin_lock(&u->lock);
+    etrace_flush_exec_cache(t, u);
     /* Write headers.  */
-    etrace_write_header(t, TYPE_MEM, unit_id, sizeof mem);
-    etrace_write(t, &mem, sizeof mem);
+    etrace_rec_begin(t, u, TYPE_MEM, unit_id, sizeof mem);
+    etrace_rec_put(u, &mem, sizeof mem);
+    etrace_rec_end(t, u);
+    qemu_spin_unlock(&u->lock);
+}
+
+void etrace_mem_cpu_init(struct etracer *t, CPUState *cpu)
+{
+    if (!cpu->etrace_mem.buf) {
+        cpu->etrace_mem.buf = g_malloc0(ETRACE_MEM_RING_SIZE
+                                        << ETRACE_MEM_REC_SHIFT);
+    }
+}
+
+/*
+ * Turn the inline records of a vCPU into TYPE_MEM records. Called by
+ * the vCPU itself, from generated code when its ring may not fit the
+ * records of the next TB and when it leaves the cpu loop. The time of
+ * all records in a batch is the time of the flush and paddr is unknown.
+ */
+void etrace_mem_flush(struct etracer *t, CPUState *cpu)
+{
+    struct etrace_mem_rec *recs = (void *) cpu->etrace_mem.buf;
+    uint32_t head = cpu->etrace_mem.head;
+    uint32_t tail = cpu->etrace_mem.tail;
+    struct etrace_unit *u;
+    struct etrace_mem mem;
+
+    QEMU_BUILD_BUG_ON(sizeof *recs != 1 << ETRACE_MEM_REC_SHIFT);
+
+    if (head == tail) {
+        return;
+    }
+
+    u = etrace_unit_get(t, cpu->cpu_index);
+    qemu_spin_lock(&u->lock);
+    if (head - tail > ETRACE_MEM_RING_SIZE) {
+        /* A single TB produced more than fits, the oldest are gone.  */
+        u->dropped += head - tail - ETRACE_MEM_RING_SIZE;
+        tail = head - ETRACE_MEM_RING_SIZE;
+    }
+
+    etrace_flush_exec_cache(t, u);
+    memset(&mem, 0, sizeof mem);
+    mem.time = etrace_time();
+    for (; tail != head; tail++) {
+        struct etrace_mem_rec *rec = &recs[tail & (ETRACE_MEM_RING_SIZE - 1)];
+
+        mem.vaddr = rec->vaddr;
+        mem.value = rec->value;
+        mem.size = rec->info & 0xff;
+        mem.attr = rec->info & ETRACE_MEM_REC_F_STORE ? MEM_WRITE : MEM_READ;
+        etrace_rec_begin(t, u, TYPE_MEM, cpu->cpu_index, sizeof mem);
+        etrace_rec_put(u, &mem, sizeof mem);
+        etrace_rec_end(t, u);
+    }
+    qemu_spin_unlock(&u->lock);
+    cpu->etrace_mem.tail = tail;
 }
 
 void etrace_dump_exec_start(struct etracer *t,
                             unsigned int unit_id,
                             uint64_t start)
 {
-    assert(!t->exec_start_valid);
-    t->exec_start = start;
-    t->exec_start_time = etrace_time();
-    t->exec_start_valid = true;
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
+
+    assert(!u->exec_start_valid);
+    u->exec_start = start;
+    u->exec_start_time = etrace_time();
+    u->exec_start_valid = true;
 }
 
 void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end)
 {
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
     int64_t tdiff;
-    if (!t->exec_start_valid) {
-        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n", t->exec_start, end);
+
+    if (!u->exec_start_valid) {
+        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n", u->exec_start, end);
     }
-    tdiff = etrace_time() - t->exec_start_time;
+    tdiff = etrace_time() - u->exec_start_time;
     if (tdiff < 0) {
         printf("tdiff=%" PRId64 "\n", tdiff);
         fflush(NULL);
     }
     assert(tdiff >= 0);
-    assert(t->exec_start_valid);
-    t->exec_start_valid = false;
-    etrace_dump_exec(t, unit_id, t->exec_start, end, t->exec_start_time, tdiff);
+    assert(u->exec_start_valid);
+    u->exec_start_valid = false;
+    etrace_dump_exec(t, unit_id, u->exec_start, end, u->exec_start_time, tdiff);
+}
+
+bool etrace_exec_started(struct etracer *t, unsigned int unit_id)
+{
+    struct etrace_unit *u;
+
+    /* Don't allocate a ring just to find nothing was started.  */
+    u = atomic_rcu_read(&t->units[MIN(unit_id, ETRACE_MAX_UNITS)]);
+    return u && u->exec_start_valid;
 }
 
 void etrace_note_write(struct etracer *t, unsigned int unit_id,
                        void *buf, size_t len)
 {
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
     struct etrace_note nt;
 
-    etrace_flush_exec_cache(t);
-
     nt.time = etrace_time();
-    etrace_write_header(t, TYPE_NOTE, unit_id, sizeof nt + len);
-    etrace_write(t, &nt, sizeof nt);
-    etrace_write(t, buf, len);
+    qemu_spin_lock(&u->lock);
+    etrace_flush_exec_cache(t, u);
+    etrace_rec_begin(t, u, TYPE_NOTE, unit_id, sizeof nt + len);
+    etrace_rec_put(u, &nt, sizeof nt);
+    etrace_rec_put(u, buf, len);
+    etrace_rec_end(t, u);
+    qemu_spin_unlock(&u->lock);
 }
 
 int etrace_note_fprintf(FILE *fp,
@@ -584,11 +1086,10 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
                       const char *event_name,
                       uint64_t val, uint64_t prev_val)
 {
+    struct etrace_unit *u = etrace_unit_get(t, unit_id);
     struct etrace_event_u64 event;
     size_t dev_len, event_len;
 
-    etrace_flush_exec_cache(t);
-
     dev_len = strlen(dev_name) + 1;
     event_len = strlen(event_name) + 1;
 
@@ -599,17 +1100,56 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
     event.event_name_len = event_len;
     event.val = val;
     event.prev_val = prev_val;
-    etrace_write_header(t, TYPE_EVENT_U64, unit_id,
-                        sizeof event + dev_len + event_len);
-    etrace_write(t, &event, sizeof event);
-    etrace_write(t, dev_name, dev_len);
-    etrace_write(t, event_name, event_len);
+    qemu_spin_lock(&u->lock);
+    etrace_flush_exec_cache(t, u);
+    etrace_rec_begin(t, u, TYPE_EVENT_U64, unit_id,
+                     sizeof event + dev_len + event_len);
+    etrace_rec_put(u, &event, sizeof event);
+    etrace_rec_put(u, dev_name, dev_len);
+    etrace_rec_put(u, event_name, event_len);
+    etrace_rec_end(t, u);
+    qemu_spin_unlock(&u->lock);
 }
 
 void etrace_close(struct etracer *t)
 {
+    unsigned int i;
+
+    if (!t->writer_running) {
+        return;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(t->units); i++) {
+        struct etrace_unit *u = atomic_rcu_read(&t->units[i]);
+
+        if (u) {
+            qemu_spin_lock(&u->lock);
+            etrace_flush_exec_cache(t, u);
+            qemu_spin_unlock(&u->lock);
+        }
+    }
+
+    /* The writer does a final drain before it exits.  */
+    atomic_set(&t->writer_quit, true);
+    qemu_sem_post(&t->writer_sem);
+    qemu_thread_join(&t->writer);
+    atomic_set(&t->writer_running, false);
+
+    for (i = 0; i < ARRAY_SIZE(t->units); i++) {
+        struct etrace_unit *u = atomic_rcu_read(&t->units[i]);
+
+        if (u && u->dropped) {
+            fprintf(stderr, "etrace: ring %u dropped %" PRIu64 " records\n",
+                    i, u->dropped);
+        }
+    }
+
+    if (t->z) {
+        etrace_zfinish(t);
+    }
+
     if (t->fp) {
-        etrace_flush_exec_cache(t);
         fclose(t->fp);
+        t->fp = NULL;
     }
 }
@@ -848,6 +848,10 @@ void cpu_exec_unrealizefn(CPUState *cpu)
 
     cpu_list_remove(cpu);
 
+    if (tcg_enabled()) {
+        tlb_destroy(cpu);
+    }
+
     if (cc->vmsd != NULL) {
         vmstate_unregister(NULL, cc->vmsd, cpu);
     }
@@ -894,6 +898,9 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
         cc->tcg_initialize();
     }
+    if (tcg_enabled()) {
+        tlb_init(cpu);
+    }
 
 #ifndef CONFIG_USER_ONLY
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
@@ -3516,7 +3523,7 @@ static hwaddr
 flatview_extend_translation(FlatView *fv, hwaddr addr,
                                  hwaddr target_len,
                                  MemoryRegion *mr, hwaddr base, hwaddr len,
-                                 bool is_write)
+                                 bool is_write, MemTxAttrs attrs)
 {
     hwaddr done = 0;
     hwaddr xlat;
@@ -3533,7 +3540,7 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
         len = target_len;
         this_mr = flatview_translate(fv, addr, &xlat,
                                                    &len, is_write,
-                                                   &MEMTXATTRS_UNSPECIFIED);
+                                                   &attrs);
         if (this_mr != mr || xlat != base + done) {
             return done;
         }
@@ -3593,7 +3600,49 @@ void *address_space_map(AddressSpace *as,
 
     memory_region_ref(mr);
     *plen = flatview_extend_translation(fv, addr, len, mr, xlat,
-                                             l, is_write);
+                                             l, is_write,
+                                             MEMTXATTRS_UNSPECIFIED);
+    ptr = qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+    rcu_read_unlock();
+
+    return ptr;
+}
+
+/* Map a physical memory region into a host virtual address, translating
+ * with the given transaction attributes.
+ * Unlike address_space_map(), this never falls back to a bounce buffer.
+ * NULL is returned if @addr does not hit directly accessible RAM.
+ * Unmap with address_space_unmap().
+ */
+void *address_space_map_attr(AddressSpace *as,
+                             hwaddr addr,
+                             hwaddr *plen,
+                             bool is_write,
+                             MemTxAttrs attrs)
+{
+    hwaddr len = *plen;
+    hwaddr l, xlat;
+    MemoryRegion *mr;
+    void *ptr;
+    FlatView *fv;
+
+    if (len == 0) {
+        return NULL;
+    }
+
+    l = len;
+    rcu_read_lock();
+    fv = address_space_to_flatview(as);
+    mr = flatview_translate(fv, addr, &xlat, &l, is_write, &attrs);
+
+    if (!memory_access_is_direct(mr, is_write)) {
+        rcu_read_unlock();
+        return NULL;
+    }
+
+    memory_region_ref(mr);
+    *plen = flatview_extend_translation(fv, addr, len, mr, xlat,
+                                        l, is_write, attrs);
     ptr = qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
     rcu_read_unlock();
 
@@ -293,6 +293,23 @@ STEXI
 @item info opcount
 @findex info opcount
 Show dynamic compiler opcode counters
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tlb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show softmmu TLB sizes and counters",
+        .cmd        = hmp_info_tlb_stats,
+    },
+#endif
+
+STEXI
+@item info tlb-stats
+@findex info tlb-stats
+Show, for each CPU and MMU mode, the size of the softmmu TLB and its fill,
+victim TLB hit, flush and resize counters.
 ETEXI
 
     {
@@ -26,6 +26,9 @@
 #include "hw/qdev.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
+#include "qemu/bitmap.h"
+#include "qemu/queue.h"
+#include "sysemu/sysemu.h"
 #include "hw/sysbus.h"
 
 #ifndef NAND_ERR_DEBUG
@@ -72,6 +75,17 @@
 
 # define NUM_PARAMETER_PAGES_OFFSET    14
 
+/* Pages read from the drive on a cache miss, for sequential reads.  */
+#define NAND_CACHE_READAHEAD 8
+
+typedef struct NANDCachePage NANDCachePage;
+struct NANDCachePage {
+    uint64_t page;
+    bool dirty;
+    QTAILQ_ENTRY(NANDCachePage) lru;
+    uint8_t data[];
+};
+
 typedef struct NANDFlashState NANDFlashState;
 struct NANDFlashState {
     SysBusDevice parent_obj;
@@ -111,6 +125,22 @@ struct NANDFlashState {
     void (*blk_load)(NANDFlashState *s, uint64_t addr, uint64_t offset);
 
     uint32_t ioaddr_vmstate;
+
+    /* Page cache over blk, used when the drive holds data and OOB.
+     * Pages are kept as stored on the drive, data followed by OOB.
+     * Erased pages that are not cached are only tracked in erased and
+     * get written to the drive when the cache is flushed.
+     */
+    struct {
+        uint32_t max_pages;
+        uint32_t nr_pages;
+        uint32_t page_len;
+        GHashTable *map;
+        QTAILQ_HEAD(NANDCacheLRU, NANDCachePage) lru;
+        unsigned long *erased;
+        int inflight;
+        Notifier shutdown_notifier;
+    } cache;
 };
 
 #define TYPE_NAND "nand"
@@ -127,6 +157,256 @@ static void mem_and(uint8_t *dest, const uint8_t *src, size_t n)
     }
 }
 
+typedef struct NANDCacheWriteReq {
+    NANDFlashState *s;
+    QEMUIOVector qiov;
+    struct iovec iov;
+} NANDCacheWriteReq;
+
+static void nand_cache_write_done(void *opaque, int ret)
+{
+    NANDCacheWriteReq *req = opaque;
+
+    if (ret < 0) {
+        error_report("nand: write-back failed: %s", strerror(-ret));
+    }
+    req->s->cache.inflight--;
+    qemu_iovec_destroy(&req->qiov);
+    g_free(req->iov.iov_base);
+    g_free(req);
+}
+
+/* Write len bytes from buf, which is handed over, to the drive.  */
+static void nand_cache_write_async(NANDFlashState *s, uint64_t offset,
+                                   void *buf, uint64_t len)
+{
+    NANDCacheWriteReq *req = g_new(NANDCacheWriteReq, 1);
+
+    req->s = s;
+    req->iov.iov_base = buf;
+    req->iov.iov_len = len;
+    qemu_iovec_init_external(&req->qiov, &req->iov, 1);
+    s->cache.inflight++;
+    blk_aio_pwritev(s->blk, offset, &req->qiov, 0, nand_cache_write_done, req);
+}
+
+static void nand_cache_evict(NANDFlashState *s)
+{
+    NANDCachePage *p = QTAILQ_LAST(&s->cache.lru, NANDCacheLRU);
+
+    QTAILQ_REMOVE(&s->cache.lru, p, lru);
+    g_hash_table_remove(s->cache.map, &p->page);
+    s->cache.nr_pages--;
+
+    if (p->dirty) {
+        nand_cache_write_async(s, p->page * s->cache.page_len,
+                               g_memdup(p->data, s->cache.page_len),
+                               s->cache.page_len);
+    }
+    g_free(p);
+}
+
+static NANDCachePage *nand_cache_insert(NANDFlashState *s, uint64_t page)
+{
+    NANDCachePage *p;
+
+    if (s->cache.nr_pages >= s->cache.max_pages) {
+        nand_cache_evict(s);
+    }
+    p = g_malloc(sizeof *p + s->cache.page_len);
+    p->page = page;
+    p->dirty = false;
+    g_hash_table_insert(s->cache.map, &p->page, p);
+    QTAILQ_INSERT_HEAD(&s->cache.lru, p, lru);
+    s->cache.nr_pages++;
+    return p;
+}
+
+/* Read page, and the following uncached ones, from the drive.  */
+static void nand_cache_fill(NANDFlashState *s, uint64_t page)
+{
+    uint32_t len = s->cache.page_len;
+    uint64_t n, nr = 1;
+    uint8_t *buf;
+
+    /* Don't read around write-backs that have not landed yet.  */
+    if (s->cache.inflight) {
+        blk_drain(s->blk);
+    }
+
+    while (nr < NAND_CACHE_READAHEAD && page + nr < s->pages
+           && !test_bit(page + nr, s->cache.erased)
+           && !g_hash_table_contains(s->cache.map, &(uint64_t){page + nr})) {
+        nr++;
+    }
+
+    buf = g_malloc(nr * len);
+    if (blk_pread(s->blk, page * len, buf, nr * len) < 0) {
+        printf("read error in page %" PRIu64 "\n", page);
+        memset(buf, 0xff, nr * len);
+    }
+    /* Insert the readahead first so that page ends up most recent.  */
+    for (n = nr; n--;) {
+        memcpy(nand_cache_insert(s, page + n)->data, buf + n * len, len);
+    }
+    g_free(buf);
+}
+
+static NANDCachePage *nand_cache_get(NANDFlashState *s, uint64_t page)
+{
+    NANDCachePage *p = g_hash_table_lookup(s->cache.map, &page);
+
+    if (p) {
+        QTAILQ_REMOVE(&s->cache.lru, p, lru);
+        QTAILQ_INSERT_HEAD(&s->cache.lru, p, lru);
+        return p;
+    }
+
+    if (test_bit(page, s->cache.erased)) {
+        /* The page now lives in the cache, dirty.  */
+        clear_bit(page, s->cache.erased);
+        p = nand_cache_insert(s, page);
+        memset(p->data, 0xff, s->cache.page_len);
+        p->dirty = true;
+        return p;
+    }
+
+    nand_cache_fill(s, page);
+    return g_hash_table_lookup(s->cache.map, &page);
+}
+
+/* Copy len bytes at drive offset off out of the cache.  */
+static void nand_cache_read(NANDFlashState *s, uint64_t off,
+                            uint8_t *buf, uint64_t len)
+{
+    while (len) {
+        uint64_t page = off / s->cache.page_len;
+        uint32_t poff = off % s->cache.page_len;
+        uint32_t n = MIN(len, s->cache.page_len - poff);
+
+        if (page >= s->pages) {
+            memset(buf, 0xff, len);
+            return;
+        }
+        memcpy(buf, nand_cache_get(s, page)->data + poff, n);
+        off += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+/* Program len bytes at drive offset off, NAND style (AND).  */
+static void nand_cache_program(NANDFlashState *s, uint64_t off,
+                               const uint8_t *buf, uint64_t len)
+{
+    while (len) {
+        uint64_t page = off / s->cache.page_len;
+        uint32_t poff = off % s->cache.page_len;
+        uint32_t n = MIN(len, s->cache.page_len - poff);
+        NANDCachePage *p;
+
+        if (page >= s->pages) {
+            return;
+        }
+        p = nand_cache_get(s, page);
+        mem_and(p->data + poff, buf, n);
+        p->dirty = true;
+        off += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void nand_cache_erase(NANDFlashState *s, uint64_t page, uint64_t nr)
+{
+    nr = MIN(nr, s->pages - page);
+    for (; nr--; page++) {
+        NANDCachePage *p = g_hash_table_lookup(s->cache.map, &page);
+
+        if (p) {
+            memset(p->data, 0xff, s->cache.page_len);
+            p->dirty = true;
+        } else {
+            set_bit(page, s->cache.erased);
+        }
+    }
+}
+
+/* Write everything back and wait for it to reach the drive.  */
+static void nand_cache_flush(NANDFlashState *s)
+{
+    uint32_t len = s->cache.page_len;
+    NANDCachePage *p;
+    unsigned long start, end;
+    uint8_t *ff;
+
+    if (!s->cache.map) {
+        return;
+    }
+
+    QTAILQ_FOREACH(p, &s->cache.lru, lru) {
+        if (p->dirty) {
+            nand_cache_write_async(s, p->page * len, g_memdup(p->data, len),
+                                   len);
+            p->dirty = false;
+        }
+    }
+
+    /* Evictions of pages erased since may still be in flight, the
+     * erase must land after them.
+     */
+    blk_drain(s->blk);
+
+    ff = g_malloc(len << s->erase_shift);
+    memset(ff, 0xff, len << s->erase_shift);
+    start = find_first_bit(s->cache.erased, s->pages);
+    while (start < s->pages) {
+        end = find_next_zero_bit(s->cache.erased, s->pages, start);
+        end = MIN(end, start + (1 << s->erase_shift));
+        if (blk_pwrite(s->blk, start * len, ff, (end - start) * len, 0) < 0) {
+            printf("write error in page %lu\n", start);
+        }
+        bitmap_clear(s->cache.erased, start, end - start);
+        start = find_next_bit(s->cache.erased, s->pages, end);
+    }
+    g_free(ff);
+
+    blk_drain(s->blk);
+    blk_flush(s->blk);
+}
+
+static void nand_cache_vm_state_change(void *opaque, int running,
+                                       RunState state)
+{
+    if (!running) {
+        nand_cache_flush(opaque);
+    }
+}
+
+/* quit does not stop the VM, write back before the drive is closed.  */
+static void nand_cache_shutdown_notify(Notifier *n, void *data)
+{
+    NANDFlashState *s = container_of(n, NANDFlashState,
+                                     cache.shutdown_notifier);
+
+    nand_cache_flush(s);
+}
+
+static void nand_cache_init(NANDFlashState *s)
+{
+    s->cache.page_len = (1 << s->page_shift) + (1 << s->oob_shift);
+    s->cache.map = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&s->cache.lru);
+    s->cache.erased = bitmap_new(s->pages);
+    if (!s->cache.max_pages) {
+        s->cache.max_pages = 1;
+    }
+
+    qemu_add_vm_change_state_handler(nand_cache_vm_state_change, s);
+    s->cache.shutdown_notifier.notify = nand_cache_shutdown_notify;
+    qemu_register_shutdown_notifier(&s->cache.shutdown_notifier);
+}
+
 # define NAND_NO_AUTOINCR	0x00000001
 # define NAND_BUSWIDTH_16	0x00000002
 # define NAND_NO_PADDING	0x00000004
@@ -647,6 +927,9 @@ static void __nand_realize(DeviceState *dev, Error **errp)
         s->storage = (uint8_t *) memset(g_malloc(s->pages * pagesize),
                         0xff, s->pages * pagesize);
     }
+    if (s->blk && !s->mem_oob) {
+        nand_cache_init(s);
+    }
     /* Give s->ioaddr a sane value in case we save state before it is used. */
     s->ioaddr = s->io;
 }
@@ -692,6 +975,7 @@ static Property nand_properties[] = {
     DEFINE_PROP_UINT32("rank", NANDFlashState, rank, 0),
     DEFINE_PROP_UINT32("full-id-low", NANDFlashState, full_id_low, 0),
     DEFINE_PROP_UINT32("full-id-high", NANDFlashState, full_id_high, 0),
+    DEFINE_PROP_UINT32("cache-pages", NANDFlashState, cache.max_pages, 4096),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -987,20 +1271,7 @@ static void glue(nand_blk_write_, PAGE_SIZE)(NANDFlashState *s)
         }
     } else {
         off = PAGE_START(s->addr) + (s->addr & PAGE_MASK) + s->offset;
-        sector = off >> 9;
-        soff = off & 0x1ff;
-        if (blk_pread(s->blk, sector << BDRV_SECTOR_BITS, iobuf,
-                      (PAGE_SECTORS + 2) << BDRV_SECTOR_BITS) < 0) {
-            printf("read error in sector %" PRIu64 "\n", sector);
-            return;
-        }
-
-        mem_and(iobuf + soff, s->io, s->iolen);
-
-        if (blk_pwrite(s->blk, sector << BDRV_SECTOR_BITS, iobuf,
-                       (PAGE_SECTORS + 2) << BDRV_SECTOR_BITS, 0) < 0) {
-            printf("write error in sector %" PRIu64 "\n", sector);
-        }
+        nand_cache_program(s, off, s->io, s->iolen);
     }
     s->offset = 0;
     s->addr = addr_save;
@@ -1038,38 +1309,7 @@ static void glue(nand_blk_erase_, PAGE_SIZE)(NANDFlashState *s)
                 printf("write error in sector %" PRIu64 "\n", i);
             }
     } else {
-        addr = PAGE_START(addr);
-        page = addr >> 9;
-        if (blk_pread(s->blk, page << BDRV_SECTOR_BITS, iobuf,
-                      BDRV_SECTOR_SIZE) < 0) {
-            printf("read error in sector %" PRIu64 "\n", page);
-        }
-        memset(iobuf + (addr & 0x1ff), 0xff, (~addr & 0x1ff) + 1);
-        if (blk_pwrite(s->blk, page << BDRV_SECTOR_BITS, iobuf,
-                       BDRV_SECTOR_SIZE, 0) < 0) {
-            printf("write error in sector %" PRIu64 "\n", page);
-        }
-
-        memset(iobuf, 0xff, 0x200);
-        i = (addr & ~0x1ff) + 0x200;
-        for (addr += ((PAGE_SIZE + __oob_size) << s->erase_shift) - 0x200;
-                        i < addr; i += 0x200) {
-            if (blk_pwrite(s->blk, i, iobuf, BDRV_SECTOR_SIZE, 0) < 0) {
-                printf("write error in sector %" PRIu64 "\n",
-                       i >> 9);
-            }
-        }
-
-        page = i >> 9;
-        if (blk_pread(s->blk, page << BDRV_SECTOR_BITS, iobuf,
-                      BDRV_SECTOR_SIZE) < 0) {
-            printf("read error in sector %" PRIu64 "\n", page);
-        }
-        memset(iobuf, 0xff, ((addr - 1) & 0x1ff) + 1);
-        if (blk_pwrite(s->blk, page << BDRV_SECTOR_BITS, iobuf,
-                       BDRV_SECTOR_SIZE, 0) < 0) {
-            printf("write error in sector %" PRIu64 "\n", page);
-        }
+        nand_cache_erase(s, PAGE(addr), 1 << s->erase_shift);
     }
     s->offset = 0;
     s->addr = addr_save;
@@ -1094,17 +1334,10 @@ static void glue(nand_blk_load_, PAGE_SIZE)(NANDFlashState *s,
                             __oob_size);
             s->ioaddr = s->io + SECTOR_OFFSET(s->addr) + offset;
         } else {
-            /* blk_pread: reads data from PAGE_START(addr) */
-            if (blk_pread(s->blk, PAGE_START(addr), s->io,
-                          (PAGE_SECTORS + 2) << (BDRV_SECTOR_BITS+1)) < 0) {
-                printf("read error in sector %" PRIu64 "\n",
-                                PAGE_START(addr) >> 9);
-            }
-#ifdef HPSC
+            /* The page lands at the start of io, only that much is valid.  */
+            nand_cache_read(s, PAGE_START(addr), s->io,
+                            PAGE_SIZE + __oob_size);
             s->ioaddr = s->io + offset;
-#else
-            s->ioaddr = s->io + (PAGE_START(addr) & 0x1ff) + offset;
-#endif
         }
     } else {
         memcpy(s->io, s->storage + PAGE_START(s->addr) +
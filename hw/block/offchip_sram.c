@@ -17,6 +17,8 @@
 #include "hw/sysbus.h"
 #include "hw/qdev.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
 
 #include "hw/block/offchip_sram.h"
 
@@ -31,6 +33,9 @@
     } \
 } while (0);
 
+/* Granularity at which dirty SRAM is written back to the drive.  */
+#define OFFCHIP_SRAM_FLUSH_CHUNK 4096
+
 typedef struct OFFCHIP_SRAMState OFFCHIP_SRAMState;
 struct OFFCHIP_SRAMState {
 //    DeviceState parent_obj;
@@ -40,8 +45,25 @@ struct OFFCHIP_SRAMState {
     MemoryRegion iomem;
     BlockBackend *blk;
     uint32_t size;	/* size of SRAM */
+    uint32_t flush_interval;	/* write-back period in ms, 0 to disable */
+
+    /* Guest accesses go straight to storage, the drive is a write-back
+     * copy of it updated from the dirty log.
+     */
+    uint8_t *storage;
+    QEMUTimer *flush_timer;
+    VMChangeStateEntry *vmse;
+    Notifier shutdown_notifier;
+    /* Asynchronous write-backs not completed yet.  */
+    unsigned int inflight;
 };
 
+typedef struct OFFCHIP_SRAMWriteReq {
+    OFFCHIP_SRAMState *s;
+    QEMUIOVector qiov;
+    struct iovec iov;
+} OFFCHIP_SRAMWriteReq;
+
 #define TYPE_OFFCHIP_SRAM "offchip-sram"
 
 #define OFFCHIP_SRAM(obj) \
@@ -53,7 +75,7 @@ static const VMStateDescription vmstate_offchip_sram = {
     .minimum_version_id = 1,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(size, OFFCHIP_SRAMState),
-        /* XXX: do we want to save s->storage too? */
+        /* The contents are migrated as RAM.  */
         VMSTATE_END_OF_LIST()
     }
 };
@@ -63,19 +85,18 @@ void offchip_sram_write (void *opaque, hwaddr addr, uint64_t value64,
 {
     OFFCHIP_SRAMState *s = OFFCHIP_SRAM(opaque);
     assert (size < sizeof(uint64_t)); 
-    if (!s->blk) return ; 
-    blk_pwrite(s->blk, addr, &value64, size, 0);
+    memcpy(s->storage + addr, &value64, size);
+    memory_region_set_dirty(&s->iomem, addr, size);
 }
 
 uint64_t offchip_sram_read (void *opaque, hwaddr addr,
                          unsigned int size)
 {
-    uint64_t value64;
+    uint64_t value64 = 0;
     OFFCHIP_SRAMState *s = OFFCHIP_SRAM(opaque);
     assert (size < sizeof(uint64_t)); 
 
-    if (!s->blk) return 0; 
-    blk_pread(s->blk, addr, &value64, size);
+    memcpy(&value64, s->storage + addr, size);
     return value64;
 }
 
@@ -90,10 +111,124 @@ const MemoryRegionOps offchip_sram_ops = {
     }
 };
 
+static void offchip_sram_write_done(void *opaque, int ret)
+{
+    OFFCHIP_SRAMWriteReq *req = opaque;
+
+    if (ret < 0) {
+        error_report("offchip-sram: write-back failed: %s", strerror(-ret));
+    }
+    req->s->inflight--;
+    qemu_iovec_destroy(&req->qiov);
+    g_free(req->iov.iov_base);
+    g_free(req);
+}
+
+static void offchip_sram_write_back(OFFCHIP_SRAMState *s, uint64_t addr,
+                                    uint64_t len, bool sync)
+{
+    OFFCHIP_SRAMWriteReq *req;
+
+    if (sync) {
+        if (blk_pwrite(s->blk, addr, s->storage + addr, len, 0) < 0) {
+            error_report("offchip-sram: write-back failed");
+        }
+        return;
+    }
+
+    /* The guest keeps running, write back a copy of the range.  */
+    req = g_new(OFFCHIP_SRAMWriteReq, 1);
+    req->s = s;
+    s->inflight++;
+    req->iov.iov_base = g_memdup(s->storage + addr, len);
+    req->iov.iov_len = len;
+    qemu_iovec_init_external(&req->qiov, &req->iov, 1);
+    blk_aio_pwritev(s->blk, addr, &req->qiov, 0, offchip_sram_write_done, req);
+}
+
+/* Write the ranges dirtied since the last flush back to the drive.  */
+static void offchip_sram_flush(OFFCHIP_SRAMState *s, bool sync)
+{
+    DirtyBitmapSnapshot *snap;
+    uint64_t addr, start = 0;
+    bool in_run = false;
+
+    if (!s->blk) {
+        return;
+    }
+
+    if (sync) {
+        /* Let the asynchronous write-backs land first, they may hold
+         * older data for the same ranges.
+         */
+        blk_drain(s->blk);
+    } else if (s->inflight) {
+        /* Requests for the same chunk may complete out of order, keep
+         * the ranges dirty until the previous flush is done.
+         */
+        return;
+    }
+
+    snap = memory_region_snapshot_and_clear_dirty(&s->iomem, 0, s->size,
+                                                  DIRTY_MEMORY_VGA);
+    for (addr = 0; addr < s->size; addr += OFFCHIP_SRAM_FLUSH_CHUNK) {
+        uint64_t len = MIN(OFFCHIP_SRAM_FLUSH_CHUNK, s->size - addr);
+        bool dirty = memory_region_snapshot_get_dirty(&s->iomem, snap,
+                                                      addr, len);
+
+        if (dirty && !in_run) {
+            start = addr;
+            in_run = true;
+        } else if (!dirty && in_run) {
+            offchip_sram_write_back(s, start, addr - start, sync);
+            in_run = false;
+        }
+    }
+    if (in_run) {
+        offchip_sram_write_back(s, start, s->size - start, sync);
+    }
+    g_free(snap);
+
+    if (sync) {
+        blk_drain(s->blk);
+        blk_flush(s->blk);
+    }
+}
+
+static void offchip_sram_flush_timer(void *opaque)
+{
+    OFFCHIP_SRAMState *s = OFFCHIP_SRAM(opaque);
+
+    offchip_sram_flush(s, false);
+    timer_mod(s->flush_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME)
+                              + s->flush_interval);
+}
+
+/* Stopping the VM, e.g. at the end of migration, syncs the drive.  */
+static void offchip_sram_vm_state_change(void *opaque, int running,
+                                         RunState state)
+{
+    OFFCHIP_SRAMState *s = OFFCHIP_SRAM(opaque);
+
+    if (!running) {
+        offchip_sram_flush(s, true);
+    }
+}
+
+/* quit does not stop the VM, write back before the drive is closed.  */
+static void offchip_sram_shutdown_notify(Notifier *n, void *data)
+{
+    OFFCHIP_SRAMState *s = container_of(n, OFFCHIP_SRAMState,
+                                        shutdown_notifier);
+
+    offchip_sram_flush(s, true);
+}
+
 static void offchip_sram_realize(DeviceState *dev, Error **errp)
 {
     OFFCHIP_SRAMState*s = OFFCHIP_SRAM(dev);
     Error *local_err = NULL;
+    int64_t blk_len;
     DriveInfo *dinfo = drive_get_by_index(IF_PFLASH, s->pflash_index);
     if (dinfo) 
         s->blk = blk_by_legacy_dinfo(dinfo); 
@@ -101,26 +236,57 @@ static void offchip_sram_realize(DeviceState *dev, Error **errp)
         s->blk = NULL;
     if (s->blk) {
         if (blk_is_read_only(s->blk)) {
-            error_report("Can't use a read-only drive");
+            error_setg(errp, "Can't use a read-only drive");
             return ;
         }
         qdev_prop_set_drive(dev, "drive", s->blk, &error_fatal);
         blk_set_perm(s->blk, BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE,
                            BLK_PERM_ALL, &local_err);
         if (local_err) {
-            error_report_err(local_err);
+            error_propagate(errp, local_err);
             return ;
         }
     }
-    memory_region_init_io(&s->iomem, OBJECT(s), &offchip_sram_ops, s,
-                          "nvram", s->size);
+
+    memory_region_init_ram(&s->iomem, OBJECT(s), "nvram", s->size,
+                           &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return ;
+    }
+    s->storage = memory_region_get_ram_ptr(&s->iomem);
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->iomem);
+
+    if (!s->blk) {
+        return ;
+    }
+
+    blk_len = blk_getlength(s->blk);
+    if (blk_len < 0
+        || blk_pread(s->blk, 0, s->storage, MIN(s->size, blk_len)) < 0) {
+        error_setg(errp, "failed to read the SRAM contents from the drive");
+        return ;
+    }
+
+    memory_region_set_log(&s->iomem, true, DIRTY_MEMORY_VGA);
+    s->vmse = qemu_add_vm_change_state_handler(offchip_sram_vm_state_change,
+                                               s);
+    s->shutdown_notifier.notify = offchip_sram_shutdown_notify;
+    qemu_register_shutdown_notifier(&s->shutdown_notifier);
+    if (s->flush_interval) {
+        s->flush_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                      offchip_sram_flush_timer, s);
+        timer_mod(s->flush_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME)
+                                  + s->flush_interval);
+    }
     return ;
 }
 static Property offchip_sram_properties[] = {
     DEFINE_PROP_DRIVE("drive", OFFCHIP_SRAMState, blk),
     DEFINE_PROP_UINT32("pflash-index", OFFCHIP_SRAMState, pflash_index, 0),
     DEFINE_PROP_UINT32("size", OFFCHIP_SRAMState, size, 0),
+    DEFINE_PROP_UINT32("flush-interval", OFFCHIP_SRAMState, flush_interval,
+                       100),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -39,29 +39,30 @@
     } \
 } while (0);
 
-#define FDT_GENERIC_MAX_PATTERN_LEN 1024
-
-typedef struct TableListNode {
-    void *next;
-    char key[FDT_GENERIC_MAX_PATTERN_LEN];
+typedef struct TableEntry {
     FDTInitFn fdt_init;
     void *opaque;
-} TableListNode;
+} TableEntry;
 
-/* add a node to the table specified by *head_p */
+/* add an entry to the table specified by *table_p. A later registration
+ * of the same key takes precedence.
+ */
 
 static void add_to_table(
         FDTInitFn fdt_init,
         const char *key,
         void *opaque,
-        TableListNode **head_p)
+        GHashTable **table_p)
 {
-    TableListNode *nn = malloc(sizeof(*nn));
-    nn->next = (void *)(*head_p);
-    strcpy(nn->key, key);
-    nn->fdt_init = fdt_init;
-    nn->opaque = opaque;
-    *head_p = nn;
+    TableEntry *e = g_new(TableEntry, 1);
+
+    if (!*table_p) {
+        *table_p = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+    }
+    e->fdt_init = fdt_init;
+    e->opaque = opaque;
+    g_hash_table_insert(*table_p, g_strdup(key), e);
 }
 
 /* FIXME: add return codes that differentiate between not found and error */
@@ -74,62 +75,66 @@ static int fdt_init_search_table(
         char *node_path,
         FDTMachineInfo *fdti,
         const char *key, /* string to match */
-        TableListNode **head) /* head of the list to search */
+        GHashTable *table) /* table to search */
 {
-    TableListNode *c = *head;
-    if (c == NULL) {
+    TableEntry *e = table ? g_hash_table_lookup(table, key) : NULL;
+
+    if (e == NULL) {
         return 1;
-    } else if (!strcmp(key, c->key)) {
-        return c->fdt_init ? c->fdt_init(node_path, fdti, c->opaque) : 0;
     }
-    return fdt_init_search_table(node_path, fdti, key,
-        (TableListNode **)(&(*head)->next));
+    return e->fdt_init ? e->fdt_init(node_path, fdti, e->opaque) : 0;
 }
 
-TableListNode *compat_list_head;
+static GHashTable *compat_table;
 
 void add_to_compat_table(FDTInitFn fdt_init, const char *compat, void *opaque)
 {
-    add_to_table(fdt_init, compat, opaque, &compat_list_head);
+    add_to_table(fdt_init, compat, opaque, &compat_table);
 }
 
 int fdt_init_compat(char *node_path, FDTMachineInfo *fdti, const char *compat)
 {
-    return fdt_init_search_table(node_path, fdti, compat, &compat_list_head);
+    return fdt_init_search_table(node_path, fdti, compat, compat_table);
 }
 
-TableListNode *inst_bind_list_head;
+static GHashTable *inst_bind_table;
 
 void add_to_inst_bind_table(FDTInitFn fdt_init, const char *name, void *opaque)
 {
-    add_to_table(fdt_init, name, opaque, &inst_bind_list_head);
+    add_to_table(fdt_init, name, opaque, &inst_bind_table);
 }
 
 int fdt_init_inst_bind(char *node_path, FDTMachineInfo *fdti,
         const char *name)
 {
-    return fdt_init_search_table(node_path, fdti, name, &inst_bind_list_head);
+    return fdt_init_search_table(node_path, fdti, name, inst_bind_table);
+}
+
+static void dump_table_entry(gpointer key, gpointer value, gpointer opaque)
+{
+    TableEntry *e = value;
+
+    printf("key : %s, opaque data %p\n", (char *)key, e->opaque);
 }
 
-static void dump_table(TableListNode *head)
+static void dump_table(GHashTable *table)
 {
-    if (head == NULL) {
+    if (table == NULL) {
         return;
     }
-    printf("key : %s, opaque data %p\n", head->key, head->opaque);
-    dump_table(head->next);
+    g_hash_table_foreach(table, dump_table_entry, NULL);
 }
 
 void dump_compat_table(void)
 {
     printf("FDT COMPATIBILITY TABLE:\n");
-    dump_table(compat_list_head);
+    dump_table(compat_table);
 }
 
 void dump_inst_bind_table(void)
 {
     printf("FDT INSTANCE BINDING TABLE:\n");
-    dump_table(inst_bind_list_head);
+    dump_table(inst_bind_table);
 }
 
 void fdt_init_yield(FDTMachineInfo *fdti)
@@ -138,42 +143,26 @@ void fdt_init_yield(FDTMachineInfo *fdti)
     int this_yield = yield_index++;
 
     DB_PRINT(1, "Yield #%d\n", this_yield);
+    fdti->nr_waiters++;
     qemu_co_queue_wait(fdti->cq, NULL);
+    fdti->nr_waiters--;
     DB_PRINT(1, "Unyield #%d\n", this_yield);
 }
 
 void fdt_init_set_opaque(FDTMachineInfo *fdti, char *node_path, void *opaque)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques;
-        dp->node_path && strcmp(dp->node_path, node_path);
-        dp++);
-    if (!dp->node_path) {
-        dp->node_path = strdup(node_path);
-    }
-    dp->opaque = opaque;
+    g_hash_table_insert(fdti->dev_opaques, g_strdup(node_path), opaque);
 }
 
 int fdt_init_has_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return 1;
-         }
-    }
-    return 0;
+    return g_hash_table_lookup_extended(fdti->dev_opaques, node_path,
+                                        NULL, NULL);
 }
 
 void *fdt_init_get_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return dp->opaque;
-        }
-    }
-    return NULL;
+    return g_hash_table_lookup(fdti->dev_opaques, node_path);
 }
 
 FDTMachineInfo *fdt_init_new_fdti(void *fdt)
@@ -182,17 +171,16 @@ FDTMachineInfo *fdt_init_new_fdti(void *fdt)
     fdti->fdt = fdt;
     fdti->cq = g_malloc0(sizeof(*(fdti->cq)));
     qemu_co_queue_init(fdti->cq);
-    fdti->dev_opaques = g_malloc0(sizeof(*(fdti->dev_opaques)) *
-        (devtree_get_num_nodes(fdt) + 1));
+    fdti->dev_opaques = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, NULL);
     return fdti;
 }
 
 void fdt_init_destroy_fdti(FDTMachineInfo *fdti)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        g_free(dp->node_path);
+    g_hash_table_destroy(fdti->dev_opaques);
+    if (fdti->plan) {
+        g_hash_table_destroy(fdti->plan);
     }
-    g_free(fdti->dev_opaques);
     g_free(fdti);
 }
@@ -41,6 +41,8 @@
 #include "qemu/config-file.h"
 #include "qom/cpu.h"
 #include "block/block.h"
+#include "qemu/error-report.h"
+#include "qemu-version.h"
 
 #define HPSC
 #ifdef HPSC
@@ -75,7 +77,27 @@
 
 int fdt_serial_ports;
 
-static int simple_bus_fdt_init(char *bus_node_path, FDTMachineInfo *fdti);
+static GPtrArray *fdt_init_order(FDTMachineInfo *fdti);
+static void fdt_init_node(void *args);
+
+static char *fdt_plan_cache_path(void *fdt);
+static GPtrArray *fdt_plan_load(const char *path, FDTMachineInfo *fdti);
+static void fdt_plan_save(const char *path, FDTMachineInfo *fdti,
+                          GPtrArray *order);
+
+struct FDTInitNodeArgs {
+    char *node_path;
+    FDTMachineInfo *fdti;
+};
+
+/* Kinds of node bindings recorded in the plan cache.  */
+enum {
+    FDT_PLAN_INST = 'i',
+    FDT_PLAN_COMPAT = 'c',
+    FDT_PLAN_QDEV = 'q',
+    FDT_PLAN_INVALID = 'x',
+    FDT_PLAN_NONE = 'n',
+};
 
 static void fdt_get_irq_info_from_intc(FDTMachineInfo *fdti, qemu_irq *ret,
                                        char *intc_node_path,
@@ -184,6 +206,7 @@ FDTMachineInfo *fdt_generic_create_machine(void *fdt, qemu_irq *cpu_irq)
     char node_path[DT_PATH_LENGTH];
     QemuOpts *opts = qemu_opts_find(qemu_find_opts("smp-opts"), NULL);
     FDTMachineInfo *fdti = fdt_init_new_fdti(fdt);
+    char *plan_path = fdt_plan_cache_path(fdt);
 
     fdti->irq_base = cpu_irq;
 
@@ -191,10 +214,45 @@ FDTMachineInfo *fdt_generic_create_machine(void *fdt, qemu_irq *cpu_irq)
 
     /* parse the device tree */
     if (!qemu_devtree_get_root_node(fdt, node_path)) {
+        GPtrArray *order;
+        unsigned int i;
+
         memory_region_transaction_begin();
         fdt_init_set_opaque(fdti, node_path, NULL);
-        simple_bus_fdt_init(node_path, fdti);
+
+        /* Instantiate the nodes in dependency order. Dependencies the
+         * graph doesn't know about are still handled by fdt_init_yield,
+         * retry those once whenever another node has been visited.
+         * A cached plan for this DTB provides both the order and the
+         * bindings of the nodes.
+         */
+        if (plan_path) {
+            fdti->plan = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, g_free);
+        }
+        order = plan_path ? fdt_plan_load(plan_path, fdti) : NULL;
+        if (!order) {
+            order = fdt_init_order(fdti);
+        }
+        for (i = 0; i < order->len; i++) {
+            struct FDTInitNodeArgs *init_args = g_new0(struct FDTInitNodeArgs,
+                                                       1);
+            unsigned int n;
+
+            init_args->node_path = g_strdup(g_ptr_array_index(order, i));
+            init_args->fdti = fdti;
+            qemu_coroutine_enter(qemu_coroutine_create(fdt_init_node,
+                                                       init_args));
+            for (n = fdti->nr_waiters; n && qemu_co_enter_next(fdti->cq);
+                 n--) {
+                /* Each waiter gets one retry.  */
+            }
+        }
         while (qemu_co_enter_next(fdti->cq));
+        if (plan_path && fdti->plan_dirty) {
+            fdt_plan_save(plan_path, fdti, order);
+        }
+        g_ptr_array_free(order, true);
         fdt_init_all_irqs(fdti);
         memory_region_transaction_commit();
     } else {
@@ -212,17 +270,41 @@ FDTMachineInfo *fdt_generic_create_machine(void *fdt, qemu_irq *cpu_irq)
 
     DB_PRINT(0, "The value of smp_cpus is: %d\n", smp_cpus);
 
+    g_free(plan_path);
     return fdti;
 }
 
-struct FDTInitNodeArgs {
-    char *node_path;
-    char *parent_path;
-    FDTMachineInfo *fdti;
-};
-
 static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat);
 
+/* Replay a binding from the plan cache, see fdt_plan_cache_path().  */
+static int fdt_init_replay(char *node_path, FDTMachineInfo *fdti,
+                           const char *binding, const char *node_name)
+{
+    switch (binding[0]) {
+    case FDT_PLAN_INST:
+        return fdt_init_inst_bind(node_path, fdti, node_name);
+    case FDT_PLAN_COMPAT:
+        return fdt_init_compat(node_path, fdti, binding + 1);
+    case FDT_PLAN_QDEV:
+        return fdt_init_qdev(node_path, fdti, (char *)binding + 1);
+    case FDT_PLAN_INVALID:
+        qemu_fdt_setprop_string(fdti->fdt, node_path, "compatible",
+                                "invalidated");
+        return 0;
+    case FDT_PLAN_NONE:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+static char *fdt_init_qdev_binding(char *node_path, FDTMachineInfo *fdti)
+{
+    Object *dev = fdt_init_get_opaque(fdti, node_path);
+
+    return g_strdup_printf("%c%s", FDT_PLAN_QDEV, object_get_typename(dev));
+}
+
 static void fdt_init_node(void *args)
 {
     struct FDTInitNodeArgs *a = args;
@@ -230,10 +312,10 @@ static void fdt_init_node(void *args)
     FDTMachineInfo *fdti = a->fdti;
     g_free(a);
 
-    simple_bus_fdt_init(node_path, fdti);
-
     char *all_compats = NULL, *compat, *node_name, *next_compat;
     char *device_type = NULL;
+    const char *planned;
+    char *binding = NULL;
     int compat_len;
 
     DB_PRINT_NP(1, "enter\n");
@@ -244,8 +326,19 @@ static void fdt_init_node(void *args)
     if (!node_name) {
         printf("FDT: ERROR: nameless node: %s\n", node_path);
     }
+
+    planned = fdti->plan ? g_hash_table_lookup(fdti->plan, node_path) : NULL;
+    if (planned && *planned) {
+        if (!fdt_init_replay(node_path, fdti, planned, node_name)) {
+            DB_PRINT_NP(1, "replayed binding %s\n", planned);
+            goto exit;
+        }
+        DB_PRINT_NP(0, "stale binding %s in the plan cache\n", planned);
+    }
+
     if (!fdt_init_inst_bind(node_path, fdti, node_name)) {
         DB_PRINT_NP(0, "instance bind successful\n");
+        binding = g_strdup_printf("%c", FDT_PLAN_INST);
         goto exit;
     }
 
@@ -259,10 +352,14 @@ static void fdt_init_node(void *args)
     for (compat = all_compats; compat && compat_len; compat = next_compat+1) {
         char *compat_prefixed = g_strdup_printf("compatible:%s", compat);
         if (!fdt_init_compat(node_path, fdti, compat_prefixed)) {
+            binding = g_strdup_printf("%c%s", FDT_PLAN_COMPAT,
+                                      compat_prefixed);
+            g_free(compat_prefixed);
             goto exit;
         }
         g_free(compat_prefixed);
         if (!fdt_init_qdev(node_path, fdti, compat)) {
+            binding = fdt_init_qdev_binding(node_path, fdti);
             goto exit;
         }
         next_compat = memchr(compat, '\0', DT_PATH_LENGTH);
@@ -276,6 +373,7 @@ static void fdt_init_node(void *args)
                                    "device_type", NULL, false, NULL);
     device_type = g_strdup_printf("device_type:%s", device_type);
     if (!fdt_init_compat(node_path, fdti, device_type)) {
+        binding = g_strdup_printf("%c%s", FDT_PLAN_COMPAT, device_type);
         goto exit;
     }
 
@@ -284,15 +382,18 @@ static void fdt_init_node(void *args)
      * try with device_type.
      */
     if (!fdt_init_qdev(node_path, fdti, device_type)) {
+        binding = fdt_init_qdev_binding(node_path, fdti);
         goto exit;
     }
 
     if (!all_compats) {
+        binding = g_strdup_printf("%c", FDT_PLAN_NONE);
         goto exit;
     }
     DB_PRINT_NP(0, "FDT: Unsupported peripheral invalidated - "
                 "compatibilities %s\n", all_compats);
     qemu_fdt_setprop_string(fdti->fdt, node_path, "compatible", "invalidated");
+    binding = g_strdup_printf("%c", FDT_PLAN_INVALID);
 exit:
 
     DB_PRINT_NP(1, "exit\n");
@@ -300,32 +401,18 @@ exit:
     if (!fdt_init_has_opaque(fdti, node_path)) {
         fdt_init_set_opaque(fdti, node_path, NULL);
     }
+    if (binding && fdti->plan) {
+        g_hash_table_insert(fdti->plan, g_strdup(node_path), binding);
+        fdti->plan_dirty = true;
+    } else {
+        g_free(binding);
+    }
     g_free(node_path);
     g_free(all_compats);
     g_free(device_type);
     return;
 }
 
-static int simple_bus_fdt_init(char *node_path, FDTMachineInfo *fdti)
-{
-    int i;
-    int num_children = qemu_devtree_get_num_children(fdti->fdt, node_path,
-                                                        1);
-    char **children = qemu_devtree_get_children(fdti->fdt, node_path, 1);
-
-    DB_PRINT_NP(num_children ? 0 : 1, "num child devices: %d\n", num_children);
-
-    for (i = 0; i < num_children; i++) {
-        struct FDTInitNodeArgs *init_args = g_malloc0(sizeof(*init_args));
-        init_args->node_path = children[i];
-        init_args->fdti = fdti;
-        qemu_coroutine_enter(qemu_coroutine_create(fdt_init_node, init_args));
-    }
-
-    g_free(children);
-    return 0;
-}
-
 static qemu_irq fdt_get_gpio(FDTMachineInfo *fdti, char *node_path,
                              int* cur_cell, qemu_irq input,
                              const FDTGenericGPIOSet *gpio_set,
@@ -884,6 +971,387 @@ static const int fdt_generic_reg_cells_defaults[] = {
     0,
 };
 
+/* Instantiation dependency graph, see fdt_init_order().  */
+
+typedef struct FDTInitNode {
+    char *path;
+    /* Number of unresolved dependencies.  */
+    unsigned int nr_deps;
+    /* Indexes of the nodes depending on this one.  */
+    GArray *dependents;
+    bool is_cpu;
+    /* interrupt-parent phandle, inherited from the ancestors.  */
+    uint32_t intc_phandle;
+} FDTInitNode;
+
+typedef struct FDTInitGraph {
+    void *fdt;
+    GArray *nodes;
+    /* phandle -> node index + 1 */
+    GHashTable *by_phandle;
+} FDTInitGraph;
+
+/* phandle list properties and the cells property of their targets.  */
+static const struct {
+    const char *propname;
+    const char *cells_propname;
+    /* Number of cells after the phandle if there is no cells property.  */
+    int fixed_cells;
+} fdt_init_dep_props[] = {
+    { "interrupts-extended", "#interrupt-cells", -1 },
+    { "gpios", "#gpio-cells", -1 },
+    { "clocks", "#clock-cells", -1 },
+    { "resets", "#reset-cells", -1 },
+    { "power-domains", "#power-domain-cells", -1 },
+    { "remote-ports", NULL, 1 },
+    { "reg-extended", NULL, -1 },
+};
+
+static int fdt_init_graph_lookup(FDTInitGraph *g, uint32_t phandle)
+{
+    return GPOINTER_TO_UINT(g_hash_table_lookup(g->by_phandle,
+                                                GUINT_TO_POINTER(phandle))) - 1;
+}
+
+static void fdt_init_graph_add_dep(FDTInitGraph *g, unsigned int idx, int dep)
+{
+    if (dep < 0 || dep == idx) {
+        return;
+    }
+    g_array_index(g->nodes, FDTInitNode, idx).nr_deps++;
+    g_array_append_val(g_array_index(g->nodes, FDTInitNode, dep).dependents,
+                       idx);
+}
+
+static uint32_t fdt_init_graph_cells(FDTInitGraph *g, int target,
+                                     const char *cells_propname, int dflt)
+{
+    const char *path = g_array_index(g->nodes, FDTInitNode, target).path;
+    const fdt32_t *p = fdt_getprop(g->fdt, fdt_path_offset(g->fdt, path),
+                                   cells_propname, NULL);
+
+    return p ? fdt32_to_cpu(*p) : dflt;
+}
+
+/* Add a dependency for every phandle in a phandle + cells list.  */
+static void fdt_init_graph_add_list(FDTInitGraph *g, unsigned int idx,
+                                    const fdt32_t *cells, int len,
+                                    const char *cells_propname,
+                                    int fixed_cells, bool reg)
+{
+    unsigned int n = len / sizeof(*cells);
+    unsigned int i = 0;
+
+    while (i < n) {
+        int target = fdt_init_graph_lookup(g, fdt32_to_cpu(cells[i]));
+        int nc = fixed_cells;
+        int j;
+
+        if (target < 0) {
+            /* Can't tell how long the tuple is, stop here.  */
+            return;
+        }
+        fdt_init_graph_add_dep(g, idx, target);
+
+        if (reg) {
+            nc = 0;
+            for (j = 0; j < FDT_GENERIC_REG_TUPLE_LENGTH; j++) {
+                nc += fdt_init_graph_cells(g, target,
+                                           fdt_generic_reg_size_prop_names[j],
+                                           fdt_generic_reg_cells_defaults[j]);
+            }
+        } else if (cells_propname) {
+            nc = fdt_init_graph_cells(g, target, cells_propname, -1);
+        }
+        if (nc < 0) {
+            return;
+        }
+        i += 1 + nc;
+    }
+}
+
+static void fdt_init_graph_add_props(FDTInitGraph *g, unsigned int idx,
+                                     int offset)
+{
+    FDTInitNode *node = &g_array_index(g->nodes, FDTInitNode, idx);
+    int prop;
+
+    if (fdt_getprop(g->fdt, offset, "interrupts", NULL)) {
+        fdt_init_graph_add_dep(g, idx,
+                               fdt_init_graph_lookup(g, node->intc_phandle));
+    }
+
+    fdt_for_each_property_offset(prop, g->fdt, offset) {
+        const char *name;
+        const fdt32_t *val;
+        int len, i;
+
+        val = fdt_getprop_by_offset(g->fdt, prop, &name, &len);
+        if (!val) {
+            continue;
+        }
+        name = trim_vendor(name);
+
+        for (i = 0; i < ARRAY_SIZE(fdt_init_dep_props); i++) {
+            if (!strcmp(name, fdt_init_dep_props[i].propname)) {
+                fdt_init_graph_add_list(g, idx, val, len,
+                                        fdt_init_dep_props[i].cells_propname,
+                                        fdt_init_dep_props[i].fixed_cells,
+                                        !strcmp(name, "reg-extended"));
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(fdt_init_dep_props)
+            && g_str_has_suffix(name, "-gpios")) {
+            fdt_init_graph_add_list(g, idx, val, len, "#gpio-cells", -1,
+                                    false);
+        }
+    }
+}
+
+/*
+ * Work out the order in which to instantiate the nodes of the tree.
+ *
+ * A node depends on its parent and on the nodes it references through
+ * interrupt-parent, interrupts-extended, gpios, clocks, resets,
+ * power-domains, remote-ports and reg-extended. The nodes are sorted
+ * topologically, CPUs first whenever possible so that the CPU count is
+ * known early. Nodes involved in dependency cycles are reported and
+ * appended in tree order. The root node is not part of the result.
+ */
+static GPtrArray *fdt_init_order(FDTMachineInfo *fdti)
+{
+    FDTInitGraph g = {
+        .fdt = fdti->fdt,
+        .nodes = g_array_new(false, true, sizeof(FDTInitNode)),
+        .by_phandle = g_hash_table_new(g_direct_hash, g_direct_equal),
+    };
+    GPtrArray *order = g_ptr_array_new_with_free_func(g_free);
+    /* Node index at each depth of the walk, -1 for the root.  */
+    GArray *stack = g_array_new(false, false, sizeof(int));
+    GArray *offsets = g_array_new(false, false, sizeof(int));
+    GQueue cpu_ready, ready;
+    uint32_t root_intc = 0;
+    char path[DT_PATH_LENGTH];
+    int offset, depth = 0;
+    unsigned int i, nr_cycle = 0;
+    GString *cycle = g_string_new(NULL);
+
+    for (offset = fdt_next_node(g.fdt, -1, &depth); offset >= 0;
+         offset = fdt_next_node(g.fdt, offset, &depth)) {
+        const fdt32_t *intc = fdt_getprop(g.fdt, offset, "interrupt-parent",
+                                          NULL);
+        const char *device_type = fdt_getprop(g.fdt, offset, "device_type",
+                                              NULL);
+        uint32_t phandle = fdt_get_phandle(g.fdt, offset);
+        FDTInitNode node = { 0 };
+        int parent;
+        int idx = g.nodes->len;
+
+        g_array_set_size(stack, depth + 1);
+        if (depth == 0) {
+            root_intc = intc ? fdt32_to_cpu(*intc) : 0;
+            g_array_index(stack, int, 0) = -1;
+            continue;
+        }
+        parent = g_array_index(stack, int, depth - 1);
+        if (fdt_get_path(g.fdt, offset, path, sizeof path)) {
+            g_array_index(stack, int, depth) = parent;
+            continue;
+        }
+        g_array_index(stack, int, depth) = idx;
+        node.path = g_strdup(path);
+        node.dependents = g_array_new(false, false, sizeof(unsigned int));
+        node.is_cpu = device_type && !strcmp(device_type, "cpu");
+        if (intc) {
+            node.intc_phandle = fdt32_to_cpu(*intc);
+        } else if (parent >= 0) {
+            node.intc_phandle = g_array_index(g.nodes, FDTInitNode,
+                                              parent).intc_phandle;
+        } else {
+            node.intc_phandle = root_intc;
+        }
+        g_array_append_val(g.nodes, node);
+        g_array_append_val(offsets, offset);
+        if (phandle) {
+            g_hash_table_insert(g.by_phandle, GUINT_TO_POINTER(phandle),
+                                GUINT_TO_POINTER(idx + 1));
+        }
+        fdt_init_graph_add_dep(&g, idx, parent);
+    }
+
+    for (i = 0; i < g.nodes->len; i++) {
+        fdt_init_graph_add_props(&g, i, g_array_index(offsets, int, i));
+    }
+
+    /* Kahn's algorithm.  */
+    g_queue_init(&cpu_ready);
+    g_queue_init(&ready);
+    for (i = 0; i < g.nodes->len; i++) {
+        FDTInitNode *node = &g_array_index(g.nodes, FDTInitNode, i);
+
+        if (!node->nr_deps) {
+            g_queue_push_tail(node->is_cpu ? &cpu_ready : &ready,
+                              GUINT_TO_POINTER(i));
+        }
+    }
+    while (!g_queue_is_empty(&cpu_ready) || !g_queue_is_empty(&ready)) {
+        GQueue *q = g_queue_is_empty(&cpu_ready) ? &ready : &cpu_ready;
+        FDTInitNode *node = &g_array_index(g.nodes, FDTInitNode,
+                                           GPOINTER_TO_UINT(g_queue_pop_head(q)));
+        unsigned int j;
+
+        g_ptr_array_add(order, node->path);
+        node->path = NULL;
+        for (j = 0; j < node->dependents->len; j++) {
+            unsigned int d = g_array_index(node->dependents, unsigned int, j);
+            FDTInitNode *dn = &g_array_index(g.nodes, FDTInitNode, d);
+
+            if (!--dn->nr_deps) {
+                g_queue_push_tail(dn->is_cpu ? &cpu_ready : &ready,
+                                  GUINT_TO_POINTER(d));
+            }
+        }
+    }
+
+    /* Whatever is left is part of, or depends on, a cycle.  */
+    for (i = 0; i < g.nodes->len; i++) {
+        FDTInitNode *node = &g_array_index(g.nodes, FDTInitNode, i);
+
+        if (node->path) {
+            if (nr_cycle++ < 8) {
+                g_string_append_printf(cycle, " %s", node->path);
+            }
+            g_ptr_array_add(order, node->path);
+        }
+        g_array_free(node->dependents, true);
+    }
+    if (nr_cycle) {
+        warn_report("FDT: %u nodes are part of or depend on a dependency "
+                    "cycle:%s%s", nr_cycle, cycle->str,
+                    nr_cycle > 8 ? " ..." : "");
+    }
+    DB_PRINT(0, "instantiation order computed for %u nodes\n", order->len);
+
+    g_string_free(cycle, true);
+    g_array_free(stack, true);
+    g_array_free(offsets, true);
+    g_array_free(g.nodes, true);
+    g_hash_table_destroy(g.by_phandle);
+    return order;
+}
+
+/*
+ * Machine plan cache.
+ *
+ * With -machine fdt-plan-cache=DIR, the instantiation order and the
+ * binding each node resolved to (instance binding, compat handler or QOM
+ * type) are saved into DIR after boot. The file is keyed by a hash of the
+ * DTB and of the QEMU binary, so later boots of the same binary on the
+ * same DTB replay the plan and skip the dependency walk and the compatible
+ * lookups. The file is plain text:
+ *
+ *   QEMU-FDT-PLAN <version>
+ *   <node path>\t<binding>
+ *   ...
+ *
+ * An empty binding is resolved as if there was no plan.
+ */
+#define FDT_PLAN_MAGIC "QEMU-FDT-PLAN"
+#define FDT_PLAN_VERSION 1
+
+static char *fdt_plan_cache_path(void *fdt)
+{
+    const char *dir = qemu_opt_get(qemu_get_machine_opts(), "fdt-plan-cache");
+    static const char version[] = QEMU_VERSION QEMU_PKGVERSION;
+    GChecksum *sum;
+    struct stat st;
+    char *path;
+
+    if (!dir) {
+        return NULL;
+    }
+
+    sum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(sum, fdt, fdt_totalsize(fdt));
+    g_checksum_update(sum, (const guchar *)version, sizeof version);
+    /* There is no build ID, any relink of the binary changes these.  */
+    if (!stat("/proc/self/exe", &st)) {
+        g_checksum_update(sum, (const guchar *)&st.st_size,
+                          sizeof st.st_size);
+        g_checksum_update(sum, (const guchar *)&st.st_mtime,
+                          sizeof st.st_mtime);
+    }
+    path = g_strdup_printf("%s/%s.fdtplan", dir, g_checksum_get_string(sum));
+    g_checksum_free(sum);
+    return path;
+}
+
+/* Returns the instantiation order, or NULL if there is no usable plan.  */
+static GPtrArray *fdt_plan_load(const char *path, FDTMachineInfo *fdti)
+{
+    GPtrArray *order;
+    char *contents;
+    char **lines;
+    unsigned int i;
+
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        return NULL;
+    }
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    if (!lines[0] || strcmp(lines[0], FDT_PLAN_MAGIC " "
+                            stringify(FDT_PLAN_VERSION))) {
+        warn_report("FDT: ignoring the incompatible plan cache %s", path);
+        g_strfreev(lines);
+        return NULL;
+    }
+
+    order = g_ptr_array_new_with_free_func(g_free);
+    for (i = 1; lines[i]; i++) {
+        char *binding = strchr(lines[i], '\t');
+
+        if (!binding) {
+            continue;
+        }
+        *binding++ = '\0';
+        g_ptr_array_add(order, g_strdup(lines[i]));
+        g_hash_table_insert(fdti->plan, g_strdup(lines[i]),
+                            g_strdup(binding));
+    }
+    g_strfreev(lines);
+
+    DB_PRINT(0, "replaying %u nodes from %s\n", order->len, path);
+    return order;
+}
+
+static void fdt_plan_save(const char *path, FDTMachineInfo *fdti,
+                          GPtrArray *order)
+{
+    GString *s = g_string_new(FDT_PLAN_MAGIC " "
+                              stringify(FDT_PLAN_VERSION) "\n");
+    GError *err = NULL;
+    unsigned int i;
+
+    for (i = 0; i < order->len; i++) {
+        const char *node_path = g_ptr_array_index(order, i);
+        const char *binding = g_hash_table_lookup(fdti->plan, node_path);
+
+        g_string_append_printf(s, "%s\t%s\n", node_path,
+                               binding ? binding : "");
+    }
+
+    /* g_file_set_contents replaces the file atomically, so concurrent
+     * runs never see a partial plan.
+     */
+    if (!g_file_set_contents(path, s->str, s->len, &err)) {
+        warn_report("FDT: cannot save the plan cache: %s", err->message);
+        g_error_free(err);
+    }
+    g_string_free(s, true);
+}
+
 static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
 {
     Object *dev, *parent;
@@ -177,6 +177,22 @@ static void machine_set_hw_dtb(Object *obj, const char *value, Error **errp)
     ms->hw_dtb = g_strdup(value);
 }
 
+static char *machine_get_fdt_plan_cache(Object *obj, Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    return g_strdup(ms->fdt_plan_cache);
+}
+
+static void machine_set_fdt_plan_cache(Object *obj, const char *value,
+                                       Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    g_free(ms->fdt_plan_cache);
+    ms->fdt_plan_cache = g_strdup(value);
+}
+
 static char *machine_get_dumpdtb(Object *obj, Error **errp)
 {
     MachineState *ms = MACHINE(obj);
@@ -655,6 +671,13 @@ static void machine_initfn(Object *obj)
     object_property_set_description(obj, "hw-dtb",
                                     "A device tree used to describe the hardware to QEMU.",
                                     NULL);
+    object_property_add_str(obj, "fdt-plan-cache",
+                             machine_get_fdt_plan_cache,
+                             machine_set_fdt_plan_cache, NULL);
+    object_property_set_description(obj, "fdt-plan-cache",
+                                    "Directory caching the instantiation plan "
+                                    "of device tree machines",
+                                    NULL);
     object_property_add_bool(obj, "linux",
                              machine_get_linux, machine_set_linux, NULL);
     object_property_set_description(obj, "linux",
@@ -676,6 +699,7 @@ static void machine_finalize(Object *obj)
     g_free(ms->kernel_cmdline);
     g_free(ms->dtb);
     g_free(ms->dumpdtb);
+    g_free(ms->fdt_plan_cache);
     g_free(ms->dt_compatible);
     g_free(ms->firmware);
 }
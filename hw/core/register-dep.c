@@ -64,6 +64,38 @@ static inline uint64_t register_read_val(DepRegisterInfo *reg)
     return 0; /* unreachable */
 }
 
+/* Precompute what the access paths need to know about a register.  */
+static void register_compile(DepRegisterInfo *reg)
+{
+    const DepRegisterAccessInfo *ac = reg->access;
+    const DepRegisterGPIOMapping *gpio;
+    bool gpio_out = false;
+
+    for (gpio = ac->gpios; gpio && gpio->name; gpio++) {
+        if (!gpio->width) {
+            ((DepRegisterGPIOMapping *)gpio)->width = 1;
+        }
+        gpio_out |= !gpio->input;
+    }
+
+    reg->no_w_mask = ac->ro | ac->w1c;
+    reg->log_mask = 0;
+    if (ac->rsvd || ac->ge0 || ac->ge1) {
+        reg->log_mask |= LOG_GUEST_ERROR;
+    }
+    if (ac->ui0 || ac->ui1) {
+        reg->log_mask |= LOG_UNIMP;
+    }
+
+    /* if there are no debug msgs and no RMW requirement, mark for fast write */
+    reg->write_lite = !reg->debug && !ac->ro && !ac->w1c && !ac->pre_write;
+    /* no debug and no clear-on-read is a fast read */
+    reg->read_lite = !reg->debug && !ac->cor;
+    /* no side effects at all, accesses only touch the data */
+    reg->plain = ac->name && !reg->debug && !ac->cor && !ac->pre_write &&
+                 !ac->post_write && !ac->post_read && !gpio_out;
+}
+
 void dep_register_write(DepRegisterInfo *reg, uint64_t val, uint64_t we)
 {
     uint64_t old_val, new_val, test, no_w_mask;
@@ -72,19 +104,28 @@ void dep_register_write(DepRegisterInfo *reg, uint64_t val, uint64_t we)
 
     assert(reg);
 
-    ac = reg->access;
-    old_val = reg->data ? register_read_val(reg) : ac->reset;
-    if (reg->write_lite && !~we) { /* fast path!! */
-        new_val = val;
-        goto register_write_fast;
+    if (reg->plain && !qemu_loglevel_mask(reg->log_mask)) {
+        no_w_mask = reg->no_w_mask | ~we;
+        old_val = register_read_val(reg);
+        new_val = (val & ~no_w_mask) | (old_val & no_w_mask);
+        new_val &= ~(val & reg->access->w1c);
+        register_write_val(reg, new_val);
+        return;
     }
 
+    ac = reg->access;
     if (!ac || !ac->name) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: write to undefined device state "
                       "(written value: %#" PRIx64 ")\n", reg->prefix, val);
         return;
     }
 
+    old_val = reg->data ? register_read_val(reg) : ac->reset;
+    if (reg->write_lite && !~we && !qemu_loglevel_mask(reg->log_mask)) {
+        new_val = val;
+        goto register_write_fast;
+    }
+
     no_w_mask = ac->ro | ac->w1c | ~we;
 
     if (reg->debug) {
@@ -153,6 +194,10 @@ uint64_t dep_register_read(DepRegisterInfo *reg)
 
     assert(reg);
 
+    if (reg->plain) {
+        return register_read_val(reg);
+    }
+
     ac = reg->access;
     if (!ac || !ac->name) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: read from undefined device state\n",
@@ -196,14 +241,8 @@ void dep_register_reset(DepRegisterInfo *reg)
     if (!(val & ac->inhibit_reset)) {
         val = reg->access->reset;
     }
-    /* FIXME: move to init */
-    /* if there are no debug msgs and no RMW requirement, mark for fast write */
-    reg->write_lite = reg->debug || ac->ro || ac->w1c || ac->pre_write ||
-            ((ac->ge0 || ac->ge1) && qemu_loglevel_mask(LOG_GUEST_ERROR)) ||
-            ((ac->ui0 || ac->ui1) && qemu_loglevel_mask(LOG_UNIMP))
-             ? false : true;
-    /* no debug and no clear-on-read is a fast read */
-    reg->read_lite = reg->debug || ac->cor ? false : true;
+    /* debug may have been changed since init */
+    register_compile(reg);
 
     register_write_val(reg, val);
     dep_register_refresh_gpios(reg, ~val);
@@ -226,10 +265,6 @@ void dep_register_refresh_gpios(DepRegisterInfo *reg, uint64_t old_value)
             uint64_t gpio_value, gpio_value_old;
 
             qemu_irq gpo = qdev_get_gpio_out_named(DEVICE(reg), gpio->name, i);
-            /* FIXME: do at init time, not lazily in fast path */
-            if (!gpio->width) {
-                ((DepRegisterGPIOMapping *)gpio)->width = 1;
-            }
             gpio_value_old = extract64(old_value,
                                    gpio->bit_pos + i * gpio->width,
                                    gpio->width) ^ gpio->polarity;
@@ -264,10 +299,6 @@ static void register_gpio_handler(void *opaque, int n, int level)
     ac = reg->access;
     for (gpio = ac->gpios; gpio && gpio->name; gpio++) {
         if (gpio->input && !strcmp(gho->name, gpio->name)) {
-            /* FIXME: do at init time, not lazily in fast path */
-            if (!gpio->width) {
-                ((DepRegisterGPIOMapping *)gpio)->width = 1;
-            }
             register_write_val(reg, deposit64(register_read_val(reg),
                                               gpio->bit_pos + n * gpio->width,
                                               gpio->width,
@@ -293,6 +324,7 @@ void dep_register_init(DepRegisterInfo *reg)
 
     object_initialize((void *)reg, sizeof(*reg), TYPE_DEP_REGISTER);
 
+    register_compile(reg);
     ac = reg->access;
     for (gpio = ac->gpios; gpio && gpio->name; gpio++) {
         if (!gpio->num) {
@@ -59,6 +59,7 @@ struct RemotePortMemoryMaster {
     /* public */
     uint32_t rp_dev;
     bool relative;
+    bool posted_writes;
     uint32_t max_access_size;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
@@ -111,12 +112,21 @@ static void rp_io_access(MemoryTransaction *tr)
     len += tr->rw ? tr->size : 0;
 
     rp_rsp_mutex_lock(s->rp);
+    rp_expect_resp(s->rp, in.id, tr->rw && s->posted_writes);
     rp_write(s->rp, (void *) &pay, len);
 
-    rsp = rp_wait_resp(s->rp);
+    if (tr->rw && s->posted_writes) {
+        /* Posted writes complete immediately. The peer processes packets
+           in order so later reads still observe the write. No remote
+           clock comes back, so this is no sync point. Errors get logged
+           when the response arrives.  */
+        rp_rsp_mutex_unlock(s->rp);
+        rp_leave_iothread(s->rp);
+        return;
+    }
 
-    /* We dont support out of order answers yet.  */
-    assert(rsp.pkt->hdr.id == be32_to_cpu(pay.pkt.hdr.id));
+    rsp = rp_wait_resp(s->rp, in.id);
+    assert(rsp.pkt->hdr.id == in.id);
 
     if (!tr->rw) {
         data = rp_busaccess_rx_dataptr(s->peer, &rsp.pkt->busaccess_ext_base);
@@ -210,6 +220,8 @@ static bool rp_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
 static Property rp_properties[] = {
     DEFINE_PROP_UINT32("rp-chan0", RemotePortMemoryMaster, rp_dev, 0),
     DEFINE_PROP_BOOL("relative", RemotePortMemoryMaster, relative, false),
+    DEFINE_PROP_BOOL("posted-writes", RemotePortMemoryMaster, posted_writes,
+                     false),
     DEFINE_PROP_UINT32("max-access-size", RemotePortMemoryMaster,
                        max_access_size, RP_MAX_ACCESS_SIZE),
     DEFINE_PROP_END_OF_LIST()
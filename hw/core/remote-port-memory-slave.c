@@ -34,21 +34,60 @@
     } \
 } while (0);
 
-/* Slow path dealing with odd stuff like byte-enables.  */
+/* Slow path dealing with odd stuff like byte-enables.
+ *
+ * The byte-enable pattern repeats every byte_enable_len bytes. Consecutive
+ * enabled bytes are coalesced into spans so that every span costs a single
+ * access. RAM backed targets are mapped once and the spans are copied
+ * directly.
+ */
 static void process_data_slow(RemotePortMemorySlave *s,
                               struct rp_pkt *pkt,
                               DMADirection dir,
                               uint8_t *data, uint8_t *byte_en)
 {
-    unsigned int i;
     unsigned int byte_en_len = pkt->busaccess_ext_base.byte_enable_len;
+    unsigned int len = pkt->busaccess.len;
+    uint64_t addr = pkt->busaccess.addr;
+    dma_addr_t maplen = len;
+    uint8_t *ram;
+    unsigned int i = 0;
+
+    ram = dma_memory_map_attr(s->as, addr, &maplen, dir, s->attr);
+    if (ram && maplen < len) {
+        /* Crosses into something else, take the generic path.  */
+        dma_memory_unmap(s->as, ram, maplen, dir, 0);
+        ram = NULL;
+    }
+    if (ram) {
+        dma_barrier(s->as, dir);
+    }
+
+    while (i < len) {
+        unsigned int start;
 
-    for (i = 0; i < pkt->busaccess.len; i++) {
-        if (byte_en && !byte_en[i % byte_en_len]) {
+        if (!byte_en[i % byte_en_len]) {
+            i++;
             continue;
         }
-        dma_memory_rw_attr(s->as, pkt->busaccess.addr + i, data + i,
-                           1, dir, s->attr);
+
+        start = i;
+        while (i < len && byte_en[i % byte_en_len]) {
+            i++;
+        }
+
+        if (!ram) {
+            dma_memory_rw_attr(s->as, addr + start, data + start,
+                               i - start, dir, s->attr);
+        } else if (dir == DMA_DIRECTION_FROM_DEVICE) {
+            memcpy(ram + start, data + start, i - start);
+        } else {
+            memcpy(data + start, ram + start, i - start);
+        }
+    }
+
+    if (ram) {
+        dma_memory_unmap(s->as, ram, len, dir, len);
     }
 }
 
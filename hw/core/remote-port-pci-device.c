@@ -125,10 +125,10 @@ static uint64_t rp_io_read(void *opaque, hwaddr addr, unsigned size,
     in.stream_width = size;
     len = rp_encode_busaccess(s->peer, &pkt, &in);
     rp_rsp_mutex_lock(s->rp);
+    rp_expect_resp(s->rp, in.id, false);
     rp_write(s->rp, (void *) &pkt, len);
 
-    rsp = rp_wait_resp(s->rp);
-    /* We dont support out of order answers yet.  */
+    rsp = rp_wait_resp(s->rp, in.id);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pkt.hdr.id));
 
     data = rp_busaccess_rx_dataptr(s->peer, &rsp.pkt->busaccess_ext_base);
@@ -184,12 +184,11 @@ static void rp_io_write(void *opaque, hwaddr addr, uint64_t value,
     len = rp_encode_busaccess(s->peer, &pay.pkt, &in);
 
     rp_rsp_mutex_lock(s->rp);
+    rp_expect_resp(s->rp, in.id, false);
 
     rp_write(s->rp, (void *) &pay, len + size);
 
-    rsp = rp_wait_resp(s->rp);
-
-    /* We dont support out of order answers yet.  */
+    rsp = rp_wait_resp(s->rp, in.id);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pay.pkt.hdr.id));
     rclk = rsp.pkt->busaccess.timestamp;
     rp_dpkt_invalidate(&rsp);
@@ -256,12 +255,11 @@ static void rp_pci_write_config(PCIDevice *pci_dev, uint32_t addr,
     len = rp_encode_busaccess(s->peer, &pay.pkt, &in);
 
     rp_rsp_mutex_lock(s->rp);
+    rp_expect_resp(s->rp, in.id, false);
 
     rp_write(s->rp, (void *) &pay, len + size);
 
-    rsp = rp_wait_resp(s->rp);
-
-    /* We dont support out of order answers yet.  */
+    rsp = rp_wait_resp(s->rp, in.id);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pay.pkt.hdr.id));
     rclk = rsp.pkt->busaccess.timestamp;
     rp_dpkt_invalidate(&rsp);
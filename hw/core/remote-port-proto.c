@@ -407,6 +407,9 @@ void rp_process_caps(struct rp_peer_state *peer,
         case CAP_BUSACCESS_EXT_BYTE_EN:
             peer->caps.busaccess_ext_byte_en = true;
             break;
+        case CAP_SHM_RING:
+            peer->caps.shm_ring = true;
+            break;
         }
     }
 }
@@ -0,0 +1,281 @@
+/*
+ * QEMU remote port shared memory transport.
+ *
+ * Copyright (c) 2026 Xilinx Inc
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "qemu/thread.h"
+#include "qemu/error-report.h"
+#include "qemu/atomic.h"
+#include "qapi/error.h"
+#include "hw/sysbus.h"
+
+#ifdef CONFIG_POSIX
+#include <poll.h>
+#include "qemu/memfd.h"
+#endif
+
+#include "hw/remote-port-proto.h"
+#include "hw/remote-port-shm.h"
+#include "hw/remote-port.h"
+
+#ifdef CONFIG_POSIX
+void rp_shm_init(RemotePort *s, Error **errp)
+{
+    struct rp_shm_hdr *hdr;
+    size_t ring_footprint;
+    uint64_t offset;
+    unsigned int i;
+    int r;
+
+    if (!is_power_of_2(s->shm.ring_size) || s->shm.ring_size < 4096) {
+        error_setg(errp, "%s: shm-ring-size must be a power of 2 >= 4096",
+                   s->prefix);
+        return;
+    }
+
+    offset = ROUND_UP(sizeof *hdr, RP_SHM_CACHELINE);
+    ring_footprint = ROUND_UP(rp_shm_ring_footprint(s->shm.ring_size),
+                              RP_SHM_CACHELINE);
+    s->shm.size = offset + ring_footprint * RP_SHM_NR_RINGS;
+    s->shm.base = qemu_memfd_alloc("remote-port", s->shm.size,
+                                   F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL,
+                                   &s->shm.fd);
+    if (!s->shm.base) {
+        error_setg(errp, "%s: Unable to allocate shared memory rings",
+                   s->prefix);
+        return;
+    }
+
+    hdr = s->shm.base;
+    for (i = 0; i < RP_SHM_NR_RINGS; i++) {
+        struct rp_shm_ring *ring = (void *) ((char *) s->shm.base + offset);
+
+        r = event_notifier_init(&s->shm.doorbell[i], 0);
+        if (r < 0) {
+            goto err_doorbell;
+        }
+        r = event_notifier_init(&s->shm.space[i], 0);
+        if (r < 0) {
+            event_notifier_cleanup(&s->shm.doorbell[i]);
+            goto err_doorbell;
+        }
+
+        ring->size = s->shm.ring_size;
+        hdr->ring_offset[i] = offset;
+        s->shm.ring[i] = ring;
+        offset += ring_footprint;
+    }
+
+    hdr->version = RP_SHM_VERSION;
+    smp_wmb();
+    hdr->magic = RP_SHM_MAGIC;
+    qemu_mutex_init(&s->shm.space_mutex);
+    return;
+
+err_doorbell:
+    error_setg_errno(errp, -r, "%s: Unable to create doorbell", s->prefix);
+    while (i--) {
+        event_notifier_cleanup(&s->shm.doorbell[i]);
+        event_notifier_cleanup(&s->shm.space[i]);
+    }
+    qemu_memfd_free(s->shm.base, s->shm.size, s->shm.fd);
+    s->shm.base = NULL;
+    s->shm.fd = -1;
+}
+
+bool rp_shm_offer(RemotePort *s)
+{
+    int fds[] = {
+        s->shm.fd,
+        event_notifier_get_fd(&s->shm.doorbell[RP_SHM_RING_TO_PEER]),
+        event_notifier_get_fd(&s->shm.doorbell[RP_SHM_RING_FROM_PEER]),
+        event_notifier_get_fd(&s->shm.space[RP_SHM_RING_TO_PEER]),
+        event_notifier_get_fd(&s->shm.space[RP_SHM_RING_FROM_PEER]),
+    };
+
+    if (!s->shm.base) {
+        return false;
+    }
+
+    /* The fds go out with the next write on the chardev, the HELLO.  */
+    if (qemu_chr_fe_set_msgfds(&s->chr, fds, ARRAY_SIZE(fds)) < 0) {
+        warn_report("%s: chardev cannot pass file descriptors, "
+                    "not offering the shm transport", s->prefix);
+        return false;
+    }
+    return true;
+}
+
+/* Runs in the main loop. Wake up whoever waits on the peer.  */
+static gboolean rp_shm_chr_hup(GIOChannel *chan, GIOCondition cond,
+                               void *opaque)
+{
+    RemotePort *s = opaque;
+
+    atomic_set(&s->shm.hup, true);
+    event_notifier_set(&s->shm.doorbell[RP_SHM_RING_FROM_PEER]);
+    event_notifier_set(&s->shm.space[RP_SHM_RING_TO_PEER]);
+    return FALSE;
+}
+
+void rp_shm_watch_hup(RemotePort *s)
+{
+    if (!qemu_chr_fe_add_watch(&s->chr, G_IO_HUP | G_IO_ERR,
+                               rp_shm_chr_hup, s)) {
+        warn_report("%s: cannot watch the chardev, "
+                    "a peer going away will go unnoticed", s->prefix);
+    }
+}
+
+/* Block on an eventfd. Returns false if the chardev hung up.  */
+static bool rp_shm_wait(RemotePort *s, EventNotifier *e)
+{
+    struct pollfd pfd = {
+        .fd = event_notifier_get_fd(e),
+        .events = POLLIN,
+    };
+
+    if (!atomic_read(&s->shm.hup)) {
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            return false;
+        }
+        event_notifier_test_and_clear(e);
+    }
+    return !atomic_read(&s->shm.hup);
+}
+
+/*
+ * Called with write_mutex held. Packets go into the ring whole, so a
+ * packet that doesn't fit yet can wait for room with write_mutex dropped
+ * and the other writers don't stall behind it. Only packets larger than
+ * the ring are pushed in pieces, with write_mutex held throughout.
+ */
+ssize_t rp_shm_write(RemotePort *s, const void *buf, size_t count)
+{
+    struct rp_shm_ring *ring = s->shm.ring[RP_SHM_RING_TO_PEER];
+    EventNotifier *space = &s->shm.space[RP_SHM_RING_TO_PEER];
+    bool whole = count <= ring->size;
+    uint32_t need = whole ? count : 1;
+    const uint8_t *p = buf;
+    size_t done = 0;
+
+    while (done < count) {
+        bool alive = true;
+
+        if (ring->size - rp_shm_ring_used(ring) >= need) {
+            done += rp_shm_ring_push(ring, p + done, count - done);
+            if (rp_shm_ring_need_doorbell(ring)) {
+                event_notifier_set(&s->shm.doorbell[RP_SHM_RING_TO_PEER]);
+            }
+            continue;
+        }
+
+        /* The ring is full, wait for the peer to catch up. Waiters take
+           turns so a single one clears the space doorbell.  */
+        if (whole) {
+            qemu_mutex_unlock(&s->write_mutex);
+        }
+        qemu_mutex_lock(&s->shm.space_mutex);
+        if (rp_shm_ring_prepare_wait_space(ring, need)) {
+            alive = rp_shm_wait(s, space);
+            rp_shm_ring_wakeup_space(ring);
+        }
+        qemu_mutex_unlock(&s->shm.space_mutex);
+        if (whole) {
+            qemu_mutex_lock(&s->write_mutex);
+        }
+        if (!alive) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+/* Busy-poll the ring for up to poll_us before blocking on the doorbell.  */
+static bool rp_shm_poll(struct rp_shm_ring *ring, uint32_t poll_us)
+{
+    int64_t end;
+
+    if (!poll_us) {
+        return false;
+    }
+
+    end = get_clock() + poll_us * 1000LL;
+    do {
+        if (rp_shm_ring_used(ring)) {
+            return true;
+        }
+        cpu_relax();
+    } while (get_clock() < end);
+    return false;
+}
+
+ssize_t rp_shm_recv(RemotePort *s, void *buf, size_t count)
+{
+    struct rp_shm_ring *ring = s->shm.ring[RP_SHM_RING_FROM_PEER];
+    EventNotifier *doorbell = &s->shm.doorbell[RP_SHM_RING_FROM_PEER];
+    EventNotifier *space = &s->shm.space[RP_SHM_RING_FROM_PEER];
+    uint8_t *p = buf;
+    size_t done = 0;
+
+    while (done < count) {
+        size_t n = rp_shm_ring_pop(ring, p + done, count - done);
+
+        if (n) {
+            done += n;
+            if (rp_shm_ring_need_space_doorbell(ring)) {
+                event_notifier_set(space);
+            }
+            continue;
+        }
+
+        if (rp_shm_poll(ring, s->shm.poll_us)) {
+            continue;
+        }
+
+        if (rp_shm_ring_prepare_sleep(ring)) {
+            bool alive = rp_shm_wait(s, doorbell);
+
+            rp_shm_ring_wakeup(ring);
+            if (!alive) {
+                /* rp_recv reports the disconnect.  */
+                return 0;
+            }
+            continue;
+        }
+        rp_shm_ring_wakeup(ring);
+    }
+    return count;
+}
+#else
+void rp_shm_init(RemotePort *s, Error **errp)
+{
+    error_setg(errp, "%s: The shm transport is not supported on this host",
+               s->prefix);
+}
+
+bool rp_shm_offer(RemotePort *s)
+{
+    return false;
+}
+
+void rp_shm_watch_hup(RemotePort *s)
+{
+    g_assert_not_reached();
+}
+
+ssize_t rp_shm_write(RemotePort *s, const void *buf, size_t count)
+{
+    g_assert_not_reached();
+}
+
+ssize_t rp_shm_recv(RemotePort *s, void *buf, size_t count)
+{
+    g_assert_not_reached();
+}
+#endif
@@ -154,9 +154,10 @@ static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
     enclen = rp_encode_busaccess(rp_get_peer(s->rp), &pkt, &in);
 
     rp_rsp_mutex_lock(s->rp);
+    rp_expect_resp(s->rp, in.id, false);
     rp_write(s->rp, (void *) &pkt, enclen);
     rp_write(s->rp, buf, len);
-    rsp = rp_wait_resp(s->rp);
+    rsp = rp_wait_resp(s->rp, in.id);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pkt.hdr.id));
     rp_dpkt_invalidate(&rsp);
     rp_rsp_mutex_unlock(s->rp);
@@ -71,7 +71,8 @@ static void rp_pkt_dump(const char *prefix, const char *buf, size_t len)
 
 uint32_t rp_new_id(RemotePort *s)
 {
-    return s->current_id++;
+    /* Requests may be issued concurrently from multiple vCPU threads.  */
+    return atomic_fetch_inc(&s->current_id);
 }
 
 void rp_rsp_mutex_lock(RemotePort *s)
@@ -93,7 +94,7 @@ int64_t rp_normalized_vmclk(RemotePort *s)
     return clk;
 }
 
-void rp_restart_sync_timer(RemotePort *s)
+static void rp_arm_sync_timer(RemotePort *s)
 {
     if (!s->do_sync) {
         return;
@@ -106,6 +107,40 @@ void rp_restart_sync_timer(RemotePort *s)
     }
 }
 
+void rp_restart_sync_timer(RemotePort *s)
+{
+    if (s->sync.adaptive) {
+        /* The round trip exchanged timestamps, sync_timer_hit may skip
+         * the next SYNC.
+         */
+        atomic_inc(&s->sync.activity);
+        atomic_set(&s->sync.last_exchange, rp_normalized_vmclk(s));
+        return;
+    }
+    rp_arm_sync_timer(s);
+}
+
+/* Pick the next quantum based on what happened since the last sync.  */
+static void rp_sync_adapt(RemotePort *s)
+{
+    uint64_t min = s->peer.local_cfg.quantum;
+    uint64_t max = MAX(s->sync.quantum_max, min);
+    unsigned int activity;
+
+    if (!s->sync.adaptive) {
+        return;
+    }
+
+    activity = atomic_xchg(&s->sync.activity, 0);
+    if (atomic_xchg(&s->sync.irq_seen, false)) {
+        atomic_set(&s->sync.quantum, min);
+    } else if (activity) {
+        atomic_set(&s->sync.quantum, MAX(s->sync.quantum / 2, min));
+    } else {
+        atomic_set(&s->sync.quantum, MIN(s->sync.quantum * 2, max));
+    }
+}
+
 static void rp_fatal_error(RemotePort *s, const char *reason)
 {
     int64_t clk = rp_normalized_vmclk(s);
@@ -117,7 +152,12 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
 {
     ssize_t r;
 
-    r = qemu_chr_fe_read_all(&s->chr, buf, count);
+    /* Only the protocol thread flips shm.rx_active, no need to lock.  */
+    if (s->shm.rx_active) {
+        r = rp_shm_recv(s, buf, count);
+    } else {
+        r = qemu_chr_fe_read_all(&s->chr, buf, count);
+    }
     if (r <= 0) {
         rp_fatal_error(s, "Disconnected");
     }
@@ -130,18 +170,45 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
     return r;
 }
 
-ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+static void rp_write_check(RemotePort *s, const void *buf, size_t count,
+                           ssize_t r)
+{
+    if (r <= 0) {
+        error_report("%s: Disconnected r=%zd buf=%p count=%zd\n",
+                     s->prefix, r, buf, count);
+        rp_fatal_error(s, "Bad write");
+    }
+}
+
+/* Writes that must go over the chardev regardless of transport.  */
+static ssize_t rp_chr_write(RemotePort *s, const void *buf, size_t count)
 {
     ssize_t r;
 
     qemu_mutex_lock(&s->write_mutex);
     r = qemu_chr_fe_write(&s->chr, buf, count);
     qemu_mutex_unlock(&s->write_mutex);
-    if (r <= 0) {
-        error_report("%s: Disconnected r=%zd buf=%p count=%zd\n",
-                     s->prefix, r, buf, count);
-        rp_fatal_error(s, "Bad write");
+    rp_write_check(s, buf, count, r);
+    return r;
+}
+
+/*
+ * Until the HELLO exchange moves us to the shm ring, writes go over the
+ * chardev. The peer reads those up to our NOP, so nothing needs to wait
+ * for the exchange.
+ */
+ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+{
+    ssize_t r;
+
+    qemu_mutex_lock(&s->write_mutex);
+    if (s->shm.active) {
+        r = rp_shm_write(s, buf, count);
+    } else {
+        r = qemu_chr_fe_write(&s->chr, buf, count);
     }
+    qemu_mutex_unlock(&s->write_mutex);
+    rp_write_check(s, buf, count, r);
     return r;
 }
 
@@ -185,13 +252,56 @@ void rp_leave_iothread(RemotePort *s)
     }
 }
 
-RemotePortDynPkt rp_wait_resp(RemotePort *s)
+static int rp_find_resp_slot(RemotePort *s, uint32_t id)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(s->rspqueue.slot); i++) {
+        if (s->rspqueue.slot[i].used && s->rspqueue.slot[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void rp_expect_resp(RemotePort *s, uint32_t id, bool posted)
+{
+    unsigned int i;
+
+    while (s->rspqueue.nr_used == ARRAY_SIZE(s->rspqueue.slot)) {
+        rp_event_read(s);
+        qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(s->rspqueue.slot); i++) {
+        if (!s->rspqueue.slot[i].used) {
+            break;
+        }
+    }
+    assert(i < ARRAY_SIZE(s->rspqueue.slot));
+
+    s->rspqueue.slot[i].id = id;
+    s->rspqueue.slot[i].posted = posted;
+    s->rspqueue.slot[i].used = true;
+    s->rspqueue.nr_used++;
+}
+
+RemotePortDynPkt rp_wait_resp(RemotePort *s, uint32_t id)
 {
-    while (!rp_dpkt_is_valid(&s->rspqueue)) {
+    int i = rp_find_resp_slot(s, id);
+
+    assert(i >= 0 && !s->rspqueue.slot[i].posted);
+    while (!rp_dpkt_is_valid(&s->rspqueue.slot[i].dpkt)) {
         rp_event_read(s);
         qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
     }
-    return s->rspqueue;
+
+    /* The caller holds the rsp mutex while it consumes the packet, so the
+       protocol thread cannot hand the slot buffer out again until then.  */
+    s->rspqueue.slot[i].used = false;
+    s->rspqueue.nr_used--;
+    qemu_cond_broadcast(&s->progress_cond);
+    return s->rspqueue.slot[i].dpkt;
 }
 
 void rp_sync_vmclock(RemotePort *s, int64_t lclk, int64_t rclk)
@@ -233,6 +343,30 @@ static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
 
         rp_process_caps(&s->peer, caps, pkt->hello.caps.len);
     }
+
+    if (s->shm.enable) {
+        qemu_mutex_lock(&s->write_mutex);
+        if (s->shm.offered && s->peer.caps.shm_ring) {
+            struct rp_pkt_hdr nop;
+            ssize_t r;
+
+            /* Mark the end of our writes on the chardev.  */
+            rp_encode_hdr(&nop, RP_CMD_nop, rp_new_id(s), 0, 0, 0);
+            r = qemu_chr_fe_write(&s->chr, (void *) &nop, sizeof nop);
+            rp_write_check(s, &nop, sizeof nop, r);
+            s->shm.active = true;
+        }
+        qemu_mutex_unlock(&s->write_mutex);
+    }
+}
+
+static void rp_cmd_nop(RemotePort *s, struct rp_pkt *pkt)
+{
+    if (s->shm.active && !s->shm.rx_active) {
+        /* The peer has moved its writes to the ring.  */
+        s->shm.rx_active = true;
+        rp_shm_watch_hup(s);
+    }
 }
 
 static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
@@ -281,25 +415,34 @@ static void rp_say_hello(RemotePort *s)
     uint32_t caps[] = {
         CAP_BUSACCESS_EXT_BASE,
         CAP_BUSACCESS_EXT_BYTE_EN,
+        CAP_SHM_RING,
     };
+    unsigned int nr_caps = ARRAY_SIZE(caps);
     size_t len;
 
-    len = rp_encode_hello_caps(s->current_id++, 0, &pkt, RP_VERSION_MAJOR,
+    s->shm.offered = rp_shm_offer(s);
+    if (!s->shm.offered) {
+        /* CAP_SHM_RING is last.  */
+        nr_caps--;
+    }
+
+    len = rp_encode_hello_caps(rp_new_id(s), 0, &pkt, RP_VERSION_MAJOR,
                                RP_VERSION_MINOR,
-                               caps, caps, sizeof caps / sizeof caps[0]);
-    rp_write(s, (void *) &pkt, len);
+                               caps, caps, nr_caps);
+    /* The HELLO always goes over the chardev.  */
+    rp_chr_write(s, (void *) &pkt, len);
 
-    if (sizeof caps) {
-        rp_write(s, caps, sizeof caps);
+    if (nr_caps) {
+        rp_chr_write(s, caps, nr_caps * sizeof caps[0]);
     }
 }
 
-static void rp_say_sync(RemotePort *s, int64_t clk)
+static void rp_say_sync(RemotePort *s, uint32_t id, int64_t clk)
 {
     struct rp_pkt_sync pkt;
     size_t len;
 
-    len = rp_encode_sync(s->current_id++, 0, &pkt, clk);
+    len = rp_encode_sync(id, 0, &pkt, clk);
     rp_write(s, (void *) &pkt, len);
 }
 
@@ -321,31 +464,48 @@ static void sync_timer_hit(void *opaque)
     int64_t clk;
     int64_t rclk;
     RemotePortDynPkt rsp;
+    uint32_t id;
+    int64_t stall;
 
     clk = rp_normalized_vmclk(s);
     if (s->sync.resp_timer_enabled) {
         SYNCD(printf("%s: sync while delaying a resp! clk=%lu\n",
                      s->prefix, clk));
         s->sync.need_sync = true;
-        rp_restart_sync_timer(s);
+        rp_arm_sync_timer(s);
         rp_leave_iothread(s);
         return;
     }
 
+    if (s->sync.adaptive
+        && atomic_read(&s->sync.last_exchange) > clk - s->sync.quantum) {
+        /* A bus access round trip already synced us within the quantum.  */
+        atomic_inc(&s->sync.stats.piggybacked);
+        rp_sync_adapt(s);
+        rp_arm_sync_timer(s);
+        return;
+    }
+
     /* Sync.  */
     s->sync.need_sync = false;
     qemu_mutex_lock(&s->rsp_mutex);
     /* Send the sync.  */
-    rp_say_sync(s, clk);
+    id = rp_new_id(s);
+    rp_expect_resp(s, id, false);
+    rp_say_sync(s, id, clk);
 
     SYNCD(printf("%s: syncing wait for resp %lu\n", s->prefix, clk));
-    rsp = rp_wait_resp(s);
+    stall = get_clock();
+    rsp = rp_wait_resp(s, id);
     rclk = rsp.pkt->sync.timestamp;
     rp_dpkt_invalidate(&rsp);
     qemu_mutex_unlock(&s->rsp_mutex);
+    atomic_add(&s->sync.stats.stall_ns, get_clock() - stall);
+    atomic_inc(&s->sync.stats.syncs);
 
     rp_sync_vmclock(s, clk, rclk);
-    rp_restart_sync_timer(s);
+    rp_sync_adapt(s);
+    rp_arm_sync_timer(s);
 }
 
 static char *rp_sanitize_prefix(RemotePort *s)
@@ -516,7 +676,7 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
                                  pkt->sync.timestamp);
     assert(enclen == sizeof rsp.sync);
 
-    if (!use_icount || diff < s->sync.quantum) {
+    if (!use_icount || diff < atomic_read(&s->sync.quantum)) {
         /* We are still OK.  */
         rp_write(s, (void *) &rsp, enclen);
         return true;
@@ -539,14 +699,42 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     }
 
     if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
+        int i;
+
         qemu_mutex_lock(&s->rsp_mutex);
-        rp_dpkt_swap(&s->rspqueue, dpkt);
-        qemu_cond_signal(&s->progress_cond);
+        i = rp_find_resp_slot(s, pkt->hdr.id);
+        if (i < 0) {
+            qemu_mutex_unlock(&s->rsp_mutex);
+            error_report("%s: response with unknown id %u cmd=%d",
+                         s->prefix, pkt->hdr.id, pkt->hdr.cmd);
+            rp_fatal_error(s, "Unexpected response");
+        }
+
+        if (s->rspqueue.slot[i].posted) {
+            unsigned int resp = (pkt->busaccess.attributes & RP_BUS_RESP_MASK)
+                                >> RP_BUS_RESP_SHIFT;
+
+            if (pkt->hdr.cmd == RP_CMD_write && resp != RP_RESP_OK) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "%s: posted write to 0x%" PRIx64
+                              " failed (%u)\n",
+                              s->prefix, pkt->busaccess.addr, resp);
+            }
+            /* Nobody is waiting for this one, just release the slot.  */
+            s->rspqueue.slot[i].used = false;
+            s->rspqueue.nr_used--;
+        } else {
+            rp_dpkt_swap(&s->rspqueue.slot[i].dpkt, dpkt);
+        }
+        qemu_cond_broadcast(&s->progress_cond);
         qemu_mutex_unlock(&s->rsp_mutex);
         return;
     }
 
     switch (pkt->hdr.cmd) {
+    case RP_CMD_nop:
+        rp_cmd_nop(s, pkt);
+        break;
     case RP_CMD_hello:
         rp_cmd_hello(s, pkt);
         break;
@@ -554,10 +742,16 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
         if (rp_pt_cmd_sync(s, pkt)) {
             return;
         }
-        /* Fall-through.  */
+        /* Too far ahead, the IO thread has to catch up with it.  */
+        rp_pt_handover_pkt(s, dpkt);
+        break;
+    case RP_CMD_interrupt:
+        atomic_set(&s->sync.irq_seen, true);
+        rp_pt_handover_pkt(s, dpkt);
+        break;
     case RP_CMD_read:
     case RP_CMD_write:
-    case RP_CMD_interrupt:
+        atomic_inc(&s->sync.activity);
         rp_pt_handover_pkt(s, dpkt);
         break;
     default:
@@ -591,7 +785,10 @@ static void *rp_protocol_thread(void *arg)
 
     /* Make sure we have a decent bufsize to start with.  */
     rp_dpkt_alloc(&s->rsp, sizeof s->rsp.pkt->busaccess + 1024);
-    rp_dpkt_alloc(&s->rspqueue, sizeof s->rspqueue.pkt->busaccess + 1024);
+    for (i = 0; i < ARRAY_SIZE(s->rspqueue.slot); i++) {
+        rp_dpkt_alloc(&s->rspqueue.slot[i].dpkt,
+                      sizeof s->rspqueue.slot[i].dpkt.pkt->busaccess + 1024);
+    }
     for (i = 0; i < ARRAY_SIZE(s->rx_queue.pkt); i++) {
         rp_dpkt_alloc(&s->rx_queue.pkt[i],
                       sizeof s->rx_queue.pkt[i].pkt->busaccess + 1024);
@@ -671,6 +868,16 @@ static void rp_realize(DeviceState *dev, Error **errp)
      */
     qemu_chr_fe_set_blocking(&s->chr, true);
 
+    if (s->shm.enable) {
+        Error *err = NULL;
+
+        rp_shm_init(s, &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+    }
+
 #ifdef _WIN32
     /* Create a socket connection between two sockets. We auto-bind
      * and read out the port selected by the kernel.
@@ -746,6 +953,7 @@ static void rp_realize(DeviceState *dev, Error **errp)
        After config negotiation with the peer, sync.quantum value might
        change.  */
     s->sync.quantum = s->peer.local_cfg.quantum;
+    s->sync.last_exchange = INT64_MIN;
 
     s->sync.bh = qemu_bh_new(sync_timer_hit, s);
     s->sync.bh_resp = qemu_bh_new(syncresp_timer_hit, s);
@@ -759,7 +967,7 @@ static void rp_realize(DeviceState *dev, Error **errp)
     qemu_sem_init(&s->rx_queue.sem, ARRAY_SIZE(s->rx_queue.pkt) - 1);
     qemu_thread_create(&s->thread, "remote-port", rp_protocol_thread, s,
                        QEMU_THREAD_JOINABLE);
-    rp_restart_sync_timer(s);
+    rp_arm_sync_timer(s);
 }
 
 static const VMStateDescription vmstate_rp = {
@@ -779,6 +987,12 @@ static Property rp_properties[] = {
     DEFINE_PROP_BOOL("sync", RemotePort, do_sync, false),
     DEFINE_PROP_UINT64("sync-quantum", RemotePort, peer.local_cfg.quantum,
                        1000000),
+    DEFINE_PROP_BOOL("sync-adaptive", RemotePort, sync.adaptive, false),
+    DEFINE_PROP_UINT64("sync-quantum-max", RemotePort, sync.quantum_max,
+                       64 * 1000000),
+    DEFINE_PROP_BOOL("shm", RemotePort, shm.enable, false),
+    DEFINE_PROP_UINT32("shm-ring-size", RemotePort, shm.ring_size, 1 << 20),
+    DEFINE_PROP_UINT32("shm-poll-us", RemotePort, shm.poll_us, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -799,6 +1013,15 @@ static void rp_init(Object *obj)
                              &error_abort);
         g_free(name);
     }
+
+    object_property_add_uint64_ptr(obj, "sync-count",
+                                   &s->sync.stats.syncs, &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-stall-ns",
+                                   &s->sync.stats.stall_ns, &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-piggybacked",
+                                   &s->sync.stats.piggybacked, &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-quantum-current",
+                                   &s->sync.quantum, &error_abort);
 }
 
 struct rp_peer_state *rp_get_peer(RemotePort *s)
@@ -30,6 +30,8 @@
 #include "hw/register-dep.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "sysemu/dma.h"
 
@@ -153,6 +155,9 @@ DEP_REG32(ZDMA_CH_CTRL2, 0x200)
 
 #define R_MAX (R_ZDMA_CH_CTRL2 + 1)
 
+/* Bytes moved per bottom half run before yielding to the main loop.  */
+#define ZDMA_BH_BUDGET (4 * 1024 * 1024)
+
 typedef enum {
     DISABLED = 0,
     ENABLED = 1,
@@ -204,11 +209,24 @@ typedef struct ZDMA {
 
     struct {
         uint32_t bus_width;
+        /* Transfer rate in bytes per second, 0 for instant transfers.  */
+        uint32_t rate;
     } cfg;
 
-    ZDMAState state;
+    uint32_t state;     /* ZDMAState */
     bool error;
 
+    /* The channel runs from bh, off the vCPU that kicked it. With a rate
+     * set, each descriptor completes when rate_timer fires. Descriptors
+     * larger than the bh budget are moved in several runs, descr_partial
+     * is set while descr_remain bytes of one are left to move.
+     */
+    QEMUBH *bh;
+    QEMUTimer *rate_timer;
+    bool descr_pending;
+    bool descr_partial;
+    uint32_t descr_remain;
+
     ZDMADescr dsc_src;
     ZDMADescr dsc_dst;
 
@@ -384,6 +402,27 @@ static uint64_t zdma_update_descr_addr(ZDMA *s, bool type, unsigned int basereg)
     return next;
 }
 
+/* Write to the DMA address space, straight into RAM when possible.  */
+static void zdma_dma_write(ZDMA *s, uint64_t addr, uint8_t *buf, uint32_t len)
+{
+    while (len) {
+        hwaddr mlen = len;
+        void *p = address_space_map_attr(s->dma_as, addr, &mlen, true,
+                                         *s->attr);
+
+        if (!p) {
+            address_space_rw(s->dma_as, addr, *s->attr, buf, len, true);
+            return;
+        }
+        /* Source and destination may overlap.  */
+        memmove(p, buf, mlen);
+        address_space_unmap(s->dma_as, p, mlen, true, mlen);
+        addr += mlen;
+        buf += mlen;
+        len -= mlen;
+    }
+}
+
 static void zdma_write_dst(ZDMA *s, uint8_t *buf, uint32_t len)
 {
     uint32_t dst_size, dlen;
@@ -426,10 +465,12 @@ static void zdma_write_dst(ZDMA *s, uint8_t *buf, uint32_t len)
             }
         }
 
-        address_space_rw(s->dma_as, s->dsc_dst.addr, *s->attr, buf, dlen,
-                         true);
         if (burst_type == AXI_BURST_INCR) {
+            zdma_dma_write(s, s->dsc_dst.addr, buf, dlen);
             s->dsc_dst.addr += dlen;
+        } else {
+            address_space_rw(s->dma_as, s->dsc_dst.addr, *s->attr, buf, dlen,
+                             true);
         }
         dst_size -= dlen;
         buf += dlen;
@@ -444,7 +485,10 @@ static void zdma_write_dst(ZDMA *s, uint8_t *buf, uint32_t len)
     }
 }
 
-static void zdma_process_descr(ZDMA *s)
+/* Move at most *budget bytes of the current descriptor. Returns false
+ * if the budget ran out first, descr_remain then holds what is left.
+ */
+static bool zdma_process_descr(ZDMA *s, uint64_t *budget)
 {
     uint64_t src_addr;
     uint32_t src_size, len;
@@ -485,8 +529,35 @@ static void zdma_process_descr(ZDMA *s)
         memcpy(s->buf, &s->regs[R_ZDMA_CH_WR_ONLY_WORD0], s->cfg.bus_width / 8);
     }
 
+    if (s->descr_partial) {
+        src_size = s->descr_remain;
+    }
+
     while (src_size) {
+        uint8_t *src = NULL;
+        hwaddr mlen = MIN(src_size, *budget);
+
+        if (!*budget) {
+            s->dsc_src.addr = src_addr;
+            s->descr_remain = src_size;
+            return false;
+        }
+
+        /* Move RAM sources without going through the bounce buffer.  */
+        if (rw_mode == RW_MODE_RW && burst_type == AXI_BURST_INCR) {
+            src = address_space_map_attr(s->dma_as, src_addr, &mlen, false,
+                                         *s->attr);
+        }
+        if (src) {
+            len = mlen;
+            zdma_write_dst(s, src, len);
+            address_space_unmap(s->dma_as, src, mlen, false, mlen);
+            src_addr += len;
+            goto accounted;
+        }
+
         len = src_size > ARRAY_SIZE(s->buf) ? ARRAY_SIZE(s->buf) : src_size;
+        len = MIN(len, *budget);
         if (burst_type == AXI_BURST_FIXED) {
             if (len > (s->cfg.bus_width / 8)) {
                 len = s->cfg.bus_width / 8;
@@ -509,8 +580,10 @@ static void zdma_process_descr(ZDMA *s)
             zdma_write_dst(s, s->buf, len);
         }
 
+accounted:
         s->regs[R_ZDMA_CH_TOTAL_BYTE] += len;
         src_size -= len;
+        *budget -= len;
 
         if (src_size == 0) {
             DEP_AF_DP32(s->regs, ZDMA_CH_ISR, DMA_DONE, true);
@@ -526,34 +599,95 @@ static void zdma_process_descr(ZDMA *s)
     if (ptype == PT_REG || src_cmd == CMD_STOP) {
         DEP_AF_DP32(s->regs, ZDMA_CH_CTRL2, EN, 0);
         zdma_set_state(s, DISABLED);
-        return;
+        return true;
     }
 
     if (src_cmd == CMD_HALT) {
         zdma_set_state(s, PAUSED);
         DEP_AF_DP32(s->regs, ZDMA_CH_ISR, DMA_PAUSE, 1);
         zdma_ch_update_irq(s);
-        return;
+        return true;
     }
 
     zdma_update_descr_addr(s, src_type, R_ZDMA_CH_SRC_CUR_DSCR_LSB);
+    return true;
+}
+
+/* Number of bytes the current source descriptor moves.  */
+static uint32_t zdma_descr_len(ZDMA *s)
+{
+    unsigned int rw_mode = DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, MODE);
+    unsigned int ptype = DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, POINT_TYPE);
+
+    if (ptype == PT_REG && rw_mode == RW_MODE_WO) {
+        return DEP_F_EX32(s->dsc_dst.words[2], ZDMA_CH_DST_DSCR_WORD2, SIZE);
+    }
+    return DEP_F_EX32(s->dsc_src.words[2], ZDMA_CH_SRC_DSCR_WORD2, SIZE);
 }
 
 static void zdma_run(ZDMA *s)
 {
+    uint64_t budget = ZDMA_BH_BUDGET;
+
     while (s->state == ENABLED && !s->error) {
-        zdma_load_src_descriptor(s);
+        if (!s->descr_pending && !s->descr_partial) {
+            zdma_load_src_descriptor(s);
 
-        if (s->error) {
-            zdma_set_state(s, DISABLED);
-        } else {
-            zdma_process_descr(s);
+            if (s->error) {
+                zdma_set_state(s, DISABLED);
+                break;
+            }
+
+            if (s->cfg.rate) {
+                int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+                /* Complete the descriptor once its transfer time passed.  */
+                s->descr_pending = true;
+                timer_mod(s->rate_timer,
+                          now + muldiv64(zdma_descr_len(s),
+                                         NANOSECONDS_PER_SECOND,
+                                         s->cfg.rate));
+                break;
+            }
+        }
+
+        s->descr_pending = false;
+        s->descr_partial = !zdma_process_descr(s, &budget);
+
+        if (!budget) {
+            /* Let the rest of the system run, continue later.  */
+            qemu_bh_schedule(s->bh);
+            break;
         }
     }
 
     zdma_ch_update_irq(s);
 }
 
+static void zdma_run_bh(void *opaque)
+{
+    ZDMA *s = XILINX_ZDMA(opaque);
+
+    if (!s->descr_pending) {
+        zdma_run(s);
+    }
+}
+
+static void zdma_rate_timer_cb(void *opaque)
+{
+    ZDMA *s = XILINX_ZDMA(opaque);
+
+    zdma_run(s);
+}
+
+static void zdma_stop(ZDMA *s)
+{
+    qemu_bh_cancel(s->bh);
+    timer_del(s->rate_timer);
+    s->descr_pending = false;
+    s->descr_partial = false;
+}
+
 static void zdma_update_descr_addr_from_start(ZDMA *s)
 {
     uint64_t src_addr, dst_addr;
@@ -569,7 +703,8 @@ static void zdma_ch_ctrlx_postw(DepRegisterInfo *reg, uint64_t val64)
 {
     ZDMA *s = XILINX_ZDMA(reg->opaque);
 
-    if (DEP_AF_EX32(s->regs, ZDMA_CH_CTRL2, EN)) {
+    /* Writes with EN set while the channel runs leave it alone.  */
+    if (DEP_AF_EX32(s->regs, ZDMA_CH_CTRL2, EN) && s->state != ENABLED) {
         s->error = false;
 
         if (s->state == PAUSED && DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, CONT)) {
@@ -587,14 +722,23 @@ static void zdma_ch_ctrlx_postw(DepRegisterInfo *reg, uint64_t val64)
             zdma_update_descr_addr_from_start(s);
         }
         zdma_set_state(s, ENABLED);
-    } else {
+    } else if (!DEP_AF_EX32(s->regs, ZDMA_CH_CTRL2, EN)) {
         /* Leave Paused state?  */
         if (s->state == PAUSED && DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, CONT)) {
             zdma_set_state(s, DISABLED);
         }
+        /* Clearing EN aborts a transfer in flight.  */
+        if (s->state == ENABLED) {
+            zdma_stop(s);
+            zdma_set_state(s, DISABLED);
+        }
     }
 
-    zdma_run(s);
+    /* Don't run the channel from the vCPU thread that kicked it.  */
+    if (s->state == ENABLED) {
+        qemu_bh_schedule(s->bh);
+    }
+    zdma_ch_update_irq(s);
 }
 
 static DepRegisterAccessInfo zdma_regs_info[] = {
@@ -709,6 +853,9 @@ static void zdma_reset(DeviceState *dev)
         dep_register_reset(&s->regs_info[i]);
     }
 
+    zdma_stop(s);
+    s->state = DISABLED;
+    s->error = false;
     zdma_ch_update_irq(s);
 }
 
@@ -781,6 +928,9 @@ static void zdma_realize(DeviceState *dev, Error **errp)
     } else {
         s->dma_as = &address_space_memory;
     }
+
+    s->bh = qemu_bh_new(zdma_run_bh, s);
+    s->rate_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, zdma_rate_timer_cb, s);
 }
 
 static void zdma_init(Object *obj)
@@ -805,19 +955,40 @@ static void zdma_init(Object *obj)
                              &error_abort);
 }
 
+static int zdma_post_load(void *opaque, int version_id)
+{
+    ZDMA *s = XILINX_ZDMA(opaque);
+
+    /* A transfer waiting on rate_timer resumes from the timer.  */
+    if (s->state == ENABLED && !s->descr_pending) {
+        qemu_bh_schedule(s->bh);
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_zdma = {
     .name = TYPE_XILINX_ZDMA,
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = zdma_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, ZDMA, R_MAX),
+        VMSTATE_UINT32_V(state, ZDMA, 2),
+        VMSTATE_BOOL_V(error, ZDMA, 2),
+        VMSTATE_UINT32_ARRAY_V(dsc_src.words, ZDMA, 4, 2),
+        VMSTATE_UINT32_ARRAY_V(dsc_dst.words, ZDMA, 4, 2),
+        VMSTATE_BOOL_V(descr_pending, ZDMA, 2),
+        VMSTATE_BOOL_V(descr_partial, ZDMA, 2),
+        VMSTATE_UINT32_V(descr_remain, ZDMA, 2),
+        VMSTATE_TIMER_PTR_V(rate_timer, ZDMA, 2),
         VMSTATE_END_OF_LIST(),
     }
 };
 
 static Property zdma_props[] = {
     DEFINE_PROP_UINT32("bus-width", ZDMA, cfg.bus_width, 64),
+    DEFINE_PROP_UINT32("rate", ZDMA, cfg.rate, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -6076,7 +6076,32 @@ DEP_REG32(SMMU_GATSR, 0x188)
 /* Maximum number of TBUs supported by this model.  */
 #define MAX_TBU 16
 
+/* Number of context banks.  */
+#define NR_CB 16
+
+/* Translation cache geometry, direct mapped.  */
+#define SMMU_TLB_SIZE 256
+#define SMMU_SID_CACHE_SIZE 64
+
 typedef struct SMMU SMMU;
+
+/* A cached 4K translation of a context bank.  */
+typedef struct SMMUTLBEntry {
+    uint64_t va;
+    uint64_t pa;
+    uint32_t stream_id;
+    uint8_t prot;
+    bool secure;
+    bool valid;
+} SMMUTLBEntry;
+
+/* A cached stream ID to context bank match, cb is -1 for no match.  */
+typedef struct SMMUSIDEntry {
+    uint32_t stream_id;
+    int cb;
+    bool valid;
+} SMMUSIDEntry;
+
 typedef struct TBU {
     SMMU *smmu;
     IOMMUMemoryRegion iommu;
@@ -6102,6 +6127,19 @@ struct SMMU {
         uint32_t pamax;
     } cfg;
 
+    /* Translations run on several vCPU threads at once. lock protects
+     * the caches, gen counts flushes so a walk that raced with one does
+     * not fill a stale entry.
+     */
+    struct {
+        QemuSpin lock;
+        uint32_t gen;
+        SMMUTLBEntry cb[NR_CB][SMMU_TLB_SIZE];
+        SMMUSIDEntry sid[SMMU_SID_CACHE_SIZE];
+        uint64_t hits;
+        uint64_t misses;
+    } tlb;
+
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
 };
@@ -6186,6 +6224,69 @@ static int smmu_stream_id_match(SMMU *s, uint32_t stream_id)
     return cbndx;
 }
 
+static int smmu_stream_id_lookup(SMMU *s, uint32_t stream_id)
+{
+    SMMUSIDEntry *e = &s->tlb.sid[stream_id % SMMU_SID_CACHE_SIZE];
+
+    if (!e->valid || e->stream_id != stream_id) {
+        e->stream_id = stream_id;
+        e->cb = smmu_stream_id_match(s, stream_id);
+        e->valid = true;
+    }
+    return e->cb;
+}
+
+static inline SMMUTLBEntry *smmu_tlb_entry(SMMU *s, unsigned int cb,
+                                           uint32_t stream_id, uint64_t va)
+{
+    unsigned int idx = ((va >> 12) ^ (stream_id << 3)) % SMMU_TLB_SIZE;
+
+    return &s->tlb.cb[cb][idx];
+}
+
+/* The flush helpers are called with tlb.lock held.  */
+static void smmu_tlb_flush_all(SMMU *s)
+{
+    memset(s->tlb.cb, 0, sizeof s->tlb.cb);
+    memset(s->tlb.sid, 0, sizeof s->tlb.sid);
+    s->tlb.gen++;
+}
+
+/* Flush a context bank and the stage 1 banks nested on it.  */
+static void smmu_tlb_flush_cb(SMMU *s, unsigned int cb)
+{
+    unsigned int i;
+
+    s->tlb.gen++;
+    for (i = 0; i < NR_CB; i++) {
+        uint32_t v = s->regs[R_SMMU_CBAR0 + i];
+
+        if (i == cb || (DEP_F_EX32(v, SMMU_CBAR0, TYPE) == 3
+                        && extract32(v, 8, 8) == cb)) {
+            memset(s->tlb.cb[i], 0, sizeof s->tlb.cb[i]);
+        }
+    }
+}
+
+/*
+ * Flush the entries of a context bank for a VA. The TLBI registers carry
+ * VA[43:12] in their low word, the high word may not be written yet so
+ * only the low word is matched. Aliases get flushed too, which is safe.
+ */
+static void smmu_tlb_flush_va(SMMU *s, unsigned int cb, uint32_t va_page)
+{
+    unsigned int i;
+
+    s->tlb.gen++;
+    for (i = 0; i < SMMU_TLB_SIZE; i++) {
+        SMMUTLBEntry *e = &s->tlb.cb[cb][i];
+
+        if (e->valid && (uint32_t)(e->va >> 12) == va_page) {
+            e->valid = false;
+        }
+    }
+}
+
 static bool check_s2_startlevel(bool is_aa64, unsigned int pamax, int level,
                                 int inputsize, int stride)
 {
@@ -6706,21 +6807,52 @@ static IOMMUTLBEntry smmu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     bool err = false;
     uint64_t master_id = attr->master_id;
     bool clientpd = DEP_AF_EX32(s->regs, SMMU_SCR0, CLIENTPD);
+    SMMUTLBEntry *e;
+    uint32_t gen;
 
     if (clientpd) {
         return ret;
     }
 
-    cb = smmu_stream_id_match(s, master_id);
+    qemu_spin_lock(&s->tlb.lock);
+    cb = smmu_stream_id_lookup(s, master_id);
 
     if (cb >= 0) {
+        e = smmu_tlb_entry(s, cb, master_id, va);
+        if (e->valid && e->va == va && e->stream_id == master_id
+            && e->secure == attr->secure) {
+            ret.translated_addr = e->pa;
+            ret.perm = e->prot;
+            qemu_spin_unlock(&s->tlb.lock);
+            atomic_inc(&s->tlb.hits);
+            return ret;
+        }
+        gen = s->tlb.gen;
+        qemu_spin_unlock(&s->tlb.lock);
+        atomic_inc(&s->tlb.misses);
+
         err = smmu500_at(s, cb, va, false, true, &pa, &prot);
         ret.translated_addr = pa;
         ret.perm = prot;
         if (err) {
             memset(&ret, 0, sizeof ret);
             ret.perm = IOMMU_NONE;
+        } else {
+            qemu_spin_lock(&s->tlb.lock);
+            if (s->tlb.gen == gen) {
+                *e = (SMMUTLBEntry) {
+                    .va = va,
+                    .pa = pa,
+                    .stream_id = master_id,
+                    .prot = prot,
+                    .secure = attr->secure,
+                    .valid = true,
+                };
+            }
+            qemu_spin_unlock(&s->tlb.lock);
         }
+    } else {
+        qemu_spin_unlock(&s->tlb.lock);
     }
     return ret;
 }
@@ -6735,6 +6867,104 @@ static void smmu_fsr_pw(DepRegisterInfo *reg, uint64_t val)
     }
 }
 
+static void smmu_tlbi_all_pw(DepRegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+
+    qemu_spin_lock(&s->tlb.lock);
+    smmu_tlb_flush_all(s);
+    qemu_spin_unlock(&s->tlb.lock);
+}
+
+static void smmu_tlbi_va_pw(DepRegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+    unsigned int i;
+
+    qemu_spin_lock(&s->tlb.lock);
+    for (i = 0; i < NR_CB; i++) {
+        smmu_tlb_flush_va(s, i, val);
+    }
+    qemu_spin_unlock(&s->tlb.lock);
+}
+
+static inline unsigned int smmu_reg_cb(DepRegisterInfo *reg)
+{
+    return (reg->access->decode.addr - A_SMMU_CB0_SCTLR) / PAGESIZE;
+}
+
+static void smmu_tlbi_cb_va_pw(DepRegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+
+    qemu_spin_lock(&s->tlb.lock);
+    smmu_tlb_flush_va(s, smmu_reg_cb(reg), val);
+    qemu_spin_unlock(&s->tlb.lock);
+}
+
+static void smmu_tlbi_cb_pw(DepRegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+
+    qemu_spin_lock(&s->tlb.lock);
+    smmu_tlb_flush_cb(s, smmu_reg_cb(reg));
+    qemu_spin_unlock(&s->tlb.lock);
+}
+
+/* Flush the bank a S2CR value points to.  */
+static void smmu_tlb_flush_s2cr(SMMU *s, uint32_t s2cr)
+{
+    unsigned int cb = DEP_F_EX32(s2cr, SMMU_S2CR0, CBNDX_VMID);
+
+    if (cb < NR_CB) {
+        smmu_tlb_flush_cb(s, cb);
+    }
+}
+
+/*
+ * Drop the cached translations a register write may have changed. OLD
+ * is the value of the register before the write. Only SCR0, the stream
+ * mapping and context bank attribute tables and the translation
+ * registers of the context banks are used by translations.
+ */
+static void smmu_config_written(SMMU *s, hwaddr addr, uint32_t old)
+{
+    unsigned int n;
+
+    if (addr == A_SMMU_SCR0 || addr == A_SMMU_NSCR0) {
+        smmu_tlb_flush_all(s);
+    } else if (addr >= A_SMMU_SMR0 && addr <= A_SMMU_SMR47) {
+        /* The streams of the group now map elsewhere.  */
+        n = (addr - A_SMMU_SMR0) / 4;
+        memset(s->tlb.sid, 0, sizeof s->tlb.sid);
+        smmu_tlb_flush_s2cr(s, s->regs[R_SMMU_S2CR0 + n]);
+    } else if (addr >= A_SMMU_S2CR0 && addr <= A_SMMU_S2CR47) {
+        memset(s->tlb.sid, 0, sizeof s->tlb.sid);
+        smmu_tlb_flush_s2cr(s, old);
+        smmu_tlb_flush_s2cr(s, s->regs[addr / 4]);
+    } else if (addr >= A_SMMU_CBAR0 && addr < A_SMMU_CBAR0 + NR_CB * 4) {
+        smmu_tlb_flush_cb(s, (addr - A_SMMU_CBAR0) / 4);
+    } else if (addr >= A_SMMU_CBA2R0 && addr < A_SMMU_CBA2R0 + NR_CB * 4) {
+        smmu_tlb_flush_cb(s, (addr - A_SMMU_CBA2R0) / 4);
+    } else if (addr >= A_SMMU_CB0_SCTLR
+               && addr < A_SMMU_CB0_SCTLR + NR_CB * PAGESIZE) {
+        n = (addr - A_SMMU_CB0_SCTLR) / PAGESIZE;
+        switch (A_SMMU_CB0_SCTLR + (addr - A_SMMU_CB0_SCTLR) % PAGESIZE) {
+        case A_SMMU_CB0_SCTLR:
+        case A_SMMU_CB0_TCR2:
+        case A_SMMU_CB0_TTBR0_LOW:
+        case A_SMMU_CB0_TTBR0_HIGH:
+        case A_SMMU_CB0_TTBR1_LOW:
+        case A_SMMU_CB0_TTBR1_HIGH:
+        case A_SMMU_CB0_TCR_LPAE:
+        case A_SMMU_CB0_PRRR_MAIR0:
+        case A_SMMU_CB0_NMRR_MAIR1:
+            smmu_tlb_flush_cb(s, n);
+            break;
+        }
+    }
+}
+
 static DepRegisterAccessInfo smmu500_regs_info[] = {
     /* Manually added.  */
     {   .name = "SMMU_GATS1PR",  .decode.addr = A_SMMU_GATS1PR,
@@ -6794,8 +7024,11 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0x40,
     },{ .name = "SMMU_SGFSYNR1",  .decode.addr = A_SMMU_SGFSYNR1,
     },{ .name = "SMMU_STLBIALL",  .decode.addr = A_SMMU_STLBIALL,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_TLBIVMID",  .decode.addr = A_SMMU_TLBIVMID,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_TLBIALLNSNH",  .decode.addr = A_SMMU_TLBIALLNSNH,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_STLBGSYNC",  .decode.addr = A_SMMU_STLBGSYNC,
     },{ .name = "SMMU_STLBGSTATUS",  .decode.addr = A_SMMU_STLBGSTATUS,
         .ro = 0x1,
@@ -6806,10 +7039,13 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
     },{ .name = "SMMU_DBGRDATATCU",  .decode.addr = A_SMMU_DBGRDATATCU,
         .ro = 0xffffffff,
     },{ .name = "SMMU_STLBIVALM_LOW",  .decode.addr = A_SMMU_STLBIVALM_LOW,
+        .post_write = smmu_tlbi_va_pw,
     },{ .name = "SMMU_STLBIVALM_HIGH",  .decode.addr = A_SMMU_STLBIVALM_HIGH,
     },{ .name = "SMMU_STLBIVAM_LOW",  .decode.addr = A_SMMU_STLBIVAM_LOW,
+        .post_write = smmu_tlbi_va_pw,
     },{ .name = "SMMU_STLBIVAM_HIGH",  .decode.addr = A_SMMU_STLBIVAM_HIGH,
     },{ .name = "SMMU_STLBIALLM",  .decode.addr = A_SMMU_STLBIALLM,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_NSCR0",  .decode.addr = A_SMMU_NSCR0,
         .reset = 0x200001,
         .ro = 0x200330,
@@ -7233,18 +7469,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB0_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB0_IPAFAR_HIGH,
     },{ .name = "SMMU_CB0_TLBIVA_LOW",  .decode.addr = A_SMMU_CB0_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB0_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB0_TLBIVA_HIGH,
     },{ .name = "SMMU_CB0_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB0_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB0_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB0_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB0_TLBIASID",  .decode.addr = A_SMMU_CB0_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB0_TLBIALL",  .decode.addr = A_SMMU_CB0_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB0_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB0_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB0_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB0_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB0_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB0_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB0_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB0_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB0_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB0_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB0_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB0_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB0_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB0_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB0_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB0_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB0_TLBSYNC",  .decode.addr = A_SMMU_CB0_TLBSYNC,
     },{ .name = "SMMU_CB0_TLBSTATUS",  .decode.addr = A_SMMU_CB0_TLBSTATUS,
@@ -7304,18 +7548,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB1_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB1_IPAFAR_HIGH,
     },{ .name = "SMMU_CB1_TLBIVA_LOW",  .decode.addr = A_SMMU_CB1_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB1_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB1_TLBIVA_HIGH,
     },{ .name = "SMMU_CB1_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB1_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB1_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB1_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB1_TLBIASID",  .decode.addr = A_SMMU_CB1_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB1_TLBIALL",  .decode.addr = A_SMMU_CB1_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB1_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB1_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB1_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB1_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB1_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB1_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB1_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB1_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB1_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB1_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB1_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB1_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB1_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB1_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB1_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB1_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB1_TLBSYNC",  .decode.addr = A_SMMU_CB1_TLBSYNC,
     },{ .name = "SMMU_CB1_TLBSTATUS",  .decode.addr = A_SMMU_CB1_TLBSTATUS,
@@ -7375,18 +7627,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB2_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB2_IPAFAR_HIGH,
     },{ .name = "SMMU_CB2_TLBIVA_LOW",  .decode.addr = A_SMMU_CB2_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB2_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB2_TLBIVA_HIGH,
     },{ .name = "SMMU_CB2_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB2_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB2_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB2_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB2_TLBIASID",  .decode.addr = A_SMMU_CB2_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB2_TLBIALL",  .decode.addr = A_SMMU_CB2_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB2_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB2_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB2_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB2_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB2_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB2_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB2_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB2_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB2_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB2_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB2_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB2_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB2_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB2_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB2_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB2_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB2_TLBSYNC",  .decode.addr = A_SMMU_CB2_TLBSYNC,
     },{ .name = "SMMU_CB2_TLBSTATUS",  .decode.addr = A_SMMU_CB2_TLBSTATUS,
@@ -7446,18 +7706,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB3_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB3_IPAFAR_HIGH,
     },{ .name = "SMMU_CB3_TLBIVA_LOW",  .decode.addr = A_SMMU_CB3_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB3_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB3_TLBIVA_HIGH,
     },{ .name = "SMMU_CB3_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB3_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB3_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB3_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB3_TLBIASID",  .decode.addr = A_SMMU_CB3_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB3_TLBIALL",  .decode.addr = A_SMMU_CB3_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB3_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB3_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB3_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB3_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB3_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB3_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB3_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB3_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB3_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB3_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB3_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB3_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB3_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB3_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB3_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB3_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB3_TLBSYNC",  .decode.addr = A_SMMU_CB3_TLBSYNC,
     },{ .name = "SMMU_CB3_TLBSTATUS",  .decode.addr = A_SMMU_CB3_TLBSTATUS,
@@ -7517,18 +7785,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB4_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB4_IPAFAR_HIGH,
     },{ .name = "SMMU_CB4_TLBIVA_LOW",  .decode.addr = A_SMMU_CB4_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB4_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB4_TLBIVA_HIGH,
     },{ .name = "SMMU_CB4_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB4_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB4_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB4_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB4_TLBIASID",  .decode.addr = A_SMMU_CB4_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB4_TLBIALL",  .decode.addr = A_SMMU_CB4_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB4_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB4_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB4_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB4_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB4_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB4_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB4_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB4_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB4_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB4_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB4_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB4_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB4_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB4_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB4_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB4_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB4_TLBSYNC",  .decode.addr = A_SMMU_CB4_TLBSYNC,
     },{ .name = "SMMU_CB4_TLBSTATUS",  .decode.addr = A_SMMU_CB4_TLBSTATUS,
@@ -7588,18 +7864,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB5_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB5_IPAFAR_HIGH,
     },{ .name = "SMMU_CB5_TLBIVA_LOW",  .decode.addr = A_SMMU_CB5_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB5_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB5_TLBIVA_HIGH,
     },{ .name = "SMMU_CB5_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB5_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB5_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB5_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB5_TLBIASID",  .decode.addr = A_SMMU_CB5_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB5_TLBIALL",  .decode.addr = A_SMMU_CB5_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB5_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB5_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB5_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB5_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB5_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB5_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB5_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB5_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB5_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB5_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB5_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB5_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB5_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB5_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB5_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB5_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB5_TLBSYNC",  .decode.addr = A_SMMU_CB5_TLBSYNC,
     },{ .name = "SMMU_CB5_TLBSTATUS",  .decode.addr = A_SMMU_CB5_TLBSTATUS,
@@ -7659,18 +7943,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB6_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB6_IPAFAR_HIGH,
     },{ .name = "SMMU_CB6_TLBIVA_LOW",  .decode.addr = A_SMMU_CB6_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB6_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB6_TLBIVA_HIGH,
     },{ .name = "SMMU_CB6_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB6_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB6_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB6_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB6_TLBIASID",  .decode.addr = A_SMMU_CB6_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB6_TLBIALL",  .decode.addr = A_SMMU_CB6_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB6_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB6_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB6_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB6_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB6_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB6_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB6_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB6_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB6_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB6_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB6_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB6_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB6_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB6_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB6_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB6_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB6_TLBSYNC",  .decode.addr = A_SMMU_CB6_TLBSYNC,
     },{ .name = "SMMU_CB6_TLBSTATUS",  .decode.addr = A_SMMU_CB6_TLBSTATUS,
@@ -7730,18 +8022,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB7_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB7_IPAFAR_HIGH,
     },{ .name = "SMMU_CB7_TLBIVA_LOW",  .decode.addr = A_SMMU_CB7_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB7_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB7_TLBIVA_HIGH,
     },{ .name = "SMMU_CB7_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB7_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB7_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB7_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB7_TLBIASID",  .decode.addr = A_SMMU_CB7_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB7_TLBIALL",  .decode.addr = A_SMMU_CB7_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB7_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB7_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB7_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB7_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB7_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB7_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB7_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB7_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB7_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB7_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB7_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB7_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB7_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB7_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB7_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB7_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB7_TLBSYNC",  .decode.addr = A_SMMU_CB7_TLBSYNC,
     },{ .name = "SMMU_CB7_TLBSTATUS",  .decode.addr = A_SMMU_CB7_TLBSTATUS,
@@ -7801,18 +8101,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB8_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB8_IPAFAR_HIGH,
     },{ .name = "SMMU_CB8_TLBIVA_LOW",  .decode.addr = A_SMMU_CB8_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB8_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB8_TLBIVA_HIGH,
     },{ .name = "SMMU_CB8_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB8_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB8_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB8_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB8_TLBIASID",  .decode.addr = A_SMMU_CB8_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB8_TLBIALL",  .decode.addr = A_SMMU_CB8_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB8_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB8_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB8_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB8_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB8_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB8_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB8_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB8_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB8_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB8_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB8_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB8_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB8_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB8_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB8_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB8_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB8_TLBSYNC",  .decode.addr = A_SMMU_CB8_TLBSYNC,
     },{ .name = "SMMU_CB8_TLBSTATUS",  .decode.addr = A_SMMU_CB8_TLBSTATUS,
@@ -7872,18 +8180,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB9_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB9_IPAFAR_HIGH,
     },{ .name = "SMMU_CB9_TLBIVA_LOW",  .decode.addr = A_SMMU_CB9_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB9_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB9_TLBIVA_HIGH,
     },{ .name = "SMMU_CB9_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB9_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB9_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB9_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB9_TLBIASID",  .decode.addr = A_SMMU_CB9_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB9_TLBIALL",  .decode.addr = A_SMMU_CB9_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB9_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB9_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB9_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB9_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB9_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB9_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB9_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB9_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB9_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB9_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB9_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB9_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB9_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB9_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB9_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB9_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB9_TLBSYNC",  .decode.addr = A_SMMU_CB9_TLBSYNC,
     },{ .name = "SMMU_CB9_TLBSTATUS",  .decode.addr = A_SMMU_CB9_TLBSTATUS,
@@ -7943,18 +8259,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB10_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB10_IPAFAR_HIGH,
     },{ .name = "SMMU_CB10_TLBIVA_LOW",  .decode.addr = A_SMMU_CB10_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB10_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB10_TLBIVA_HIGH,
     },{ .name = "SMMU_CB10_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB10_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB10_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB10_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB10_TLBIASID",  .decode.addr = A_SMMU_CB10_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB10_TLBIALL",  .decode.addr = A_SMMU_CB10_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB10_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB10_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB10_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB10_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB10_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB10_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB10_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB10_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB10_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB10_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB10_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB10_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB10_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB10_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB10_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB10_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB10_TLBSYNC",  .decode.addr = A_SMMU_CB10_TLBSYNC,
     },{ .name = "SMMU_CB10_TLBSTATUS",  .decode.addr = A_SMMU_CB10_TLBSTATUS,
@@ -8014,18 +8338,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB11_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB11_IPAFAR_HIGH,
     },{ .name = "SMMU_CB11_TLBIVA_LOW",  .decode.addr = A_SMMU_CB11_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB11_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB11_TLBIVA_HIGH,
     },{ .name = "SMMU_CB11_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB11_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB11_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB11_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB11_TLBIASID",  .decode.addr = A_SMMU_CB11_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB11_TLBIALL",  .decode.addr = A_SMMU_CB11_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB11_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB11_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB11_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB11_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB11_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB11_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB11_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB11_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB11_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB11_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB11_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB11_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB11_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB11_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB11_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB11_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB11_TLBSYNC",  .decode.addr = A_SMMU_CB11_TLBSYNC,
     },{ .name = "SMMU_CB11_TLBSTATUS",  .decode.addr = A_SMMU_CB11_TLBSTATUS,
@@ -8085,18 +8417,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB12_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB12_IPAFAR_HIGH,
     },{ .name = "SMMU_CB12_TLBIVA_LOW",  .decode.addr = A_SMMU_CB12_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB12_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB12_TLBIVA_HIGH,
     },{ .name = "SMMU_CB12_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB12_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB12_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB12_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB12_TLBIASID",  .decode.addr = A_SMMU_CB12_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB12_TLBIALL",  .decode.addr = A_SMMU_CB12_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB12_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB12_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB12_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB12_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB12_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB12_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB12_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB12_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB12_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB12_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB12_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB12_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB12_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB12_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB12_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB12_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB12_TLBSYNC",  .decode.addr = A_SMMU_CB12_TLBSYNC,
     },{ .name = "SMMU_CB12_TLBSTATUS",  .decode.addr = A_SMMU_CB12_TLBSTATUS,
@@ -8156,18 +8496,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB13_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB13_IPAFAR_HIGH,
     },{ .name = "SMMU_CB13_TLBIVA_LOW",  .decode.addr = A_SMMU_CB13_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB13_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB13_TLBIVA_HIGH,
     },{ .name = "SMMU_CB13_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB13_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB13_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB13_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB13_TLBIASID",  .decode.addr = A_SMMU_CB13_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB13_TLBIALL",  .decode.addr = A_SMMU_CB13_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB13_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB13_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB13_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB13_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB13_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB13_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB13_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB13_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB13_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB13_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB13_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB13_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB13_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB13_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB13_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB13_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB13_TLBSYNC",  .decode.addr = A_SMMU_CB13_TLBSYNC,
     },{ .name = "SMMU_CB13_TLBSTATUS",  .decode.addr = A_SMMU_CB13_TLBSTATUS,
@@ -8227,18 +8575,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB14_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB14_IPAFAR_HIGH,
     },{ .name = "SMMU_CB14_TLBIVA_LOW",  .decode.addr = A_SMMU_CB14_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB14_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB14_TLBIVA_HIGH,
     },{ .name = "SMMU_CB14_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB14_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB14_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB14_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB14_TLBIASID",  .decode.addr = A_SMMU_CB14_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB14_TLBIALL",  .decode.addr = A_SMMU_CB14_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB14_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB14_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB14_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB14_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB14_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB14_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB14_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB14_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB14_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB14_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB14_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB14_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB14_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB14_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB14_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB14_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB14_TLBSYNC",  .decode.addr = A_SMMU_CB14_TLBSYNC,
     },{ .name = "SMMU_CB14_TLBSTATUS",  .decode.addr = A_SMMU_CB14_TLBSTATUS,
@@ -8298,18 +8654,26 @@ static DepRegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "SMMU_CB15_IPAFAR_HIGH",  .decode.addr = A_SMMU_CB15_IPAFAR_HIGH,
     },{ .name = "SMMU_CB15_TLBIVA_LOW",  .decode.addr = A_SMMU_CB15_TLBIVA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB15_TLBIVA_HIGH",  .decode.addr = A_SMMU_CB15_TLBIVA_HIGH,
     },{ .name = "SMMU_CB15_TLBIVAA_LOW",  .decode.addr = A_SMMU_CB15_TLBIVAA_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB15_TLBIVAA_HIGH",  .decode.addr = A_SMMU_CB15_TLBIVAA_HIGH,
     },{ .name = "SMMU_CB15_TLBIASID",  .decode.addr = A_SMMU_CB15_TLBIASID,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB15_TLBIALL",  .decode.addr = A_SMMU_CB15_TLBIALL,
+        .post_write = smmu_tlbi_cb_pw,
     },{ .name = "SMMU_CB15_TLBIVAL_LOW",  .decode.addr = A_SMMU_CB15_TLBIVAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB15_TLBIVAL_HIGH",  .decode.addr = A_SMMU_CB15_TLBIVAL_HIGH,
     },{ .name = "SMMU_CB15_TLBIVAAL_LOW",  .decode.addr = A_SMMU_CB15_TLBIVAAL_LOW,
+        .post_write = smmu_tlbi_cb_va_pw,
     },{ .name = "SMMU_CB15_TLBIVAAL_HIGH",  .decode.addr = A_SMMU_CB15_TLBIVAAL_HIGH,
     },{ .name = "SMMU_CB15_TLBIIPAS2_LOW",  .decode.addr = A_SMMU_CB15_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB15_TLBIIPAS2_HIGH",  .decode.addr = A_SMMU_CB15_TLBIIPAS2_HIGH,
     },{ .name = "SMMU_CB15_TLBIIPAS2L_LOW",  .decode.addr = A_SMMU_CB15_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbi_all_pw,
     },{ .name = "SMMU_CB15_TLBIIPAS2L_HIGH",  .decode.addr = A_SMMU_CB15_TLBIIPAS2L_HIGH,
     },{ .name = "SMMU_CB15_TLBSYNC",  .decode.addr = A_SMMU_CB15_TLBSYNC,
     },{ .name = "SMMU_CB15_TLBSTATUS",  .decode.addr = A_SMMU_CB15_TLBSTATUS,
@@ -8350,6 +8714,9 @@ static void smmu500_reset(DeviceState *dev)
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         dep_register_reset(&s->regs_info[i]);
     }
+    qemu_spin_lock(&s->tlb.lock);
+    smmu_tlb_flush_all(s);
+    qemu_spin_unlock(&s->tlb.lock);
 }
 
 static uint64_t smmu500_read(void *opaque, hwaddr addr, unsigned size)
@@ -8371,6 +8738,7 @@ static void smmu500_write(void *opaque, hwaddr addr, uint64_t value,
 {
     SMMU *s = XILINX_SMMU500(opaque);
     DepRegisterInfo *r = &s->regs_info[addr / 4];
+    uint32_t old;
 
     if (!r->data) {
         qemu_log("%s: Decode error: write to %" HWADDR_PRIx "=%" PRIx64 "\n",
@@ -8378,7 +8746,13 @@ static void smmu500_write(void *opaque, hwaddr addr, uint64_t value,
                  addr, value);
         return;
     }
+    old = s->regs[addr / 4];
     dep_register_write(r, value, ~0);
+
+    /* Cached translations don't survive configuration changes.  */
+    qemu_spin_lock(&s->tlb.lock);
+    smmu_config_written(s, addr, old);
+    qemu_spin_unlock(&s->tlb.lock);
 }
 
 
@@ -8444,6 +8818,13 @@ static void smmu500_init(Object *obj)
         g_free(name);
         s->tbu[i].smmu = s;
     }
+
+    qemu_spin_init(&s->tlb.lock);
+
+    object_property_add_uint64_ptr(obj, "tlb-hits", &s->tlb.hits,
+                                   &error_abort);
+    object_property_add_uint64_ptr(obj, "tlb-misses", &s->tlb.misses,
+                                   &error_abort);
 }
 
 static bool smmu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
@@ -8481,11 +8862,23 @@ static Property smmu_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static int smmu500_post_load(void *opaque, int version_id)
+{
+    SMMU *s = XILINX_SMMU500(opaque);
+
+    /* The caches hold translations of the configuration we replaced.  */
+    qemu_spin_lock(&s->tlb.lock);
+    smmu_tlb_flush_all(s);
+    qemu_spin_unlock(&s->tlb.lock);
+    return 0;
+}
+
 static const VMStateDescription vmstate_smmu500 = {
     .name = TYPE_XILINX_SMMU500,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = smmu500_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, SMMU, R_MAX),
         VMSTATE_END_OF_LIST(),
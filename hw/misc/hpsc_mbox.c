@@ -1,29 +1,46 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
+#include "qemu/host-utils.h"
+#include "trace.h"
 
 #include "hw/misc/hpsc_mbox.h"
 
-static void update_irq(HPSCMboxState *s, unsigned instance)
+/* Bitmap of the interrupts the instance currently asserts.  */
+static uint32_t instance_irqs(HPSCMboxInstance *si)
 {
-    HPSCMboxInstance *si = &s->mbox[instance];
+    uint32_t irqs = 0;
     unsigned int_idx;
 
-    // For now, we resolve the mapping here, every time. Alternatively, we
-    // could resolve the mapping upon write to Interrupt Enable register, store
-    // it in the instance state, and simply set the state of the saved irq here.
-
     for (int_idx = 0; int_idx < HPSC_MBOX_INTS; ++int_idx) {
         unsigned event_mask = (si->int_enable >> (2 * int_idx)) & HPSC_MBOX_EVENTS_MASK;
-        if (event_mask) { // are any events mapped to this interrupt?
-
-            // Are any *of the mapped events* raised?
-            bool intval = !!(si->event_status & event_mask);
+        // Are any *of the mapped events* raised?
+        if (si->event_status & event_mask)
+            irqs |= 1u << int_idx;
+    }
+    return irqs;
+}
 
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u event mask %x: set irq %u to %u\n",
-                          __func__, instance, event_mask, int_idx, intval);
-            qemu_set_irq(s->arm_irq[int_idx], intval);
-        }
+static void update_irq(HPSCMboxState *s, unsigned instance)
+{
+    HPSCMboxInstance *si = &s->mbox[instance];
+    uint32_t irqs = instance_irqs(si);
+    uint32_t changed = irqs ^ si->irq_out;
+
+    trace_hpsc_mbox_events(instance, si->event_status, si->int_enable);
+
+    // An interrupt line is the OR of all the instances mapped to it, only
+    // touch the lines whose level actually changes.
+    si->irq_out = irqs;
+    while (changed) {
+        unsigned int_idx = ctz32(changed);
+        bool level = irqs & (1u << int_idx);
+
+        changed &= changed - 1;
+        if (level ? s->irq_count[int_idx]++ : --s->irq_count[int_idx])
+            continue;
+        trace_hpsc_mbox_irq(int_idx, level);
+        qemu_set_irq(s->arm_irq[int_idx], level);
     }
 }
 
@@ -69,20 +86,20 @@ static void hpsc_mbox_reset(DeviceState *dev)
 {
     HPSCMboxState *s = HPSC_MBOX(dev);
     unsigned i, int_idx;
-    for (i = 0; i < HPSC_MBOX_INSTANCES; ++i)
+    for (i = 0; i < HPSC_MBOX_INSTANCES; ++i) {
         hpsc_mbox_reset_instance(s, i);
-    for (int_idx = 0; int_idx < HPSC_MBOX_INTS; ++int_idx)
+        s->mbox[i].irq_out = 0;
+    }
+    for (int_idx = 0; int_idx < HPSC_MBOX_INTS; ++int_idx) {
+        s->irq_count[int_idx] = 0;
         qemu_set_irq(s->arm_irq[int_idx], 0);
+    }
 }
 
-static MemTxResult hpsc_mbox_read(void *opaque, hwaddr offset, uint64_t *r, unsigned size, MemTxAttrs attrs)
+static void hpsc_mbox_read_reg(HPSCMboxState *s, unsigned instance, hwaddr offset, uint64_t *r)
 {
     uint64_t ie;
     uint32_t int_idx;
-    unsigned instance = offset / HPSC_MBOX_INSTANCE_REGION;
-    offset %= HPSC_MBOX_INSTANCE_REGION;
-
-    HPSCMboxState *s = HPSC_MBOX(opaque);
     HPSCMboxInstance *si = &s->mbox[instance];
 
     /* Allow reads to everyone, including non-owner and non-destination */
@@ -106,33 +123,42 @@ static MemTxResult hpsc_mbox_read(void *opaque, hwaddr offset, uint64_t *r, unsi
         for (int_idx = 0; int_idx < HPSC_MBOX_INTS; ++int_idx)
             ie |= (si->int_enable >> (2 * int_idx)) & HPSC_MBOX_EVENTS_MASK;
         *r = si->event_status & ie;
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u %p: cause: event_status %x cause %lx\n",
-                      __func__, instance, si, si->event_status, *r);
         break;
     default:
         if (offset >= REG_DATA) {
             unsigned reg_idx = (offset - REG_DATA) / 4; // each reg is 32 bits = 4 bytes
             *r = si->data[reg_idx];
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u read data[%lx|%u] -> %x\n",
-                          __func__, instance, offset, reg_idx, si->data[reg_idx]);
         } else {
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unrecognized register\n", __func__);
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: read from unrecognized register\n", __func__);
+            *r = 0;
         }
     }
+}
+
+static MemTxResult hpsc_mbox_read(void *opaque, hwaddr offset, uint64_t *r, unsigned size, MemTxAttrs attrs)
+{
+    HPSCMboxState *s = HPSC_MBOX(opaque);
+    unsigned instance = offset / HPSC_MBOX_INSTANCE_REGION;
+    hwaddr reg = offset % HPSC_MBOX_INSTANCE_REGION;
+    uint64_t hi;
+
+    hpsc_mbox_read_reg(s, instance, reg, r);
+    if (size == 8) {
+        // Two consecutive registers, e.g. a pair of data words
+        hpsc_mbox_read_reg(s, instance, reg + 4, &hi);
+        *r |= hi << 32;
+    }
+    trace_hpsc_mbox_read(instance, reg, *r, size);
     return MEMTX_OK;
 }
 
-static MemTxResult hpsc_mbox_write(void *opaque, hwaddr offset,
-                               uint64_t value, unsigned size, MemTxAttrs attrs)
+static MemTxResult hpsc_mbox_write_reg(HPSCMboxState *s, unsigned instance, hwaddr offset,
+                                       uint32_t value, MemTxAttrs attrs)
 {
     uint32_t owner, src, dest;
     bool unsecure;
     unsigned reg_idx;
 
-    unsigned instance = offset / HPSC_MBOX_INSTANCE_REGION;
-    offset %= HPSC_MBOX_INSTANCE_REGION;
-
-    HPSCMboxState *s = HPSC_MBOX(opaque);
     HPSCMboxInstance *si = &s->mbox[instance];
 
     switch (offset) {
@@ -158,27 +184,25 @@ static MemTxResult hpsc_mbox_write(void *opaque, hwaddr offset,
             if (owner || !check_owner(si, attrs, "OWNER"))
                 return MEMTX_ERROR;
             hpsc_mbox_reset_instance(s, instance);
+            update_irq(s, instance);
         }
         break;
     case REG_INT_ENABLE: // bit 2*K+X maps event X to interrupt K
         if (!check_owner_or_dest(si, attrs, "EVENT_ENABLE"))
             return MEMTX_ERROR;
         si->int_enable = value;
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u int_enable %x\n", __func__, instance, si->int_enable);
         update_irq(s, instance);
         break;
     case REG_EVENT_CLEAR:
         if (!check_owner_or_dest(si, attrs, "EVENT_CLEAR"))
             return MEMTX_ERROR;
         si->event_status &= ~value;
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u, event_status %x\n", __func__, instance, si->event_status);
         update_irq(s, instance);
         break;
     case REG_EVENT_SET:
         if (!check_owner_or_dest(si, attrs, "EVENT_SET"))
             return MEMTX_ERROR;
         si->event_status |= value;
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u event_status %x\n", __func__, instance, si->event_status);
         update_irq(s, instance);
         break;
     default:
@@ -187,9 +211,7 @@ static MemTxResult hpsc_mbox_write(void *opaque, hwaddr offset,
                 return MEMTX_ERROR;
             reg_idx = (offset - REG_DATA) / 4; // each register is 32 bits = 4 bytes
             assert(reg_idx < HPSC_MBOX_DATA_REGS); // otherwise we got here through wrong calc, not bad user code
-            si->data[reg_idx] = (uint32_t)value;
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: instance %u wrote data[%lx|%u] <- %x\n",
-                          __func__, instance, offset, reg_idx, (uint32_t)value);
+            si->data[reg_idx] = value;
         } else {
             switch (offset) {
                 case REG_EVENT_CAUSE:
@@ -206,12 +228,31 @@ static MemTxResult hpsc_mbox_write(void *opaque, hwaddr offset,
     return MEMTX_OK;
 }
 
+static MemTxResult hpsc_mbox_write(void *opaque, hwaddr offset,
+                               uint64_t value, unsigned size, MemTxAttrs attrs)
+{
+    HPSCMboxState *s = HPSC_MBOX(opaque);
+    unsigned instance = offset / HPSC_MBOX_INSTANCE_REGION;
+    hwaddr reg = offset % HPSC_MBOX_INSTANCE_REGION;
+    MemTxResult ret;
+
+    trace_hpsc_mbox_write(instance, reg, value, size);
+    ret = hpsc_mbox_write_reg(s, instance, reg, value, attrs);
+    if (size == 8 && ret == MEMTX_OK) {
+        // Two consecutive registers, e.g. a pair of data words
+        ret = hpsc_mbox_write_reg(s, instance, reg + 4, value >> 32, attrs);
+    }
+    return ret;
+}
+
 static const MemoryRegionOps hpsc_mbox_ops = {
     .read_with_attrs = hpsc_mbox_read,
     .write_with_attrs = hpsc_mbox_write,
     .endianness = DEVICE_NATIVE_ENDIAN,
     .valid.min_access_size = 4,
-    .valid.max_access_size = 4,
+    .valid.max_access_size = 8,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 8,
 };
 
 /* vmstate of a single mailbox */
@@ -231,12 +272,27 @@ static const VMStateDescription vmstate_hpsc_mbox_box = {
     }
 };
 
+static int hpsc_mbox_post_load(void *opaque, int version_id)
+{
+    HPSCMboxState *s = HPSC_MBOX(opaque);
+    unsigned i, int_idx;
+
+    memset(s->irq_count, 0, sizeof(s->irq_count));
+    for (i = 0; i < HPSC_MBOX_INSTANCES; ++i) {
+        s->mbox[i].irq_out = instance_irqs(&s->mbox[i]);
+        for (int_idx = 0; int_idx < HPSC_MBOX_INTS; ++int_idx)
+            s->irq_count[int_idx] += extract32(s->mbox[i].irq_out, int_idx, 1);
+    }
+    return 0;
+}
+
 /* vmstate of the entire device */
 static const VMStateDescription vmstate_hpsc_mbox = {
     .name = TYPE_HPSC_MBOX,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = hpsc_mbox_post_load,
     .fields      = (VMStateField[]) {
         VMSTATE_STRUCT_ARRAY(mbox, HPSCMboxState, HPSC_MBOX_INSTANCES, 1,
                              vmstate_hpsc_mbox_box, HPSCMboxInstance),
@@ -296,6 +296,8 @@ DEP_REG32(R15_CONFIG, 0x1fc)
 
 #define NR_XMPU_REGIONS 16
 #define MAX_NR_MASTERS  8
+/* Master IDs are matched on 10 bits.  */
+#define XMPU_NR_MIDS    1024
 
 typedef struct XMPU XMPU;
 
@@ -321,6 +323,29 @@ typedef struct XMPUMaster {
     } err;
 } XMPUMaster;
 
+typedef struct XMPURegion {
+    uint64_t start;
+    uint64_t end;
+    uint64_t size;
+    union {
+        uint32_t u32;
+        struct {
+            uint16_t mask;
+            uint16_t id;
+        };
+    } master;
+    struct {
+        bool nschecktype;
+        bool regionns;
+        bool wrallowed;
+        bool rdallowed;
+        bool enable;
+    } config;
+    /* Resulting permissions for non-secure [0] and secure [1] accesses.  */
+    IOMMUAccessFlags perm[2];
+    bool sec_vio[2];
+} XMPURegion;
+
 struct XMPU {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -348,27 +373,16 @@ struct XMPU {
     const char *prefix;
     bool enabled;
     qemu_irq enabled_signal;
-};
 
-typedef struct XMPURegion {
-    uint64_t start;
-    uint64_t end;
-    uint64_t size;
-    union {
-        uint32_t u32;
-        struct {
-            uint16_t mask;
-            uint16_t id;
-        };
-    } master;
+    /* Enabled regions decoded by xmpu_decode_regions(), highest priority
+     * first, and for every master ID the bitmap of the ones it matches.
+     */
     struct {
-        bool nschecktype;
-        bool regionns;
-        bool wrallowed;
-        bool rdallowed;
-        bool enable;
-    } config;
-} XMPURegion;
+        XMPURegion region[NR_XMPU_REGIONS];
+        unsigned int nr;
+        uint16_t mid_map[XMPU_NR_MIDS];
+    } lut;
+};
 
 static void xmpu_decode_region(XMPU *s, XMPURegion *xr, unsigned int region)
 {
@@ -392,6 +406,84 @@ static void xmpu_decode_region(XMPU *s, XMPURegion *xr, unsigned int region)
     xr->config.nschecktype = DEP_F_EX32(config, R00_CONFIG, NSCHECKTYPE);
 }
 
+static void xmpu_decode_regions(XMPU *s)
+{
+    unsigned int mid;
+    int i;
+
+    memset(s->lut.mid_map, 0, sizeof s->lut.mid_map);
+    s->lut.nr = 0;
+
+    for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
+        XMPURegion *xr = &s->lut.region[s->lut.nr];
+        unsigned int sec;
+
+        xmpu_decode_region(s, xr, i);
+        if (!xr->config.enable) {
+            continue;
+        }
+
+        if (xr->start & s->addr_mask) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: Bad region start address %" PRIx64 "\n",
+                          s->prefix, xr->start);
+        }
+
+        if (xr->end & s->addr_mask) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: Bad region end address %" PRIx64 "\n",
+                           s->prefix, xr->end);
+        }
+
+        if (xr->start < s->cfg.base) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: Too low region start address %" PRIx64 "\n",
+                           s->prefix, xr->end);
+        }
+
+        xr->start &= ~s->addr_mask;
+        xr->end &= ~s->addr_mask;
+
+        for (sec = 0; sec < 2; sec++) {
+            bool sec_access_check;
+
+            /* Determine if this region is accessible by the transactions
+             * security domain.
+             */
+            if (xr->config.nschecktype) {
+                /* In strict mode, secure accesses are not allowed to
+                 * non-secure regions (and vice-versa).
+                 */
+                sec_access_check = (sec != xr->config.regionns);
+            } else {
+                /* In relaxed mode secure accesses can access any region
+                 * while non-secure can only access non-secure areas.
+                 */
+                sec_access_check = (sec || xr->config.regionns);
+            }
+
+            xr->perm[sec] = IOMMU_NONE;
+            xr->sec_vio[sec] = !sec_access_check;
+            if (sec_access_check) {
+                if (xr->config.rdallowed) {
+                    xr->perm[sec] |= IOMMU_RO;
+                }
+                if (xr->config.wrallowed) {
+                    xr->perm[sec] |= IOMMU_WO;
+                }
+            }
+        }
+
+        for (mid = 0; mid < XMPU_NR_MIDS; mid++) {
+            if ((xr->master.mask & xr->master.id) ==
+                (xr->master.mask & mid)) {
+                s->lut.mid_map[mid] |= 1 << s->lut.nr;
+            }
+        }
+        s->lut.nr++;
+    }
+}
+
 static void isr_update_irq(XMPU *s)
 {
     bool pending = s->regs[R_ISR] & ~s->regs[R_IMR];
@@ -429,18 +521,8 @@ static void xmpu_update_enabled(XMPU *s)
     bool regions_enabled = false;
     bool default_wr = DEP_AF_EX32(s->regs, CTRL, DEFWRALLOWED);
     bool default_rd = DEP_AF_EX32(s->regs, CTRL, DEFRDALLOWED);
-    int i;
 
-    /* Lookup if this address fits a region.  */
-    for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
-        XMPURegion xr;
-        xmpu_decode_region(s, &xr, i);
-        if (!xr.config.enable) {
-            continue;
-        }
-        regions_enabled = true;
-        break;
-    }
+    regions_enabled = s->lut.nr > 0;
 
     s->enabled = true;
     if (!regions_enabled && default_wr && default_rd) {
@@ -452,6 +534,7 @@ static void xmpu_flush(XMPU *s)
 {
     unsigned int i;
 
+    xmpu_decode_regions(s);
     xmpu_update_enabled(s);
     qemu_set_irq(s->enabled_signal, s->enabled);
 
@@ -826,7 +909,6 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
                                            bool *sec_vio)
 {
     XMPU *s = xm->parent;
-    XMPURegion xr;
     IOMMUTLBEntry ret = {
         .iova = addr,
         .translated_addr = addr,
@@ -842,9 +924,8 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     bool default_wr = DEP_AF_EX32(s->regs, CTRL, DEFWRALLOWED);
     bool default_rd = DEP_AF_EX32(s->regs, CTRL, DEFRDALLOWED);
     bool sec = attr->secure;
-    bool sec_access_check;
     unsigned int nr_matched = 0;
-    int i;
+    uint32_t candidates;
 
     /* No security violation by default.  */
     *sec_vio = false;
@@ -858,67 +939,18 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     /* Convert to an absolute address to simplify the compare logic.  */
     addr += s->cfg.base;
 
-    /* Lookup if this address fits a region.  */
-    for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
-        bool id_match;
-        bool match;
-
-        xmpu_decode_region(s, &xr, i);
-        if (!xr.config.enable) {
-            continue;
-        }
-
-        if (xr.start & s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad region start address %" PRIx64 "\n",
-                          s->prefix, xr.start);
-        }
-
-        if (xr.end & s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad region end address %" PRIx64 "\n",
-                           s->prefix, xr.end);
-        }
-
-        if (xr.start < s->cfg.base) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Too low region start address %" PRIx64 "\n",
-                           s->prefix, xr.end);
-        }
-
-        xr.start &= ~s->addr_mask;
-        xr.end &= ~s->addr_mask;
+    /* Lookup if this address fits a region, only the regions matching
+     * the master ID need to be looked at.
+     */
+    candidates = s->lut.mid_map[attr->master_id % XMPU_NR_MIDS];
+    while (candidates) {
+        XMPURegion *xr = &s->lut.region[ctz32(candidates)];
 
-        id_match = (xr.master.mask & xr.master.id) ==
-                       (xr.master.mask & attr->master_id);
-        match = id_match && (addr >= xr.start && addr < xr.end);
-        if (match) {
+        candidates &= candidates - 1;
+        if (addr >= xr->start && addr < xr->end) {
             nr_matched++;
-            /* Determine if this region is accessible by the transactions
-             * security domain.
-             */
-            if (xr.config.nschecktype) {
-                /* In strict mode, secure accesses are not allowed to
-                 * non-secure regions (and vice-versa).
-                 */
-                sec_access_check = (sec != xr.config.regionns);
-            } else {
-                /* In relaxed mode secure accesses can access any region
-                 * while non-secure can only access non-secure areas.
-                 */
-                sec_access_check = (sec || xr.config.regionns);
-            }
-
-            if (sec_access_check) {
-                if (xr.config.rdallowed) {
-                    ret.perm |= IOMMU_RO;
-                }
-                if (xr.config.wrallowed) {
-                    ret.perm |= IOMMU_WO;
-                }
-            } else {
-                *sec_vio = true;
-            }
+            ret.perm = xr->perm[sec];
+            *sec_vio = xr->sec_vio[sec];
             break;
         }
     }
@@ -1182,11 +1214,20 @@ static Property xmpu_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static int xmpu_post_load(void *opaque, int version_id)
+{
+    XMPU *s = XILINX_XMPU(opaque);
+
+    xmpu_flush(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_xmpu = {
     .name = TYPE_XILINX_XMPU,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = xmpu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XMPU, R_MAX),
         VMSTATE_END_OF_LIST(),
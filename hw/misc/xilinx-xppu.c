@@ -207,6 +207,8 @@ DEP_REG32(RAM_ADJ, 0x1fc)
 #define R_MAX (R_RAM_ADJ + 1)
 
 #define NR_MID_ENTRIES 20
+/* Master IDs are matched on 10 bits.  */
+#define XPPU_NR_MIDS 1024
 
 #define NR_32B_APL_ENTRIES 128
 #define NR_64K_APL_ENTRIES 256
@@ -252,6 +254,19 @@ struct XPPU {
 
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
+
+    /* Derived from the MID registers, CTRL and perm_ram, see
+     * xppu_update_mid_lut() and xppu_update_apl_parity().
+     */
+    struct {
+        /* For every master ID, the bitmap of MID entries it matches.  */
+        uint32_t mid_map[XPPU_NR_MIDS];
+        /* MID entries with a bad parity or marked read-only.  */
+        uint32_t mid_bad_parity;
+        uint32_t mid_ro;
+        /* APL entries with a bad parity.  */
+        unsigned long apl_bad_parity[BITS_TO_LONGS(NR_APL_ENTRIES)];
+    } lut;
 };
 
 static bool parity32(uint32_t v)
@@ -306,9 +321,35 @@ static void check_mid_parities(XPPU *s)
     }
 }
 
-static bool check_apl_parity(XPPU *s, uint32_t val32)
+static void xppu_update_mid_lut(XPPU *s)
+{
+    unsigned int i, id;
+
+    memset(s->lut.mid_map, 0, sizeof s->lut.mid_map);
+    s->lut.mid_bad_parity = 0;
+    s->lut.mid_ro = 0;
+
+    for (i = 0; i < NR_MID_ENTRIES; i++) {
+        uint32_t val32 = s->regs[R_MASTER_ID00 + i];
+        uint32_t mid = DEP_F_EX32(val32, MASTER_ID00, MID);
+        uint32_t mask = DEP_F_EX32(val32, MASTER_ID00, MIDM);
+
+        for (id = 0; id < XPPU_NR_MIDS; id++) {
+            if ((mid & mask) == (id & mask)) {
+                s->lut.mid_map[id] |= 1U << i;
+            }
+        }
+        if (!check_mid_parity(s, val32)) {
+            s->lut.mid_bad_parity |= 1U << i;
+        }
+        if (DEP_F_EX32(val32, MASTER_ID00, MIDR)) {
+            s->lut.mid_ro |= 1U << i;
+        }
+    }
+}
+
+static void xppu_update_apl_parity(XPPU *s, unsigned int i)
 {
-    unsigned int i;
     /* Bit 31 - Parity of 27, 19:15.
      * Bit 30 - Parity of 14:10
      * Bit 29 - Parity of 9:5
@@ -320,31 +361,35 @@ static bool check_apl_parity(XPPU *s, uint32_t val32)
         0x1f << 10,
         (0x1f << 15) | 1 << 27,
     };
-    uint32_t p = 0, p_written;
-    bool ok;
+    uint32_t val32 = s->perm_ram[i];
+    uint32_t p = 0;
+    unsigned int j;
 
     if (!DEP_AF_EX32(s->regs, CTRL, APER_PARITY_EN)) {
-        return true;
+        clear_bit(i, s->lut.apl_bad_parity);
+        return;
     }
 
-    for (i = 0; i < ARRAY_SIZE(apl_parities); i++) {
-        uint32_t v = val32;
-        bool parity;
+    for (j = 0; j < ARRAY_SIZE(apl_parities); j++) {
+        p |= ((int) parity32(val32 & apl_parities[j])) << j;
+    }
 
-        /* Extract the lanes for this pairity.  */
-        v &= apl_parities[i];
-        parity = parity32(v);
-        p |= ((int) parity) << i;
+    if ((val32 >> 28) == p) {
+        clear_bit(i, s->lut.apl_bad_parity);
+    } else {
+        set_bit(i, s->lut.apl_bad_parity);
     }
+}
 
-    p_written = val32 >> 28;
-    ok = p_written == p;
+/* Rebuild all the lookups, the parity checks depend on CTRL.  */
+static void xppu_update_lut(XPPU *s)
+{
+    unsigned int i;
 
-    if (!ok) {
-        qemu_log_mask(LOG_GUEST_ERROR, "Bad APL parity!\n");
-        DEP_AF_DP32(s->regs, ISR, APER_PARITY, true);
+    xppu_update_mid_lut(s);
+    for (i = 0; i < NR_APL_ENTRIES; i++) {
+        xppu_update_apl_parity(s, i);
     }
-    return ok;
 }
 
 static void isr_update_irq(XPPU *s)
@@ -394,6 +439,7 @@ static void ctrl_postw(DepRegisterInfo *reg, uint64_t val64)
     XPPU *s = XILINX_XPPU(reg->opaque);
     update_mrs(s);
     check_mid_parities(s);
+    xppu_update_lut(s);
     isr_update_irq(s);
 }
 
@@ -401,6 +447,7 @@ static void mid_postw(DepRegisterInfo *reg, uint64_t val64)
 {
     XPPU *s = XILINX_XPPU(reg->opaque);
     check_mid_parity(s, val64);
+    xppu_update_mid_lut(s);
     isr_update_irq(s);
 }
 
@@ -552,66 +599,57 @@ static void xppu_reset(DeviceState *dev)
         dep_register_reset(&s->regs_info[i]);
     }
     update_mrs(s);
+    xppu_update_lut(s);
     isr_update_irq(s);
 }
 
-static bool xppu_ap_check(XPPU *s, MemoryTransaction *tr, uint32_t apl)
+static bool xppu_ap_check(XPPU *s, MemoryTransaction *tr, uint32_t apl,
+                          unsigned int ram_offset)
 {
-    unsigned int i;
-    bool mid_match = false;
     bool tz = extract32(apl, 27, 1);
-    bool ok;
+    uint32_t candidates;
+    uint32_t ok;
+    uint32_t failed;
 
-    ok = check_apl_parity(s, apl);
-    if (!ok) {
+    if (test_bit(ram_offset, s->lut.apl_bad_parity)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "Bad APL parity!\n");
+        DEP_AF_DP32(s->regs, ISR, APER_PARITY, true);
         return false;
     }
 
-    /* Check MIDs.  */
-    for (i = 0; i < NR_MID_ENTRIES; i++) {
-        uint32_t val32, mid, mask;
-        bool readonly;
-
-        if (!extract32(apl, i, 1)) {
-            continue;
-        }
-
-        val32 = s->regs[R_MASTER_ID00 + i];
-        mid = DEP_F_EX32(val32, MASTER_ID00, MID);
-        readonly = DEP_F_EX32(val32, MASTER_ID00, MIDR);
-        mask = DEP_F_EX32(val32, MASTER_ID00, MIDM);
-
-        if ((mid & mask) != (tr->attr.master_id & mask)) {
-            continue;
-        }
-
-        mid_match = true;
-
-        /* Check MID parity.  */
-        if (check_mid_parity(s, val32) == false) {
-            DEP_AF_DP32(s->regs, ISR, MID_PARITY, true);
-            continue;
-        }
-
-        if (readonly && tr->rw) {
-            DEP_AF_DP32(s->regs, ISR, MID_RO, true);
-            continue;
-        }
-
-        if (!tr->attr.secure && !tz) {
-            DEP_AF_DP32(s->regs, ISR, APER_TZ, true);
-            continue;
-        }
+    /* MID entries enabled by the APL that match the master ID.  */
+    candidates = apl & s->lut.mid_map[tr->attr.master_id % XPPU_NR_MIDS];
+    if (!candidates) {
+        /* Set if MID checks don't make it past masking and compare.  */
+        DEP_AF_DP32(s->regs, ISR, MID_MISS, true);
+        return false;
+    }
 
-        break;
+    ok = candidates & ~s->lut.mid_bad_parity;
+    if (tr->rw) {
+        ok &= ~s->lut.mid_ro;
+    }
+    if (!tr->attr.secure && !tz) {
+        ok = 0;
     }
 
-    if (!mid_match) {
-        /* Set if MID checks don't make it past masking and compare.  */
-        DEP_AF_DP32(s->regs, ISR, MID_MISS, true);
+    /* The entries are checked in order, the ones before the first
+     * accepting entry flag their errors.
+     */
+    failed = ok ? candidates & ((ok & -ok) - 1) : candidates;
+    if (failed & s->lut.mid_bad_parity) {
+        DEP_AF_DP32(s->regs, ISR, MID_PARITY, true);
+        failed &= ~s->lut.mid_bad_parity;
+    }
+    if (tr->rw && (failed & s->lut.mid_ro)) {
+        DEP_AF_DP32(s->regs, ISR, MID_RO, true);
+        failed &= ~s->lut.mid_ro;
+    }
+    if (failed) {
+        DEP_AF_DP32(s->regs, ISR, APER_TZ, true);
     }
 
-    return i < NR_MID_ENTRIES;
+    return ok != 0;
 }
 
 static void xppu_ap_access(MemoryTransaction *tr)
@@ -637,7 +675,7 @@ static void xppu_ap_access(MemoryTransaction *tr)
 
     ram_offset += ap->ram_base;
     apl = s->perm_ram[ram_offset];
-    valid = xppu_ap_check(s, tr, apl);
+    valid = xppu_ap_check(s, tr, apl, ram_offset);
 
     if (!valid) {
         if (isr_free) {
@@ -728,6 +766,7 @@ static void xppu_write(void *opaque, hwaddr addr, uint64_t value,
         unsigned int i = (addr - 0x1000) / 4;
         assert(i < ARRAY_SIZE(s->perm_ram));
         s->perm_ram[i] = value;
+        xppu_update_apl_parity(s, i);
         return;
     }
 
@@ -882,11 +921,20 @@ static bool xppu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
     return parent_fmc ? parent_fmc->parse_reg(obj, reg, errp) : false;
 }
 
+static int xppu_post_load(void *opaque, int version_id)
+{
+    XPPU *s = XILINX_XPPU(opaque);
+
+    xppu_update_lut(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_xppu = {
     .name = TYPE_XILINX_XPPU,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = xppu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XPPU, R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -99,8 +99,9 @@ typedef struct HPSCElapsedTimerEvent {
     ARMSystemCounterEvent parent_obj;
 
     QLIST_ENTRY(HPSCElapsedTimerEvent) list_entry;
+    QLIST_ENTRY(HPSCElapsedTimerEvent) sched_entry;
 
-    QEMUTimer qtimer;
+    uint64_t deadline; /* in QEMU_CLOCK_VIRTUAL ns, multiple of delta */
     bool scheduled;
     ARMSystemCounterEventCb *cb;
     void *arg;
@@ -121,6 +122,11 @@ typedef struct HPSCElapsedTimer {
 
     QLIST_HEAD(se_list_head, HPSCElapsedTimerEvent) slave_events;
     HPSCElapsedTimerEvent event; /* note: also in slave_events list */
+
+    /* Scheduled events sorted by deadline, the single qtimer is armed for
+     * the earliest one. */
+    QLIST_HEAD(, HPSCElapsedTimerEvent) sched_events;
+    QEMUTimer *qtimer;
     
     qemu_irq irq;
 
@@ -147,13 +153,61 @@ static void set_count(HPSCElapsedTimer *s, uint64_t count)
             object_get_canonical_path(OBJECT(s)), count, s->offset, s->offset);
 }
 
+static void arm_qtimer(HPSCElapsedTimer *s)
+{
+    HPSCElapsedTimerEvent *first = QLIST_FIRST(&s->sched_events);
+
+    if (first) {
+        timer_mod(s->qtimer, first->deadline);
+    } else {
+        timer_del(s->qtimer);
+    }
+}
+
+static void sched_insert(HPSCElapsedTimer *s, HPSCElapsedTimerEvent *he)
+{
+    HPSCElapsedTimerEvent *e, *last = NULL;
+
+    QLIST_FOREACH(e, &s->sched_events, sched_entry) {
+        if (e->deadline > he->deadline)
+            break;
+        last = e;
+    }
+    if (last) {
+        QLIST_INSERT_AFTER(last, he, sched_entry);
+    } else {
+        QLIST_INSERT_HEAD(&s->sched_events, he, sched_entry);
+    }
+    he->scheduled = true;
+}
+
+static void sched_remove(HPSCElapsedTimerEvent *he)
+{
+    if (he->scheduled) {
+        QLIST_REMOVE(he, sched_entry);
+        he->scheduled = false;
+    }
+}
+
+static void qtimer_cb(void *opaque)
+{
+    HPSCElapsedTimer *s = HPSC_ELAPSED_TIMER(opaque);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    HPSCElapsedTimerEvent *he;
+
+    /* Callbacks may reschedule events, so always restart from the head. */
+    while ((he = QLIST_FIRST(&s->sched_events)) && he->deadline <= now) {
+        sched_remove(he);
+        he->cb(he->arg);
+    }
+    arm_qtimer(s);
+}
+
 static void update_freq(HPSCElapsedTimer *s)
 {
     uint32_t tickdiv = extract32(s->regs[R_REG_CONFIG_LO],
             R_REG_CONFIG_LO_TICKDIV_SHIFT, R_REG_CONFIG_LO_TICKDIV_LENGTH) + 1;
     unsigned cur_delta = s->delta;
-    uint64_t cur_remaining, remaining;
-    bool scheduled;
 
     s->freq_hz = s->clk_freq_hz / tickdiv;
     s->delta = NOMINAL_FREQ_HZ / s->freq_hz;
@@ -166,26 +220,18 @@ static void update_freq(HPSCElapsedTimer *s)
     if (s->delta == cur_delta)
         return;
 
+    /* Re-scale the remaining time of the scheduled events. Rounding down
+     * to the new delta keeps them in order, and only the one timer needs to
+     * be re-armed. */
     HPSCElapsedTimerEvent *he;
-    QLIST_FOREACH(he, &s->slave_events, list_entry) {
-        scheduled = he->scheduled;
-        if (scheduled) {
-            /* The timer.h interface does not support changing the scale
-             * of a timer, so we reinit and re-scale the remaining time. */
-            cur_remaining = timer_expire_time(&he->qtimer) * cur_delta;
-            remaining = cur_remaining / s->delta;
-            DB_PRINT("%s: update freq: event: mod: remaining %lu -> %lu\n",
-                     object_get_canonical_path(OBJECT(s)),
-                     cur_remaining, remaining);
-            timer_del(&he->qtimer);
-        }
-
-        timer_init(&he->qtimer, QEMU_CLOCK_VIRTUAL, s->delta, he->cb, he->arg);
-
-        if (scheduled) {
-            timer_mod(&he->qtimer, remaining);
-        }
+    QLIST_FOREACH(he, &s->sched_events, sched_entry) {
+        uint64_t cur_deadline = he->deadline;
+        he->deadline = cur_deadline / s->delta * s->delta;
+        DB_PRINT("%s: update freq: event: deadline %lu -> %lu\n",
+                 object_get_canonical_path(OBJECT(s)),
+                 cur_deadline, he->deadline);
     }
+    arm_qtimer(s);
 }
 
 static void synchronize(HPSCElapsedTimer *s)
@@ -209,39 +255,37 @@ static void event_init(HPSCElapsedTimerEvent *he, HPSCElapsedTimer *s,
     he->scheduled = false;
     he->cb = cb;
     he->arg = arg;
-    /* Timer is scaled by delta, because our maximum resolution is bounded by
-     * the clk freq (i.e. the delta). We don't have to scale it, though, could
-     * also keep it at same freq as QEMU_CLOCK_VIRTUAL. */
-    timer_init(&he->qtimer, QEMU_CLOCK_VIRTUAL, s->delta, cb, arg);
-    DB_PRINT("%s: event create: delta %u exp %lu\n",
-             object_get_canonical_path(OBJECT(s)), s->delta,
-             timer_expire_time(&he->qtimer));
+    DB_PRINT("%s: event create: delta %u\n",
+             object_get_canonical_path(OBJECT(s)), s->delta);
     QLIST_INSERT_HEAD(&s->slave_events, he, list_entry);
 }
 
-static void event_deinit(HPSCElapsedTimerEvent *he)
+static void event_deinit(HPSCElapsedTimerEvent *he, HPSCElapsedTimer *s)
 {
     QLIST_REMOVE(he, list_entry);
-    timer_deinit(&he->qtimer);
+    sched_remove(he);
+    arm_qtimer(s);
 }
 
 static void event_schedule(HPSCElapsedTimerEvent *he, HPSCElapsedTimer *s, uint64_t time)
 {
-    he->scheduled = true;
-    /* Scale the time given (in units exported by this timer interface, i.e.
-     * ns) by delta, because this internal event backend timer is scaled. */
+    /* Our maximum resolution is bounded by the clk freq (i.e. the delta),
+     * so the deadline is rounded down to a multiple of delta. */
     uint64_t event_time = (time - s->offset) / s->delta;
     DB_PRINT("%s: event sched: time %lx offset %ld "
              "(time - offset) %lx event_time %lx\n",
              object_get_canonical_path(OBJECT(s)), time, s->offset,
              time - s->offset, event_time);
-    timer_mod(&he->qtimer, event_time);
+    sched_remove(he);
+    he->deadline = event_time * s->delta;
+    sched_insert(s, he);
+    arm_qtimer(s);
 }
 
-static void event_cancel(HPSCElapsedTimerEvent *he)
+static void event_cancel(HPSCElapsedTimerEvent *he, HPSCElapsedTimer *s)
 {
-    timer_del(&he->qtimer);
-    he->scheduled = false;
+    sched_remove(he);
+    arm_qtimer(s);
 }
 
 static void execute_cmd(HPSCElapsedTimer *s, cmd_t cmd)
@@ -505,8 +549,8 @@ static ARMSystemCounterEvent *hpsc_elapsed_timer_event_create(
 static void hpsc_elapsed_timer_event_destroy(ARMSystemCounterEvent *e)
 {
     HPSCElapsedTimerEvent *he = HPSC_ELAPSED_TIMER_EVENT(e);
+    event_deinit(he, HPSC_ELAPSED_TIMER(e->sc));
     e->sc = NULL;
-    event_deinit(he);
     object_unref(OBJECT(he));
 }
 
@@ -525,7 +569,7 @@ static void hpsc_elapsed_timer_event_cancel(ARMSystemCounterEvent *asc_e)
     HPSCElapsedTimerEvent *he = HPSC_ELAPSED_TIMER_EVENT(asc_e);
     DB_PRINT("%s: slave event cancel\n",
              object_get_canonical_path(OBJECT(asc_e->sc)));
-    event_cancel(he);
+    event_cancel(he, HPSC_ELAPSED_TIMER(asc_e->sc));
 }
 
 static void hpsc_elapsed_reset(DeviceState *dev)
@@ -546,7 +590,7 @@ static void hpsc_elapsed_reset(DeviceState *dev)
      * the we can't schedule it for 0 because then it would trigger immediately,
      * so we could schedule it for max_count, which would be off by one cycle.
      */
-    event_cancel(&s->event);
+    event_cancel(&s->event, s);
 
     /* To external slave events need the re-scaling due to frequency change,
      * but they should be kept running, because the comparators are logically
@@ -573,10 +617,9 @@ static void hpsc_elapsed_realize(DeviceState *dev, Error **errp)
              object_get_canonical_path(OBJECT(s)),
              s->max_tickdiv, s->max_count, s->max_delta);
 
+    s->qtimer = timer_new_ns(QEMU_CLOCK_VIRTUAL, qtimer_cb, s);
     event_init(&s->event, s, handle_event, s);
 
-    QLIST_INIT(&s->slave_events);
-
     for (i = 0; i < ARRAY_SIZE(hpsc_elapsed_regs_info); ++i) {
         DepRegisterInfo *r =
                     &s->regs_info[hpsc_elapsed_regs_info[i].decode.addr / 4];
@@ -614,6 +657,10 @@ static void hpsc_elapsed_timer_init(Object *obj)
     sysbus_init_mmio(sbd, &s->iomem);
 
     sysbus_init_irq(SYS_BUS_DEVICE(s), &s->irq);
+
+    /* Consumers may create events before we are realized. */
+    QLIST_INIT(&s->slave_events);
+    QLIST_INIT(&s->sched_events);
 }
 
 static const VMStateDescription vmstate_hpsc_elapsed = {
@@ -86,7 +86,12 @@ static void schedule_event(HPSCRTITimer *s)
     uint64_t event_time;
     ARMSystemCounterClass *ascc = ARM_SYSTEM_COUNTER_GET_CLASS(s->sys_counter);
 
-    s->start_count = get_count(s);
+    /* A zero interval would expire continuously, leave the timer idle. */
+    if (!s->interval) {
+        ascc->event_cancel(s->sys_counter_event);
+        return;
+    }
+
     event_time = s->start_count + s->interval;
     DB_PRINT("%s: sched event @ count %lx + interval %lx = %lx\n",
             object_get_canonical_path(OBJECT(s)),
@@ -103,6 +108,13 @@ static void sys_counter_event_cb(void *opaque)
     qemu_set_irq(s->irq, 1);
     qemu_set_irq(s->irq, 0);
 
+    /* The next period starts at this event's deadline rather than at
+     * whenever the callback got to run, so periods don't drift. Resync only
+     * if we fell a whole period behind. */
+    uint64_t count = get_count(s);
+    s->start_count += s->interval;
+    if (s->start_count + s->interval <= count)
+        s->start_count = count;
     schedule_event(s);
 }
 
@@ -30,6 +30,7 @@
 #endif
 #ifndef CONFIG_USER_ONLY
 #include "exec/hwaddr.h"
+#include "qemu/thread.h"
 #endif
 #include "exec/memattrs.h"
 
@@ -57,8 +58,10 @@ typedef uint64_t target_ulong;
 #endif
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
-/* use a fully associative victim tlb of 8 entries */
-#define CPU_VTLB_SIZE 8
+/* use a fully associative victim tlb of 16 entries, unless changed
+ * with -accel tcg,vtlb-size=N
+ */
+#define CPU_VTLB_DEFAULT_SIZE 16
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -98,6 +101,27 @@ typedef uint64_t target_ulong;
 
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* With a backend that loads the TLB mask and table from env, each
+ * MMU mode gets its own TLB, resized on flush between these bounds
+ * according to how much of it the guest used (see tlb_mmu_resize).
+ */
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
+
+# if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#  define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+# else
+/* 2^22 entries of 4K pages cover 16G, about what the second level TLB
+ * of a current host core reaches.  Never size past the guest's
+ * address space.
+ */
+#  define CPU_TLB_DYN_MAX_BITS                                  \
+    MIN(22, TARGET_VIRT_ADDR_SPACE_BITS - TARGET_PAGE_BITS)
+# endif
+#endif
+
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
        bit TARGET_PAGE_BITS-1..4  : Nonzero for accesses that should not
@@ -135,17 +159,113 @@ typedef struct CPUIOTLBEntry {
 #define NB_MEM_ATTR 2
 #endif
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* Number of address spaces whose translations each MMU mode keeps
+ * aside while another one is current (see tlb_set_asid_for_mmuidx).
+ */
+#define CPU_TLB_DYN_CONTEXTS 4
+
+/* The TLB of an address space that is not current.  Its tables are
+ * swapped back in, as they are, when the address space becomes current
+ * again; until then only invalidations are applied to it.
+ */
+typedef struct CPUTLBContext {
+    uintptr_t mask;
+    CPUTLBEntry *table;
+    CPUIOTLBEntry *iotlb;
+    CPUTLBEntry *v_table;
+    CPUIOTLBEntry *iotlb_v;
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    size_t n_used_entries;
+    size_t n_evictions;
+    uint32_t asid;
+    /* False if the tables are free for reuse, or not allocated yet.  */
+    bool valid;
+    /* Value of the asid_switches counter when last current, for LRU.  */
+    size_t last_use;
+} CPUTLBContext;
+#endif
+
+/* Per MMU mode bookkeeping.  The counters are only written by the
+ * vCPU owning the TLB and are read by "info tlb-stats".
+ */
+typedef struct CPUTLBDesc {
+    /* Address space tag of the current contents.  */
+    uint32_t asid;
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    CPUTLBContext ctx[CPU_TLB_DYN_CONTEXTS];
+    /* Usage observed since window_begin_ns, used for resizing.  */
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    /* Valid entries in the main table, and fills that replaced a valid
+     * entry, since the last flush.
+     */
+    size_t n_used_entries;
+    size_t n_evictions;
+#endif
+    size_t fills;
+    size_t victim_hits;
+    size_t flushes;
+    size_t page_flushes;
+    size_t resizes;
+    size_t asid_switches;
+    size_t asid_hits;
+} CPUTLBDesc;
+
+/* An invalidation queued for a vCPU by another one, see
+ * tlb_flush_range_by_mmuidx.  A flush by ASID has a zero range.
+ */
+typedef struct CPUTLBPendingFlush {
+    target_ulong start;
+    target_ulong last;
+    uint32_t asid;
+    uint16_t idxmap;
+    bool by_asid;
+} CPUTLBPendingFlush;
+
+#define CPU_TLB_PENDING_FLUSHES 8
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+#define CPU_TLB                                                         \
+    /* tlb_mask[i] contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */    \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];
+#define CPU_IOTLB                                                       \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];
+#else
+#define CPU_TLB                                                         \
+    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];
+#define CPU_IOTLB                                                       \
+    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];
+#endif
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
-    CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
-    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
-    CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+    CPU_TLB                                                             \
+    CPU_IOTLB                                                           \
+    /* Victim tlb, vtlb_size entries per MMU mode. */                   \
+    CPUTLBEntry *tlb_v_table[NB_MMU_MODES];                             \
+    CPUIOTLBEntry *iotlb_v[NB_MMU_MODES];                               \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
     CPUIOTLBEntry memattr[NB_MEM_ATTR];                                 \
     size_t tlb_flush_count;                                             \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;                                        \
     target_ulong vtlb_index;                                            \
+    size_t vtlb_size;                                                   \
+    /* Held while resizing and by tlb_reset_dirty. */                  \
+    QemuSpin tlb_lock;                                                  \
+    /* Invalidations queued by other vCPUs, coalesced until we get to   \
+     * run them; tlb_pending_full are the MMU modes to flush entirely.  \
+     */                                                                 \
+    QemuSpin tlb_pending_lock;                                          \
+    CPUTLBPendingFlush tlb_pending[CPU_TLB_PENDING_FLUSHES];            \
+    unsigned int tlb_n_pending;                                         \
+    uint16_t tlb_pending_full;                                          \
+    bool tlb_pending_queued;                                            \
+    bool tlb_pending_safe_queued;                                       \
+    size_t tlb_pending_merges;                                          \
 
 #else
 
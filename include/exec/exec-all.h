@@ -94,6 +94,18 @@ void cpu_address_space_init(CPUState *cpu, AddressSpace *as, int asidx);
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 /* cputlb.c */
+/**
+ * tlb_init:
+ * @cpu: CPU whose TLB should be initialized
+ *
+ * Allocate the softmmu and victim TLBs of @cpu.
+ */
+void tlb_init(CPUState *cpu);
+/**
+ * tlb_destroy:
+ * @cpu: CPU whose TLB should be freed
+ */
+void tlb_destroy(CPUState *cpu);
 /**
  * tlb_flush_page:
  * @cpu: CPU whose TLB should be flushed
@@ -225,6 +237,83 @@ void tlb_flush_by_mmuidx_all_cpus(CPUState *cpu, uint16_t idxmap);
  * depend on when the guests translation ends the TB.
  */
 void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu, uint16_t idxmap);
+/**
+ * tlb_flush_range_by_mmuidx:
+ * @cpu: CPU whose TLB should be flushed
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Flush the pages of the range from the TLB of the specified CPU, for
+ * the specified MMU indexes.  Large ranges flush the MMU indexes
+ * entirely.  Flushes queued for another vCPU are coalesced until it
+ * gets to run them.
+ */
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap);
+/**
+ * tlb_flush_range_by_mmuidx_all_cpus:
+ * @cpu: Originating CPU of the flush
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Flush the pages of the range from the TLBs of all CPUs, for the
+ * specified MMU indexes.
+ */
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap);
+/**
+ * tlb_flush_range_by_mmuidx_all_cpus_synced:
+ * @cpu: Originating CPU of the flush
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Like tlb_flush_range_by_mmuidx_all_cpus, except the source vCPU's
+ * work is scheduled as safe work, so all flushes are complete once it
+ * is.
+ */
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap);
+/**
+ * tlb_set_asid_for_mmuidx:
+ * @cpu: CPU whose TLB should be switched
+ * @asid: tag of the address space now in use
+ * @idxmap: bitmap of MMU indexes translating in that address space
+ *
+ * Make @asid the address space of the specified MMU indexes.  If it
+ * differs from the previous one, the translations of the latter are
+ * set aside, to be reused if it becomes current again, instead of
+ * being flushed.  The tag is opaque to the TLB: the target code
+ * decides what it stands for (ASID, VMID, ...).  If @cpu is not the
+ * current CPU, the switch is deferred to it as async work, like
+ * tlb_flush().
+ */
+void tlb_set_asid_for_mmuidx(CPUState *cpu, uint32_t asid, uint16_t idxmap);
+/**
+ * tlb_flush_asid_by_mmuidx:
+ * @cpu: CPU whose TLB should be flushed
+ * @asid: tag of the address space to flush
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Flush all entries of the specified MMU indexes that were added while
+ * @asid was their address space, whether it is current or set aside.
+ */
+void tlb_flush_asid_by_mmuidx(CPUState *cpu, uint32_t asid, uint16_t idxmap);
+/**
+ * tlb_flush_asid_by_mmuidx_all_cpus_synced:
+ * @cpu: Originating CPU of the flush
+ * @asid: tag of the address space to flush
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Like tlb_flush_asid_by_mmuidx, on all CPUs, with the source vCPU's
+ * work scheduled as safe work like tlb_flush_by_mmuidx_all_cpus_synced.
+ */
+void tlb_flush_asid_by_mmuidx_all_cpus_synced(CPUState *cpu, uint32_t asid,
+                                              uint16_t idxmap);
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -263,6 +352,12 @@ void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr);
 void probe_write(CPUArchState *env, target_ulong addr, int mmu_idx,
                  uintptr_t retaddr);
 #else
+static inline void tlb_init(CPUState *cpu)
+{
+}
+static inline void tlb_destroy(CPUState *cpu)
+{
+}
 static inline void tlb_flush_page(CPUState *cpu, target_ulong addr)
 {
 }
@@ -307,6 +402,35 @@ static inline void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                        uint16_t idxmap)
 {
 }
+static inline void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                                             target_ulong len, uint16_t idxmap)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu,
+                                                      target_ulong addr,
+                                                      target_ulong len,
+                                                      uint16_t idxmap)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                             target_ulong addr,
+                                                             target_ulong len,
+                                                             uint16_t idxmap)
+{
+}
+static inline void tlb_set_asid_for_mmuidx(CPUState *cpu, uint32_t asid,
+                                           uint16_t idxmap)
+{
+}
+static inline void tlb_flush_asid_by_mmuidx(CPUState *cpu, uint32_t asid,
+                                            uint16_t idxmap)
+{
+}
+static inline void tlb_flush_asid_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                            uint32_t asid,
+                                                            uint16_t idxmap)
+{
+}
 static inline void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr)
 {
 }
@@ -41,6 +41,8 @@ static inline void gen_tb_start(TranslationBlock *tb)
     }
 
     tcg_temp_free_i32(count);
+
+    tcg_gen_etrace_mem_tb_start();
 }
 
 static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
@@ -50,6 +52,7 @@ static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
          * the actual insn count.  */
         tcg_set_insn_param(icount_start_insn_idx, 1, num_insns);
     }
+    tcg_gen_etrace_mem_tb_end();
 
     gen_set_label(tcg_ctx->exitreq_label);
     tcg_gen_exit_tb((uintptr_t)tb + TB_EXIT_REQUESTED);
@@ -1919,6 +1919,23 @@ bool address_space_access_valid(AddressSpace *as, hwaddr addr, int len, bool is_
 void *address_space_map(AddressSpace *as, hwaddr addr,
                         hwaddr *plen, bool is_write);
 
+/* address_space_map_attr: map a RAM backed physical memory region into a
+ * host virtual address
+ *
+ * Like address_space_map() but the translation honours @attrs, and no
+ * bounce buffer is used. Returns %NULL if @addr is not backed by directly
+ * accessible RAM. May map a subset of the requested range, given by and
+ * returned in @plen. Unmap with address_space_unmap().
+ *
+ * @as: #AddressSpace to be accessed
+ * @addr: address within that address space
+ * @plen: pointer to length of buffer; updated on return
+ * @is_write: indicates the transfer direction
+ * @attrs: memory transaction attributes
+ */
+void *address_space_map_attr(AddressSpace *as, hwaddr addr,
+                             hwaddr *plen, bool is_write, MemTxAttrs attrs);
+
 /* address_space_unmap: Unmaps a memory region previously mapped by address_space_map()
  *
  * Will also mark the memory as dirty if @is_write == %true.  @access_len gives
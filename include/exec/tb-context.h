@@ -35,6 +35,10 @@ struct TBContext {
     struct qht htable;
     /* any access to the tbs or the page table must use this lock */
     QemuMutex tb_lock;
+    /* bumped on every write that may hit translated code, so that
+     * translations done without tb_lock can tell if they went stale
+     */
+    unsigned code_write_gen;
 
     /* statistics */
     unsigned tb_flush_count;
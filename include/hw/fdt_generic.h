@@ -14,11 +14,6 @@
 /* This is the number of serial ports we have connected */
 extern int fdt_serial_ports;
 
-typedef struct FDTDevOpaque {
-    char *node_path;
-    void *opaque;
-} FDTDevOpaque;
-
 typedef struct FDTIRQConnection {
     DeviceState *dev;
     const char *name;
@@ -34,10 +29,16 @@ typedef struct FDTMachineInfo {
     void *fdt;
     /* irq descriptors for top level int controller */
     qemu_irq *irq_base;
-    /* per-device specific opaques */
-    FDTDevOpaque *dev_opaques;
+    /* per-device specific opaques, keyed by node path */
+    GHashTable *dev_opaques;
     /* recheck coroutine queue */
     CoQueue *cq;
+    /* number of coroutines waiting in cq */
+    unsigned int nr_waiters;
+    /* resolved binding of each node path, for the plan cache */
+    GHashTable *plan;
+    /* plan holds bindings that were not replayed from the cache */
+    bool plan_dirty;
     /* list of all IRQ connections */
     FDTIRQConnection *irqs;
 } FDTMachineInfo;
@@ -42,6 +42,7 @@ typedef struct {
     uint32_t int_enable; // maps event X to interrupt K
     uint32_t data[HPSC_MBOX_DATA_REGS];
 
+    uint32_t irq_out; // interrupts asserted by this instance, not migrated
 } HPSCMboxInstance;
 
 typedef struct {
@@ -54,6 +55,7 @@ typedef struct {
     MemoryRegion iomem;
 
     qemu_irq arm_irq[HPSC_MBOX_INTS];
+    unsigned irq_count[HPSC_MBOX_INTS]; // instances asserting each interrupt
 
     HPSCMboxInstance mbox[HPSC_MBOX_INSTANCES];
 } HPSCMboxState;
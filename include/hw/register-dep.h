@@ -141,6 +141,10 @@ struct DepRegisterInfo {
     /* private */
     bool read_lite;
     bool write_lite;
+    /* Precomputed from access by dep_register_init and dep_register_reset */
+    bool plain;
+    int log_mask;
+    uint64_t no_w_mask;
 
     MemoryRegion mem;
 };
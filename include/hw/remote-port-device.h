@@ -44,12 +44,36 @@ uint32_t rp_new_id(RemotePort *s);
 void rp_rsp_mutex_lock(RemotePort *s);
 void rp_rsp_mutex_unlock(RemotePort *s);
 void rp_sync_vmclock(RemotePort *s, int64_t lclk, int64_t rclk);
+/* Called after a completed round trip, it counts as a sync point.  */
 void rp_restart_sync_timer(RemotePort *s);
 void rp_leave_iothread(RemotePort *s);
 
 ssize_t rp_write(RemotePort *s, const void *buf, size_t count);
 
-RemotePortDynPkt rp_wait_resp(RemotePort *s);
+/**
+ * rp_expect_resp:
+ * @s: The remote-port adaptor
+ * @id: ID of the request about to be sent
+ * @posted: True if nobody will wait for the response
+ *
+ * Reserves a response slot for request @id. Must be called with the
+ * rsp mutex held and before the request is written to the peer.
+ * Blocks while all slots are in use. Responses to posted requests are
+ * dropped by the adaptor as they arrive.
+ */
+void rp_expect_resp(RemotePort *s, uint32_t id, bool posted);
+
+/**
+ * rp_wait_resp:
+ * @s: The remote-port adaptor
+ * @id: ID of a request previously reserved with rp_expect_resp()
+ *
+ * Waits for the response to request @id and releases its slot. Must be
+ * called with the rsp mutex held. The mutex is dropped while waiting so
+ * that other requests can be issued in the meantime. The returned packet
+ * is only valid until the mutex is released.
+ */
+RemotePortDynPkt rp_wait_resp(RemotePort *s, uint32_t id);
 
 int64_t rp_normalized_vmclk(RemotePort *s);
 
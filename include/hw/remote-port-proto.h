@@ -114,6 +114,7 @@ struct rp_capabilities {
 enum {
     CAP_BUSACCESS_EXT_BASE = 1,    /* New header layout. */
     CAP_BUSACCESS_EXT_BYTE_EN = 2, /* Support for Byte Enables.  */
+    CAP_SHM_RING = 3,              /* Shared memory transport.  */
 };
 
 struct rp_pkt_hello {
@@ -127,6 +128,15 @@ enum {
     RP_BUS_ATTR_EOP        =  (1 << 0),
     RP_BUS_ATTR_SECURE     =  (1 << 1),
     RP_BUS_ATTR_EXT_BASE   =  (1 << 2),
+    /* Status of the access, in responses.  */
+    RP_BUS_RESP_SHIFT      =  8,
+    RP_BUS_RESP_MASK       =  (3 << RP_BUS_RESP_SHIFT),
+};
+
+enum {
+    RP_RESP_OK                  =  0x0,
+    RP_RESP_BUS_GENERIC_ERROR   =  0x1,
+    RP_RESP_ADDR_ERROR          =  0x2,
 };
 
 struct rp_pkt_busaccess {
@@ -231,6 +241,7 @@ struct rp_peer_state {
     struct {
         bool busaccess_ext_base;
         bool busaccess_ext_byte_en;
+        bool shm_ring;
     } caps;
 
     /* Used to normalize our clk.  */
@@ -0,0 +1,239 @@
+/*
+ * QEMU remote port shared memory transport.
+ *
+ * Copyright (c) 2026 Xilinx Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef REMOTE_PORT_SHM_H__
+#define REMOTE_PORT_SHM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * The shared memory transport is an optional replacement for the chardev
+ * stream when both simulators run on the same host.
+ *
+ * The region starts with a struct rp_shm_hdr followed by two single
+ * producer, single consumer byte rings, one per direction. Packets are
+ * laid out in the rings exactly as they would be on the chardev stream,
+ * so the normal rp_encode_* and rp_decode_* functions apply.
+ *
+ * Every ring has a doorbell (an eventfd). Consumers announce that they
+ * are about to block by setting consumer_sleeping and producers only
+ * ring the doorbell when it is set. The other way around, a producer
+ * that finds its ring full sets producer_sleeping and waits on the
+ * ring's space doorbell, which the consumer rings after making room.
+ * While both sides are busy, packets move without any syscalls.
+ *
+ * Setup
+ * The side that owns the region passes five file descriptors along with
+ * its HELLO packet on the chardev (SCM_RIGHTS), in this order:
+ *   [0] the shared memory region,
+ *   [1] the doorbell for RP_SHM_RING_TO_PEER,
+ *   [2] the doorbell for RP_SHM_RING_FROM_PEER,
+ *   [3] the space doorbell for RP_SHM_RING_TO_PEER,
+ *   [4] the space doorbell for RP_SHM_RING_FROM_PEER.
+ * The owner also lists CAP_SHM_RING in its capabilities.
+ *
+ * Once both sides have advertised CAP_SHM_RING in their HELLO, each side
+ * sends an RP_CMD_nop on the chardev and moves its writes to the rings.
+ * Packets that were already on their way over the chardev precede the
+ * NOP, so the receiver keeps reading the chardev until the NOP arrives
+ * and only then switches to the ring. The chardev stays connected, a
+ * hang up on it means the peer is gone.
+ */
+
+#define RP_SHM_MAGIC        0x52505348 /* "RPSH".  */
+#define RP_SHM_VERSION      1
+#define RP_SHM_CACHELINE    64
+
+enum {
+    RP_SHM_RING_TO_PEER     = 0,
+    RP_SHM_RING_FROM_PEER   = 1,
+    RP_SHM_NR_RINGS         = 2,
+};
+
+struct rp_shm_ring {
+    /* Only written by the producer.  */
+    uint32_t head __attribute__ ((aligned(RP_SHM_CACHELINE)));
+    uint32_t producer_sleeping;
+
+    /* Only written by the consumer.  */
+    uint32_t tail __attribute__ ((aligned(RP_SHM_CACHELINE)));
+    uint32_t consumer_sleeping;
+
+    /* Constant after setup. In bytes, always a power of 2.  */
+    uint32_t size __attribute__ ((aligned(RP_SHM_CACHELINE)));
+
+    uint8_t data[] __attribute__ ((aligned(RP_SHM_CACHELINE)));
+};
+
+struct rp_shm_hdr {
+    uint32_t magic;
+    uint32_t version;
+    /* Offsets from the start of the region.  */
+    uint64_t ring_offset[RP_SHM_NR_RINGS];
+};
+
+static inline size_t rp_shm_ring_footprint(uint32_t size)
+{
+    return sizeof(struct rp_shm_ring) + size;
+}
+
+static inline uint32_t rp_shm_ring_used(struct rp_shm_ring *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)
+           - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * rp_shm_ring_push
+ *
+ * Copies up to len bytes into the ring. Returns the number of bytes
+ * actually copied. Must only be called by the producer.
+ */
+static inline size_t rp_shm_ring_push(struct rp_shm_ring *r,
+                                      const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t head = r->head;
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    uint32_t space = r->size - (head - tail);
+    uint32_t offset = head & (r->size - 1);
+    uint32_t chunk;
+
+    if (len > space) {
+        len = space;
+    }
+    chunk = r->size - offset;
+    if (chunk > len) {
+        chunk = len;
+    }
+    memcpy(r->data + offset, p, chunk);
+    memcpy(r->data, p + chunk, len - chunk);
+    __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+/*
+ * rp_shm_ring_pop
+ *
+ * Copies up to len bytes out of the ring. Returns the number of bytes
+ * actually copied. Must only be called by the consumer.
+ */
+static inline size_t rp_shm_ring_pop(struct rp_shm_ring *r,
+                                     void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    uint32_t tail = r->tail;
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t avail = head - tail;
+    uint32_t offset = tail & (r->size - 1);
+    uint32_t chunk;
+
+    if (len > avail) {
+        len = avail;
+    }
+    chunk = r->size - offset;
+    if (chunk > len) {
+        chunk = len;
+    }
+    memcpy(p, r->data + offset, chunk);
+    memcpy(p + chunk, r->data, len - chunk);
+    __atomic_store_n(&r->tail, tail + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+/*
+ * rp_shm_ring_need_doorbell
+ *
+ * Called by the producer after a push. Returns true if the consumer
+ * may be blocked on the doorbell and needs a kick.
+ */
+static inline bool rp_shm_ring_need_doorbell(struct rp_shm_ring *r)
+{
+    /* Pairs with the barrier in rp_shm_ring_prepare_sleep.  */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->consumer_sleeping, __ATOMIC_RELAXED);
+}
+
+/*
+ * rp_shm_ring_prepare_sleep
+ *
+ * Called by the consumer before blocking on the doorbell. Returns false
+ * if data arrived in the meantime, in which case the consumer must not
+ * block.
+ */
+static inline bool rp_shm_ring_prepare_sleep(struct rp_shm_ring *r)
+{
+    __atomic_store_n(&r->consumer_sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (rp_shm_ring_used(r)) {
+        __atomic_store_n(&r->consumer_sleeping, 0, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+static inline void rp_shm_ring_wakeup(struct rp_shm_ring *r)
+{
+    __atomic_store_n(&r->consumer_sleeping, 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * rp_shm_ring_need_space_doorbell
+ *
+ * Called by the consumer after a pop. Returns true if the producer
+ * may be blocked on the space doorbell and needs a kick.
+ */
+static inline bool rp_shm_ring_need_space_doorbell(struct rp_shm_ring *r)
+{
+    /* Pairs with the barrier in rp_shm_ring_prepare_wait_space.  */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->producer_sleeping, __ATOMIC_RELAXED);
+}
+
+/*
+ * rp_shm_ring_prepare_wait_space
+ *
+ * Called by the producer before blocking on the space doorbell. Returns
+ * false if len bytes are free by now, in which case the producer must
+ * not block.
+ */
+static inline bool rp_shm_ring_prepare_wait_space(struct rp_shm_ring *r,
+                                                  uint32_t len)
+{
+    __atomic_store_n(&r->producer_sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (r->size - rp_shm_ring_used(r) >= len) {
+        __atomic_store_n(&r->producer_sleeping, 0, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+static inline void rp_shm_ring_wakeup_space(struct rp_shm_ring *r)
+{
+    __atomic_store_n(&r->producer_sleeping, 0, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -11,7 +11,9 @@
 
 #include <stdbool.h>
 #include "hw/remote-port-proto.h"
+#include "hw/remote-port-shm.h"
 #include "hw/remote-port-device.h"
+#include "qemu/event_notifier.h"
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
 #include "hw/ptimer.h"
@@ -39,6 +41,30 @@ struct RemotePort {
     char *chrdev_id;
     struct rp_peer_state peer;
 
+    /* Optional shared memory transport, see hw/remote-port-shm.h.  */
+    struct {
+        bool enable;
+        uint32_t ring_size;
+        uint32_t poll_us;
+
+        int fd;
+        void *base;
+        size_t size;
+        struct rp_shm_ring *ring[RP_SHM_NR_RINGS];
+        EventNotifier doorbell[RP_SHM_NR_RINGS];
+        EventNotifier space[RP_SHM_NR_RINGS];
+
+        bool offered;
+        /* Writes go to the ring. Protected by write_mutex.  */
+        bool active;
+        /* Reads come from the ring. Only used by the protocol thread.  */
+        bool rx_active;
+        /* The chardev hung up.  */
+        bool hup;
+        /* Serializes writers waiting for ring space.  */
+        QemuMutex space_mutex;
+    } shm;
+
     struct {
         QEMUBH *bh;
         QEMUBH *bh_resp;
@@ -48,6 +74,26 @@ struct RemotePort {
         bool need_sync;
         struct rp_pkt rsp;
         uint64_t quantum;
+
+        /*
+         * Adaptive mode. The quantum doubles, up to quantum_max, while
+         * the peer is idle and drops back to the configured quantum as
+         * soon as traffic or interrupts flow. Completed bus accesses
+         * carry both clocks, a SYNC falling due within a quantum of the
+         * last one (last_exchange) is skipped and counted as piggybacked.
+         * quantum is read from the protocol thread, use atomic accesses.
+         */
+        bool adaptive;
+        uint64_t quantum_max;
+        unsigned int activity;
+        bool irq_seen;
+        int64_t last_exchange;
+
+        struct {
+            uint64_t syncs;
+            uint64_t stall_ns;
+            uint64_t piggybacked;
+        } stats;
     } sync;
 
     QemuMutex rsp_mutex;
@@ -69,10 +115,21 @@ struct RemotePort {
 
     /*
      * rspqueue holds received responses from the remote side.
-     * Only one for the moment but it might grow.
+     * Every outstanding request owns a slot, responses are matched
+     * to slots by ID and may arrive in any order.
      * Used by the master.
      */
-    RemotePortDynPkt rspqueue;
+#define RP_MAX_OUTSTANDING 32
+    struct {
+        struct {
+            RemotePortDynPkt dpkt;
+            uint32_t id;
+            bool used;
+            /* Posted requests have nobody waiting for the response.  */
+            bool posted;
+        } slot[RP_MAX_OUTSTANDING];
+        unsigned int nr_used;
+    } rspqueue;
 
     bool resets[32];
 
@@ -111,4 +168,13 @@ bool rp_time_warp_enable(bool en);
  */
 void rp_device_add(QemuOpts *opts, DeviceState *dev, Error **errp);
 
+/* Shared memory transport internals, used by the adaptor.  */
+void rp_shm_init(RemotePort *s, Error **errp);
+/* Attach the shm fds to the next chardev write. False if not possible.  */
+bool rp_shm_offer(RemotePort *s);
+/* Watch the chardev for hang ups once reads come from the ring.  */
+void rp_shm_watch_hup(RemotePort *s);
+ssize_t rp_shm_write(RemotePort *s, const void *buf, size_t count);
+ssize_t rp_shm_recv(RemotePort *s, void *buf, size_t count);
+
 #endif
@@ -18,4 +18,8 @@
 int save_snapshot(const char *name, Error **errp);
 int load_snapshot(const char *name, Error **errp);
 
+/* Snapshots of a stopped VM kept in memory, without the disk contents.  */
+int save_snapshot_mem(uint8_t **data, size_t *len, Error **errp);
+int load_snapshot_mem(uint8_t *data, size_t len, Error **errp);
+
 #endif
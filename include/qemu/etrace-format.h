@@ -0,0 +1,212 @@
+/*
+ * Execution trace on-disk format.
+ * Copyright (c) 2013 Xilinx Inc.
+ * Written by Edgar E. Iglesias
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ETRACE_FORMAT_H__
+#define __ETRACE_FORMAT_H__
+
+/* Still under development.  */
+#define ETRACE_VERSION_MAJOR 0
+#define ETRACE_VERSION_MINOR 0
+
+enum {
+    TYPE_EXEC = 1,
+    TYPE_TB = 2,
+    TYPE_NOTE = 3,
+    TYPE_MEM = 4,
+    TYPE_ARCH = 5,
+    TYPE_BARRIER = 6,
+    TYPE_OLD_EVENT_U64 = 7,
+    TYPE_EVENT_U64 = 8,
+    TYPE_INFO = 0x4554,
+};
+
+struct etrace_hdr {
+    uint16_t type;
+    uint16_t unit_id;
+    uint32_t len;
+} QEMU_PACKED;
+
+enum etrace_info_flags {
+    ETRACE_INFO_F_TB_CHAINING   = (1 << 0),
+};
+
+struct etrace_info_data {
+    uint64_t attr;
+    struct {
+        uint16_t major;
+        uint16_t minor;
+    } version;
+} QEMU_PACKED;
+
+struct etrace_arch {
+    struct {
+        uint32_t arch_id;
+        uint8_t arch_bits;
+        uint8_t big_endian;
+    } guest, host;
+} QEMU_PACKED;
+
+struct etrace_exec {
+    uint64_t start_time;
+} QEMU_PACKED;
+
+struct etrace_note {
+    uint64_t time;
+} QEMU_PACKED;
+
+struct etrace_mem {
+    uint64_t time;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t value;
+    uint32_t attr;
+    uint8_t size;
+    uint8_t padd[3];
+} QEMU_PACKED;
+
+struct etrace_tb {
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t host_addr;
+    uint32_t guest_code_len;
+    uint32_t host_code_len;
+} QEMU_PACKED;
+
+struct etrace_event_u64 {
+    uint32_t flags;
+    uint16_t unit_id;
+    uint16_t __reserved;
+    uint64_t time;
+    uint64_t val;
+    uint64_t prev_val;
+    uint16_t dev_name_len;
+    uint16_t event_name_len;
+} QEMU_PACKED;
+
+/*
+ * Compressed container, selected with the "compress" etrace flag.
+ *
+ * The file starts with a struct etrace_zfile_hdr followed by blocks.
+ * Every block is a struct etrace_zblock_hdr followed by comp_len bytes
+ * of zlib data which inflate into raw_len bytes of the plain record
+ * stream above. Blocks only hold whole records. A block is cut once it
+ * reaches block_size bytes so a single huge record may make a block
+ * larger than block_size.
+ *
+ * When the trace is closed, an index with one struct etrace_zindex
+ * per block is appended, followed by a struct etrace_zfile_trailer at
+ * the very end of the file. A reader can seek to the trailer, load the
+ * index and only inflate the blocks that overlap the time window and
+ * units it is interested in.
+ *
+ * Times are guest times from the records that carry one (EXEC, NOTE,
+ * MEM and EVENT_U64). Records without a time (TB, ARCH, BARRIER, INFO
+ * and the old events) do not affect the window of their block, so a
+ * time filter may skip the block holding the TB record an EXEC record
+ * in the window refers to. A block with no timed records at all
+ * matches any window. All fields are in host byte order.
+ */
+#define ETRACE_ZFILE_MAGIC      "ETRACEZ"
+#define ETRACE_ZFILE_VERSION    1
+#define ETRACE_ZINDEX_MAGIC     0x495a5445 /* "ETZI".  */
+
+/* Units at or beyond this share the last bit of a block's unit map.  */
+#define ETRACE_ZINDEX_UNITS     256
+
+struct etrace_zfile_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+} QEMU_PACKED;
+
+struct etrace_zblock_hdr {
+    uint32_t raw_len;
+    uint32_t comp_len;
+} QEMU_PACKED;
+
+struct etrace_zindex {
+    /* Offset of the block header from the start of the file.  */
+    uint64_t offset;
+    uint64_t time_min;
+    uint64_t time_max;
+    uint64_t unit_map[(ETRACE_ZINDEX_UNITS + 1 + 63) / 64];
+} QEMU_PACKED;
+
+struct etrace_zfile_trailer {
+    uint64_t index_offset;
+    uint32_t nr_blocks;
+    uint32_t magic;
+} QEMU_PACKED;
+
+static inline void etrace_zindex_set_unit(struct etrace_zindex *ix,
+                                          unsigned int unit_id)
+{
+    unsigned int bit = unit_id < ETRACE_ZINDEX_UNITS ? unit_id
+                                                     : ETRACE_ZINDEX_UNITS;
+
+    ix->unit_map[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static inline bool etrace_zindex_has_unit(const struct etrace_zindex *ix,
+                                          unsigned int unit_id)
+{
+    unsigned int bit = unit_id < ETRACE_ZINDEX_UNITS ? unit_id
+                                                     : ETRACE_ZINDEX_UNITS;
+
+    return ix->unit_map[bit / 64] & (1ULL << (bit % 64));
+}
+
+/*
+ * Extract the guest time of a record. payload points to the len bytes
+ * following the header. Returns false for records without a time.
+ */
+static inline bool etrace_record_time(const struct etrace_hdr *hdr,
+                                      const void *payload, uint64_t *time)
+{
+    const struct etrace_event_u64 *ev = payload;
+
+    switch (hdr->type) {
+    case TYPE_EXEC:
+        if (hdr->len < sizeof(struct etrace_exec)) {
+            return false;
+        }
+        *time = ((const struct etrace_exec *) payload)->start_time;
+        return true;
+    case TYPE_NOTE:
+        if (hdr->len < sizeof(struct etrace_note)) {
+            return false;
+        }
+        *time = ((const struct etrace_note *) payload)->time;
+        return true;
+    case TYPE_MEM:
+        if (hdr->len < sizeof(struct etrace_mem)) {
+            return false;
+        }
+        *time = ((const struct etrace_mem *) payload)->time;
+        return true;
+    case TYPE_EVENT_U64:
+        if (hdr->len < sizeof *ev) {
+            return false;
+        }
+        *time = ev->time;
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
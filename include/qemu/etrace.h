@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "qemu/thread.h"
 
 struct etrace_entry32 {
     uint32_t duration;
@@ -39,6 +40,15 @@ enum qemu_etrace_flag {
     ETRACE_F_MEM         = (1 << 2),
     ETRACE_F_CPU         = (1 << 3),
     ETRACE_F_GPIO         = (1 << 4),
+    /* Drop records instead of stalling when a unit's ring is full.  */
+    ETRACE_F_DROP        = (1 << 5),
+    /* Write the compressed, indexed container (see etrace-format.h).  */
+    ETRACE_F_COMPRESS    = (1 << 6),
+    /* Record guest loads/stores inline from the generated code.  */
+    ETRACE_F_MEM_LD      = (1 << 7),
+    ETRACE_F_MEM_ST      = (1 << 8),
+    ETRACE_F_ALL         = ETRACE_F_EXEC | ETRACE_F_TRANSLATION | ETRACE_F_MEM
+                           | ETRACE_F_CPU | ETRACE_F_GPIO,
 };
 
 enum qemu_etrace_event_u64_flag {
@@ -46,6 +56,26 @@ enum qemu_etrace_event_u64_flag {
     ETRACE_EVU64_F_PREV_VAL    = (1 << 0),
 };
 
+/*
+ * Inline memory access records. TCG generated code stores one of these
+ * per guest load/store into the vCPU's CPUState::etrace_mem ring and
+ * etrace_mem_flush() turns them into TYPE_MEM records. The ring is
+ * indexed by free running counters masked with ETRACE_MEM_RING_SIZE - 1
+ * so generated code never needs to branch.
+ */
+#define ETRACE_MEM_RING_SIZE (64 * 1024)
+#define ETRACE_MEM_REC_SHIFT 5
+
+struct etrace_mem_rec {
+    uint64_t vaddr;
+    uint64_t value;
+    /* Access size in bytes, ORed with ETRACE_MEM_REC_F_STORE.  */
+    uint32_t info;
+    uint32_t pad[3];
+};
+
+#define ETRACE_MEM_REC_F_STORE (1 << 8)
+
 enum etrace_mem_attr {
     MEM_READ    = (0 << 0),
     MEM_WRITE   = (1 << 0),
@@ -60,19 +90,29 @@ struct etracer {
     /* FIXME: Removeme.  */
     unsigned int current_unit_id;
 
-#define EXEC_CACHE_SIZE (16 * 1024)
-    uint64_t exec_start;
-    bool exec_start_valid;
-    int64_t exec_start_time;
-    struct {
-        union {
-            struct etrace_entry64 t64[EXEC_CACHE_SIZE];
-            struct etrace_entry32 t32[2 * EXEC_CACHE_SIZE];
-        };
-        uint64_t start_time;
-        unsigned int pos;
-        unsigned int unit_id;
-    } exec_cache;
+    /*
+     * Records are produced into per unit rings, indexed by unit_id, and
+     * drained into fp by a writer thread. Unit ids beyond
+     * ETRACE_MAX_UNITS share the last ring. Rings are allocated on
+     * first use.
+     */
+#define ETRACE_MAX_UNITS 256
+    struct etrace_unit *units[ETRACE_MAX_UNITS + 1];
+    /* Orders records across units, see etrace_rec_end.  */
+    uint64_t seq;
+
+    QemuThread writer;
+    QemuSemaphore writer_sem;
+    bool writer_running;
+    bool writer_quit;
+    bool writer_kicked;
+
+    /* Address window for inline memory access records, inclusive.  */
+    uint64_t mem_range_start;
+    uint64_t mem_range_end;
+
+    /* Compressed container state, only used by the writer.  */
+    struct etrace_zstate *z;
 };
 
 bool etrace_init(struct etracer *t, const char *filename,
@@ -92,10 +132,15 @@ void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end);
 
+bool etrace_exec_started(struct etracer *t, unsigned int unit_id);
+
 void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val);
 
+void etrace_mem_cpu_init(struct etracer *t, CPUState *cpu);
+void etrace_mem_flush(struct etracer *t, CPUState *cpu);
+
 void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
                     uint64_t guest_vaddr, uint64_t guest_paddr,
                     size_t guest_len,
@@ -318,6 +318,8 @@ struct qemu_work_item;
  * @trace_dstate_delayed: Delayed changes to trace_dstate (includes all changes
  *                        to @trace_dstate).
  * @trace_dstate: Dynamic tracing state of events for this vCPU (bitmask).
+ * @etrace_mem: Ring of inline etrace memory access records, filled by
+ *              generated code and drained by etrace_mem_flush().
  * @ignore_memory_transaction_failures: Cached copy of the MachineState
  *    flag of the same name: allows the board to suppress calling of the
  *    CPU do_transaction_failed hook function.
@@ -419,6 +421,12 @@ struct CPUState {
         icount_decr_u16 u16;
     } icount_decr;
 
+    struct {
+        uint8_t *buf;
+        uint32_t head;
+        uint32_t tail;
+    } etrace_mem;
+
     struct hax_vcpu_state *hax_vcpu;
 
     /* The pending_tlb_flush flag is set and cleared atomically to
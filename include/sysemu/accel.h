@@ -64,6 +64,9 @@ typedef struct AccelClass {
     OBJECT_GET_CLASS(AccelClass, (obj), TYPE_ACCEL)
 
 extern unsigned long tcg_tb_size;
+/* Victim TLB entries per MMU mode, 0 selects the default.  */
+extern unsigned int tcg_vtlb_size;
+#define TCG_VTLB_MAX_SIZE 256
 
 void configure_accelerator(MachineState *ms);
 /* Register accelerator specific global properties */
@@ -156,6 +156,19 @@ static inline void *dma_memory_map(AddressSpace *as,
     return p;
 }
 
+static inline void *dma_memory_map_attr(AddressSpace *as,
+                                        dma_addr_t addr, dma_addr_t *len,
+                                        DMADirection dir, MemTxAttrs attr)
+{
+    hwaddr xlen = *len;
+    void *p;
+
+    p = address_space_map_attr(as, addr, &xlen,
+                               dir == DMA_DIRECTION_FROM_DEVICE, attr);
+    *len = xlen;
+    return p;
+}
+
 static inline void dma_memory_unmap(AddressSpace *as,
                                     void *buffer, dma_addr_t len,
                                     DMADirection dir, dma_addr_t access_len)
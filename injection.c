@@ -19,12 +19,12 @@
 #include "exec/memory.h"
 #include "qom/cpu.h"
 #include "qemu/log.h"
-#include "qemu/queue.h"
+#include "qemu/bswap.h"
 #include "sysemu/sysemu.h"
+#include "migration/snapshot.h"
 #include "exec/exec-all.h"
 
 typedef struct FaultEventEntry FaultEventEntry;
-static QLIST_HEAD(, FaultEventEntry) events = QLIST_HEAD_INITIALIZER(events);
 static QEMUTimer *timer;
 
 #ifndef DEBUG_FAULT_INJECTION
@@ -117,68 +117,323 @@ ReadValue *qmp_read_mem(int64_t addr, int64_t size, bool has_cpu, int64_t cpu,
 
 struct FaultEventEntry {
     uint64_t time_ns;
+    /* Keeps faults scheduled for the same time in order.  */
+    uint64_t seq;
+    FaultType type;
     int64_t val;
-    QLIST_ENTRY(FaultEventEntry) node;
+    /* write-mem faults only.  */
+    int64_t addr;
+    int64_t size;
+    int cpu;
 };
 
-static void mod_next_event_timer(void)
+/* Scheduled faults, a binary min-heap ordered by time_ns then seq.  */
+static struct {
+    FaultEventEntry *e;
+    size_t n;
+    size_t alloc;
+    uint64_t seq;
+} events;
+
+static bool fault_before(const FaultEventEntry *a, const FaultEventEntry *b)
 {
-    uint64_t val;
-    FaultEventEntry *entry;
+    return a->time_ns < b->time_ns
+           || (a->time_ns == b->time_ns && a->seq < b->seq);
+}
 
-    if (QLIST_EMPTY(&events)) {
-        return;
-    } else {
-        val = QLIST_FIRST(&events)->time_ns;
+static void fault_heap_swap(size_t i, size_t j)
+{
+    FaultEventEntry tmp = events.e[i];
+
+    events.e[i] = events.e[j];
+    events.e[j] = tmp;
+}
+
+static void fault_heap_push(FaultEventEntry *entry)
+{
+    size_t i = events.n++;
+
+    if (events.n > events.alloc) {
+        events.alloc = MAX(64, events.alloc * 2);
+        events.e = g_renew(FaultEventEntry, events.e, events.alloc);
+    }
+
+    entry->seq = events.seq++;
+    events.e[i] = *entry;
+    while (i && fault_before(&events.e[i], &events.e[(i - 1) / 2])) {
+        fault_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
     }
+}
+
+static void fault_heap_pop(FaultEventEntry *entry)
+{
+    size_t i = 0;
+
+    *entry = events.e[0];
+    events.e[0] = events.e[--events.n];
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, min = i;
 
-    QLIST_FOREACH(entry, &events, node) {
-        if (val > entry->time_ns) {
-            val = entry->time_ns;
+        if (l < events.n && fault_before(&events.e[l], &events.e[min])) {
+            min = l;
+        }
+        if (r < events.n && fault_before(&events.e[r], &events.e[min])) {
+            min = r;
         }
+        if (min == i) {
+            break;
+        }
+        fault_heap_swap(i, min);
+        i = min;
     }
+}
 
-    timer_mod(timer, val);
+static void mod_next_event_timer(void)
+{
+    if (events.n) {
+        timer_mod(timer, events.e[0].time_ns);
+    }
 }
 
 static void do_fault(void *opaque)
 {
-    FaultEventEntry *entry;
-    FaultEventEntry *next;
+    FaultEventEntry entry;
     uint64_t current_time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    bool stop = false;
+
+    while (events.n && events.e[0].time_ns <= current_time) {
+        fault_heap_pop(&entry);
 
-    QLIST_FOREACH_SAFE(entry, &events, node, next) {
-        if (entry->time_ns < current_time) {
-            DPRINTF("fault %"PRId64" happened @%"PRId64"!\n", entry->val,
-                    qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
-            qapi_event_send_fault_event(entry->val, current_time, &error_abort);
-            QLIST_REMOVE(entry, node);
-            g_free(entry);
-            vm_stop_from_timer(RUN_STATE_DEBUG);
+        switch (entry.type) {
+        case FAULT_TYPE_EVENT:
+            DPRINTF("fault %"PRId64" happened @%"PRId64"!\n", entry.val,
+                    current_time);
+            qapi_event_send_fault_event(entry.val, current_time, &error_abort);
+            stop = true;
+            break;
+        case FAULT_TYPE_WRITE_MEM:
+            DPRINTF("write memory addr=0x%" PRIx64 " val=0x%" PRIx64
+                    " @%"PRId64"\n", entry.addr, entry.val, current_time);
+            if (address_space_write(cpu_get_address_space(
+                                        qemu_get_cpu(entry.cpu), 0),
+                                    entry.addr, MEMTXATTRS_UNSPECIFIED,
+                                    (uint8_t *)&entry.val, entry.size)) {
+                DPRINTF("write memory failed.\n");
+            }
+            break;
+        default:
+            g_assert_not_reached();
         }
     }
 
+    if (stop) {
+        vm_stop_from_timer(RUN_STATE_DEBUG);
+    }
     mod_next_event_timer();
 }
 
+static void fault_schedule(FaultEventEntry *entry)
+{
+    entry->time_ns += qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    fault_heap_push(entry);
+
+    if (!timer) {
+        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
+    }
+}
+
 void qmp_trigger_event(int64_t time_ns, int64_t event_id, Error **errp)
 {
-    FaultEventEntry *entry;
+    FaultEventEntry entry = {
+        .type = FAULT_TYPE_EVENT,
+        .time_ns = time_ns,
+        .val = event_id,
+    };
 
     DPRINTF("trigger_event(%"PRId64", %"PRId64")\n", time_ns, event_id);
 
-    entry = g_new0(FaultEventEntry, 1);
-    entry->time_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + time_ns;
-    entry->val = event_id;
-    QLIST_INSERT_HEAD(&events, entry, node);
+    fault_schedule(&entry);
+    mod_next_event_timer();
+}
 
-    if (!timer) {
-        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
+static bool fault_check(FaultEventEntry *entry, Error **errp)
+{
+    switch (entry->type) {
+    case FAULT_TYPE_EVENT:
+        return true;
+    case FAULT_TYPE_WRITE_MEM:
+        if (entry->size <= 0 || entry->size > sizeof(entry->val)) {
+            error_setg(errp, "Invalid write size %" PRId64, entry->size);
+            return false;
+        }
+        if (!qemu_get_cpu(entry->cpu)) {
+            error_set(errp, ERROR_CLASS_DEVICE_NOT_FOUND,
+                      "CPU %d doesn't exist", entry->cpu);
+            return false;
+        }
+        return true;
+    default:
+        error_setg(errp, "Invalid fault type %d", entry->type);
+        return false;
+    }
+}
+
+#define FAULT_FILE_MAGIC    "QFLT"
+#define FAULT_FILE_VERSION  1
+#define FAULT_FILE_HDR_LEN  12
+#define FAULT_FILE_REC_LEN  40
+
+static void fault_file_record(const gchar *buf, uint32_t i,
+                              FaultEventEntry *entry)
+{
+    const gchar *p = buf + FAULT_FILE_HDR_LEN + i * FAULT_FILE_REC_LEN;
+
+    *entry = (FaultEventEntry) {
+        .time_ns = ldq_le_p(p),
+        .type = ldl_le_p(p + 8),
+        .size = ldl_le_p(p + 12),
+        .addr = ldq_le_p(p + 16),
+        .val = ldq_le_p(p + 24),
+        .cpu = ldl_le_p(p + 32),
+    };
+    if (entry->type == FAULT_TYPE_EVENT) {
+        entry->val = entry->addr;
+    }
+}
+
+static void fault_schedule_file(const char *path, Error **errp)
+{
+    FaultEventEntry entry;
+    GError *gerr = NULL;
+    gchar *buf;
+    gsize len;
+    uint32_t i, count;
+
+    if (!g_file_get_contents(path, &buf, &len, &gerr)) {
+        error_setg(errp, "%s", gerr->message);
+        g_error_free(gerr);
+        return;
+    }
+
+    if (len < FAULT_FILE_HDR_LEN || memcmp(buf, FAULT_FILE_MAGIC, 4)
+        || ldl_le_p(buf + 4) != FAULT_FILE_VERSION) {
+        error_setg(errp, "'%s' is not a fault campaign file", path);
+        goto out;
+    }
+    count = ldl_le_p(buf + 8);
+    if ((len - FAULT_FILE_HDR_LEN) / FAULT_FILE_REC_LEN < count) {
+        error_setg(errp, "'%s' is truncated", path);
+        goto out;
+    }
+
+    /* Validate everything first, the campaign is scheduled as a whole.  */
+    for (i = 0; i < count; i++) {
+        fault_file_record(buf, i, &entry);
+        if (!fault_check(&entry, errp)) {
+            error_prepend(errp, "'%s' record %u: ", path, i);
+            goto out;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        fault_file_record(buf, i, &entry);
+        fault_schedule(&entry);
+    }
+
+out:
+    g_free(buf);
+}
+
+void qmp_schedule_faults(bool has_faults, FaultSpecList *faults,
+                         bool has_file, const char *file, Error **errp)
+{
+    FaultSpecList *l;
+    Error *local_err = NULL;
+
+    for (l = has_faults ? faults : NULL; l; l = l->next) {
+        FaultSpec *f = l->value;
+        FaultEventEntry entry = {
+            .type = f->type,
+            .size = f->has_size ? f->size : 4,
+            .cpu = f->has_cpu ? f->cpu : 0,
+        };
+
+        if (f->type == FAULT_TYPE_EVENT && !f->has_event_id) {
+            error_setg(errp, "event faults need an event_id");
+            return;
+        }
+        if (f->type == FAULT_TYPE_WRITE_MEM && (!f->has_addr || !f->has_val)) {
+            error_setg(errp, "write-mem faults need an addr and a val");
+            return;
+        }
+        if (!fault_check(&entry, errp)) {
+            return;
+        }
+    }
+
+    if (has_file) {
+        fault_schedule_file(file, &local_err);
+        if (local_err) {
+            error_propagate(errp, local_err);
+            return;
+        }
+    }
+
+    for (l = has_faults ? faults : NULL; l; l = l->next) {
+        FaultSpec *f = l->value;
+        FaultEventEntry entry = {
+            .type = f->type,
+            .time_ns = f->time_ns,
+            .val = f->type == FAULT_TYPE_EVENT ? f->event_id : f->val,
+            .addr = f->addr,
+            .size = f->has_size ? f->size : 4,
+            .cpu = f->has_cpu ? f->cpu : 0,
+        };
+
+        fault_schedule(&entry);
     }
 
+    DPRINTF("%zu faults scheduled\n", events.n);
     mod_next_event_timer();
 }
 
+/* The VM state at the injection point, see fault_checkpoint.  */
+static struct {
+    uint8_t *data;
+    size_t len;
+} checkpoint;
+
+void qmp_fault_checkpoint(Error **errp)
+{
+    uint8_t *data;
+    size_t len;
+
+    if (save_snapshot_mem(&data, &len, errp) < 0) {
+        return;
+    }
+
+    g_free(checkpoint.data);
+    checkpoint.data = data;
+    checkpoint.len = len;
+    DPRINTF("checkpoint of %zu bytes taken\n", len);
+}
+
+void qmp_fault_restore(Error **errp)
+{
+    if (!checkpoint.data) {
+        error_setg(errp, "No checkpoint has been taken");
+        return;
+    }
+
+    /* Faults scheduled for the previous variant don't apply anymore.  */
+    events.n = 0;
+    if (timer) {
+        timer_del(timer);
+    }
+
+    load_snapshot_mem(checkpoint.data, checkpoint.len, errp);
+}
+
 void qmp_inject_gpio(const char *device_name, bool has_gpio, const char *gpio,
                      int64_t num, int64_t val, Error **errp)
 {
@@ -2257,6 +2257,83 @@ int save_snapshot(const char *name, Error **errp)
     return ret;
 }
 
+int save_snapshot_mem(uint8_t **data, size_t *len, Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    if (runstate_is_running()) {
+        error_setg(errp, "The VM must be stopped");
+        return -EINVAL;
+    }
+
+    ret = global_state_store();
+    if (ret) {
+        error_setg(errp, "Error saving global state");
+        return ret;
+    }
+
+    bdrv_drain_all_begin();
+
+    bioc = qio_channel_buffer_new(4096);
+    f = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = qemu_savevm_state(f, errp);
+    qemu_fflush(f);
+    if (ret == 0) {
+        /* Take the data before closing the file frees it.  */
+        *data = bioc->data;
+        *len = bioc->usage;
+        bioc->data = NULL;
+        bioc->capacity = bioc->usage = bioc->offset = 0;
+    }
+    qemu_fclose(f);
+
+    bdrv_drain_all_end();
+    return ret;
+}
+
+int load_snapshot_mem(uint8_t *data, size_t len, Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    if (runstate_is_running()) {
+        error_setg(errp, "The VM must be stopped");
+        return -EINVAL;
+    }
+
+    /* Flush all IO requests so they don't interfere with the new state.  */
+    bdrv_drain_all_begin();
+
+    bioc = qio_channel_buffer_new(0);
+    bioc->data = data;
+    bioc->capacity = bioc->usage = len;
+    f = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+
+    qemu_system_reset(SHUTDOWN_CAUSE_NONE);
+    mis->from_src_file = f;
+
+    ret = qemu_loadvm_state(f);
+
+    /* The data belongs to the caller, don't let closing the file free it.  */
+    bioc->data = NULL;
+    bioc->capacity = bioc->usage = bioc->offset = 0;
+    migration_incoming_state_destroy();
+    object_unref(OBJECT(bioc));
+
+    bdrv_drain_all_end();
+
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading VM state", ret);
+    }
+    return ret;
+}
+
 void qmp_xen_save_devices_state(const char *filename, bool has_live, bool live,
                                 Error **errp)
 {
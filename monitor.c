@@ -1128,6 +1128,16 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info((FILE *)mon, monitor_fprintf);
 }
+
+static void hmp_info_tlb_stats(Monitor *mon, const QDict *qdict)
+{
+    if (!tcg_enabled()) {
+        error_report("TLB statistics are only available with accel=tcg");
+        return;
+    }
+
+    dump_tlb_stats((FILE *)mon, monitor_fprintf);
+}
 #endif
 
 static void hmp_info_history(Monitor *mon, const QDict *qdict)
@@ -43,7 +43,8 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                suppress-vmdesc=on|off disables self-describing migration (default=off)\n"
     "                nvdimm=on|off controls NVDIMM support (default=off)\n"
     "                enforce-config-section=on|off enforce configuration section migration (default=off)\n"
-    "                s390-squash-mcss=on|off controls support for squashing into default css (default=off)\n",
+    "                s390-squash-mcss=on|off controls support for squashing into default css (default=off)\n"
+    "                fdt-plan-cache=dir caches the device tree instantiation plan in dir\n",
     QEMU_ARCH_ALL)
 STEXI
 @item -machine [type=]@var{name}[,prop=@var{value}[,...]]
@@ -98,6 +99,11 @@ Enables or disables NVDIMM support. The default is off.
 @item s390-squash-mcss=on|off
 Enables or disables squashing subchannels into the default css.
 The default is off.
+@item fdt-plan-cache=@var{dir}
+Save the instantiation order and the resolved device bindings of device tree
+based machines (e.g. arm-generic-fdt) into @var{dir}. The cache is keyed by
+the hardware DTB and the QEMU binary, later boots with the same DTB replay it
+instead of walking and resolving the device tree again.
 @item enforce-config-section=on|off
 If @option{enforce-config-section} is set to @var{on}, force migration
 code to send configuration section even if the machine-type sets the
@@ -119,9 +125,10 @@ Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
 DEF("accel", HAS_ARG, QEMU_OPTION_accel,
-    "-accel [accel=]accelerator[,thread=single|multi]\n"
+    "-accel [accel=]accelerator[,thread=single|multi][,vtlb-size=n]\n"
     "                select accelerator (kvm, xen, hax or tcg; use 'help' for a list)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                vtlb-size=n (victim TLB entries per MMU mode, default 16)\n", QEMU_ARCH_ALL)
 STEXI
 @item -accel @var{name}[,prop=@var{value}[,...]]
 @findex -accel
@@ -135,6 +142,9 @@ Controls number of TCG threads. When the TCG is multi-threaded there will be one
 thread per vCPU therefor taking advantage of additional host cores. The default
 is to enable multi-threading where both the back-end and front-ends support it and
 no incompatible TCG features have been enabled (e.g. icount/replay).
+@item vtlb-size=@var{n}
+Sets the number of entries of the fully associative victim TLB that backs
+the softmmu TLB of each MMU mode, between 1 and 256. The default is 16.
 @end table
 ETEXI
 
@@ -384,7 +394,7 @@ Dump an execution trace to @var{path}.
 ETEXI
 
 DEF("etrace-flags", HAS_ARG, QEMU_OPTION_etrace_flags,
-    "-etrace-flags FLAGS  Execution trace flags\n\texec,translation,mem,cpu\n", QEMU_ARCH_ALL)
+    "-etrace-flags FLAGS  Execution trace flags\n\texec,translation,mem,cpu,gpio,drop,compress,\n\tmem-ld,mem-st,mem-range=START-END,all\n", QEMU_ARCH_ALL)
 STEXI
 @item -etrace-flags
 @findex -etrace-flags
@@ -395,6 +405,24 @@ exec          Trace instruction execution.
 translation   Trace TB translation with TB contents. (for off-line disassembly)
 mem           Trace memory accesses (Only MMIO at the moment).
 cpu           Trace CPU register state (slow, currently not binary).
+gpio          Trace GPIO activity.
+drop          Drop records instead of stalling a vCPU when its trace
+              buffer is full. The number of dropped records is reported
+              on exit.
+compress      Write a compressed container with a time and unit index
+              instead of the plain record stream. Use
+              contrib/etrace-reader to extract time windows from it.
+mem-ld        Record every guest load from the generated code, including
+              TLB hits. Records are batched per vCPU and carry the time
+              of the batch. The physical address is not known there and
+              is recorded as 0. Each traced access adds about 20 TCG ops
+              to the generated code.
+mem-st        Same as mem-ld for guest stores.
+mem-range=START-END
+              Only record inline accesses to virtual addresses within
+              START to END, inclusive.
+all           exec, translation, mem, cpu and gpio. drop, compress,
+              mem-ld and mem-st have to be given explicitly.
 @end example
 ETEXI
 
@@ -101,6 +101,60 @@ class FaultInjectionFramework(qmp.QEMUMonitorProtocol):
                                 'time_ns': time_ns}}
         self.send(qmpcmd)
 
+    def schedule(self, faults, path = None):
+        # Schedule a whole campaign, see schedule_faults in the QMP schema
+        self.time_print('Schedule %s faults' % len(faults))
+        arguments = {'faults': faults}
+        if path is not None:
+            arguments['file'] = path
+        qmpcmd = {'execute': 'schedule_faults',
+                  'arguments': arguments}
+        self.send(qmpcmd)
+
+    def checkpoint(self):
+        # Snapshot the stopped VM in memory, at the injection point
+        self.time_print('Checkpoint')
+        self.send({'execute': 'fault_checkpoint', 'arguments': {}})
+
+    def restore(self):
+        # Go back to the checkpoint
+        self.time_print('Restore')
+        self.send({'execute': 'fault_restore', 'arguments': {}})
+
+    def campaign(self, variants, duration_ns, end_id = -1):
+        # Run each list of faults in variants from the checkpoint, for
+        # duration_ns each. Returns, per variant, the list of
+        # (event_id, time_ns) fault events seen before the end. Guest
+        # shutdowns and resets end a variant early, run QEMU with
+        # -no-shutdown so that it survives them.
+        results = []
+        self.checkpoint()
+        for faults in variants:
+            self.restore()
+            self.schedule(faults + [{'type': 'event',
+                                     'time_ns': duration_ns,
+                                     'event_id': end_id}])
+            seen = []
+            self.cont()
+            done = False
+            while not done:
+                for ev in self.get_events(True):
+                    if ev['event'] == 'FAULT_EVENT':
+                        data = ev['data']
+                        self.qemu_time = data['time_ns']
+                        if data['event_id'] == end_id:
+                            done = True
+                        else:
+                            seen.append((data['event_id'], data['time_ns']))
+                            self.cont()
+                    elif ev['event'] in ('SHUTDOWN', 'RESET'):
+                        seen.append((ev['event'], self.qemu_time))
+                        self.send({'execute': 'stop', 'arguments': {}})
+                        done = True
+                self.clear_events()
+            results.append(seen)
+        return results
+
     def write(self, address, value, size, cpu):
         # write a value
         self.time_print('write: 0x%08x @0x%08x size %s from cpu %s' \
@@ -176,6 +230,17 @@ class FaultInjectionFramework(qmp.QEMUMonitorProtocol):
         print " * Start the simulation when the notify are set.\n"
         print "notify(time_ns, cb)"
         print " * Notify the callback cb in guest time time_ns.\n"
+        print "schedule(faults, path)"
+        print " * Schedule a list of faults, and the ones in the binary file"
+        print " * @path if given, in one go.\n"
+        print "checkpoint()"
+        print " * Snapshot the stopped VM in memory.\n"
+        print "restore()"
+        print " * Restore the VM to the checkpoint.\n"
+        print "campaign(variants, duration_ns)"
+        print " * Checkpoint, then run each list of faults in @variants from"
+        print " * the checkpoint for @duration_ns. Returns the fault events seen"
+        print " * by each variant.\n"
         print "write(address, value, size, cpu)"
         print " * Write @value of size @size at @address from @cpu."
         print " * @cpu can be either a qom path or the cpu id.\n"
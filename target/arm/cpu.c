@@ -377,6 +377,7 @@ static void arm_cpu_reset(CPUState *s)
 
     hw_breakpoint_update_all(cpu);
     hw_watchpoint_update_all(cpu);
+    arm_update_tlb_asid(env);
 
 #ifndef CONFIG_USER_ONLY
     if (cpu->env.memattr_ns) {
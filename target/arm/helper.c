@@ -631,17 +631,12 @@ static void fcse_write(CPUARMState *env, const ARMCPRegInfo *ri, uint64_t value)
 static void contextidr_write(CPUARMState *env, const ARMCPRegInfo *ri,
                              uint64_t value)
 {
-    ARMCPU *cpu = arm_env_get_cpu(env);
-
-    if (raw_read(env, ri) != value && !arm_feature(env, ARM_FEATURE_PMSA)
-        && !extended_addresses_enabled(env)) {
-        /* For VMSA (when not using the LPAE long descriptor page table
-         * format) this register includes the ASID, so do a TLB flush.
-         * For PMSA it is purely a process ID and no action is needed.
-         */
-        tlb_flush(CPU(cpu));
-    }
+    /* For VMSA (when not using the LPAE long descriptor page table
+     * format) this register includes the ASID, so switch the TLB to it.
+     * For PMSA it is purely a process ID and no action is needed.
+     */
     raw_write(env, ri, value);
+    arm_update_tlb_asid(env);
 }
 
 static void tlbiall_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -666,9 +661,19 @@ static void tlbiasid_write(CPUARMState *env, const ARMCPRegInfo *ri,
                            uint64_t value)
 {
     /* Invalidate by ASID (TLBIASID) */
-    ARMCPU *cpu = arm_env_get_cpu(env);
+    CPUState *cs = ENV_GET_CPU(env);
+    uint32_t asid = arm_tlb_asid(env, extract64(value, 0, 8));
 
-    tlb_flush(CPU(cpu));
+    if (arm_is_secure(env)) {
+        tlb_flush_asid_by_mmuidx(cs, asid,
+                                 ARMMMUIdxBit_S1SE1 |
+                                 ARMMMUIdxBit_S1SE0 |
+                                 ARMMMUIdxBit_S1E3);
+    } else {
+        tlb_flush_asid_by_mmuidx(cs, asid,
+                                 ARMMMUIdxBit_S12NSE1 |
+                                 ARMMMUIdxBit_S12NSE0);
+    }
 }
 
 static void tlbimvaa_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -693,8 +698,18 @@ static void tlbiasid_is_write(CPUARMState *env, const ARMCPRegInfo *ri,
                              uint64_t value)
 {
     CPUState *cs = ENV_GET_CPU(env);
+    uint32_t asid = arm_tlb_asid(env, extract64(value, 0, 8));
 
-    tlb_flush_all_cpus_synced(cs);
+    if (arm_is_secure(env)) {
+        tlb_flush_asid_by_mmuidx_all_cpus_synced(cs, asid,
+                                                 ARMMMUIdxBit_S1SE1 |
+                                                 ARMMMUIdxBit_S1SE0 |
+                                                 ARMMMUIdxBit_S1E3);
+    } else {
+        tlb_flush_asid_by_mmuidx_all_cpus_synced(cs, asid,
+                                                 ARMMMUIdxBit_S12NSE1 |
+                                                 ARMMMUIdxBit_S12NSE0);
+    }
 }
 
 static void tlbimva_is_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -3151,14 +3166,18 @@ static void vmsa_ttbcr_write(CPUARMState *env, const ARMCPRegInfo *ri,
                              uint64_t value)
 {
     ARMCPU *cpu = arm_env_get_cpu(env);
+    TCR *tcr = raw_ptr(env, ri);
 
-    if (arm_feature(env, ARM_FEATURE_LPAE)) {
-        /* With LPAE the TTBCR could result in a change of ASID
-         * via the TTBCR.A1 bit, so do a TLB flush.
-         */
+    if (arm_feature(env, ARM_FEATURE_LPAE)
+        && ((tcr->raw_tcr ^ value) & TTBCR_EAE)) {
+        /* Entries of one descriptor format are no use with the other */
         tlb_flush(CPU(cpu));
     }
     vmsa_ttbcr_raw_write(env, ri, value);
+    /* With LPAE the TTBCR could result in a change of ASID
+     * via the TTBCR.A1 bit.
+     */
+    arm_update_tlb_asid(env);
 }
 
 static void vmsa_ttbcr_reset(CPUARMState *env, const ARMCPRegInfo *ri)
@@ -3176,42 +3195,33 @@ static void vmsa_ttbcr_reset(CPUARMState *env, const ARMCPRegInfo *ri)
 static void vmsa_tcr_el1_write(CPUARMState *env, const ARMCPRegInfo *ri,
                                uint64_t value)
 {
-    ARMCPU *cpu = arm_env_get_cpu(env);
     TCR *tcr = raw_ptr(env, ri);
 
-    /* For AArch64 the A1 bit could result in a change of ASID, so TLB flush. */
-    tlb_flush(CPU(cpu));
+    /* For AArch64 the A1 and AS bits could result in a change of ASID. */
     tcr->raw_tcr = value;
+    arm_update_tlb_asid(env);
 }
 
 static void vmsa_ttbr_write(CPUARMState *env, const ARMCPRegInfo *ri,
                             uint64_t value)
 {
-    /* 64 bit accesses to the TTBRs can change the ASID and so we
-     * must flush the TLB.
+    /* 64 bit accesses to the TTBRs can change the ASID.  The TLB is
+     * tagged with it, so this switches TLB contents rather than
+     * flushing them: as on hardware, a change of translation tables
+     * under the same ASID is only seen after a TLB invalidation.
      */
+    raw_write(env, ri, value);
     if (cpreg_field_is_64bit(ri)) {
-        ARMCPU *cpu = arm_env_get_cpu(env);
-
-        tlb_flush(CPU(cpu));
+        arm_update_tlb_asid(env);
     }
-    raw_write(env, ri, value);
 }
 
 static void vttbr_write(CPUARMState *env, const ARMCPRegInfo *ri,
                         uint64_t value)
 {
-    ARMCPU *cpu = arm_env_get_cpu(env);
-    CPUState *cs = CPU(cpu);
-
-    /* Accesses to VTTBR may change the VMID so we must flush the TLB.  */
-    if (raw_read(env, ri) != value) {
-        tlb_flush_by_mmuidx(cs,
-                            ARMMMUIdxBit_S12NSE1 |
-                            ARMMMUIdxBit_S12NSE0 |
-                            ARMMMUIdxBit_S2NS);
-        raw_write(env, ri, value);
-    }
+    /* Accesses to VTTBR may change the VMID, which tags the TLB.  */
+    raw_write(env, ri, value);
+    arm_update_tlb_asid(env);
 }
 
 static const ARMCPRegInfo vmsa_pmsa_cp_reginfo[] = {
@@ -3605,6 +3615,48 @@ static void tlbi_aa64_vmalle1is_write(CPUARMState *env, const ARMCPRegInfo *ri,
     }
 }
 
+/* Return the TLB tag of the ASID in bits [63:48] of a TLBI argument */
+static uint32_t tlbi_aa64_get_asid(CPUARMState *env, uint64_t value)
+{
+    bool as16 = extract64(env->cp15.tcr_el[1].raw_tcr, 36, 1);
+
+    return arm_tlb_asid(env, extract64(value, 48, as16 ? 16 : 8));
+}
+
+static void tlbi_aa64_aside1_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                   uint64_t value)
+{
+    CPUState *cs = ENV_GET_CPU(env);
+    uint32_t asid = tlbi_aa64_get_asid(env, value);
+
+    if (arm_is_secure_below_el3(env)) {
+        tlb_flush_asid_by_mmuidx(cs, asid,
+                                 ARMMMUIdxBit_S1SE1 |
+                                 ARMMMUIdxBit_S1SE0);
+    } else {
+        tlb_flush_asid_by_mmuidx(cs, asid,
+                                 ARMMMUIdxBit_S12NSE1 |
+                                 ARMMMUIdxBit_S12NSE0);
+    }
+}
+
+static void tlbi_aa64_aside1is_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                     uint64_t value)
+{
+    CPUState *cs = ENV_GET_CPU(env);
+    uint32_t asid = tlbi_aa64_get_asid(env, value);
+
+    if (arm_is_secure_below_el3(env)) {
+        tlb_flush_asid_by_mmuidx_all_cpus_synced(cs, asid,
+                                                 ARMMMUIdxBit_S1SE1 |
+                                                 ARMMMUIdxBit_S1SE0);
+    } else {
+        tlb_flush_asid_by_mmuidx_all_cpus_synced(cs, asid,
+                                                 ARMMMUIdxBit_S12NSE1 |
+                                                 ARMMMUIdxBit_S12NSE0);
+    }
+}
+
 static void tlbi_aa64_alle1_write(CPUARMState *env, const ARMCPRegInfo *ri,
                                   uint64_t value)
 {
@@ -3699,21 +3751,22 @@ static void tlbi_aa64_vae1_write(CPUARMState *env, const ARMCPRegInfo *ri,
 {
     /* Invalidate by VA, EL1&0 (AArch64 version).
      * Currently handles all of VAE1, VAAE1, VAALE1 and VALE1,
-     * since we don't support flush-for-specific-ASID-only or
-     * flush-last-level-only.
+     * since we don't support flush-last-level-only.  The TLB is
+     * tagged by ASID as a whole rather than per entry, so the page
+     * is flushed for all ASIDs: global mappings must go anyway.
      */
     ARMCPU *cpu = arm_env_get_cpu(env);
     CPUState *cs = CPU(cpu);
     uint64_t pageaddr = sextract64(value << 12, 0, 56);
 
     if (arm_is_secure_below_el3(env)) {
-        tlb_flush_page_by_mmuidx(cs, pageaddr,
-                                 ARMMMUIdxBit_S1SE1 |
-                                 ARMMMUIdxBit_S1SE0);
+        tlb_flush_range_by_mmuidx(cs, pageaddr, TARGET_PAGE_SIZE,
+                                  ARMMMUIdxBit_S1SE1 |
+                                  ARMMMUIdxBit_S1SE0);
     } else {
-        tlb_flush_page_by_mmuidx(cs, pageaddr,
-                                 ARMMMUIdxBit_S12NSE1 |
-                                 ARMMMUIdxBit_S12NSE0);
+        tlb_flush_range_by_mmuidx(cs, pageaddr, TARGET_PAGE_SIZE,
+                                  ARMMMUIdxBit_S12NSE1 |
+                                  ARMMMUIdxBit_S12NSE0);
     }
 }
 
@@ -3728,7 +3781,8 @@ static void tlbi_aa64_vae2_write(CPUARMState *env, const ARMCPRegInfo *ri,
     CPUState *cs = CPU(cpu);
     uint64_t pageaddr = sextract64(value << 12, 0, 56);
 
-    tlb_flush_page_by_mmuidx(cs, pageaddr, ARMMMUIdxBit_S1E2);
+    tlb_flush_range_by_mmuidx(cs, pageaddr, TARGET_PAGE_SIZE,
+                              ARMMMUIdxBit_S1E2);
 }
 
 static void tlbi_aa64_vae3_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -3742,7 +3796,8 @@ static void tlbi_aa64_vae3_write(CPUARMState *env, const ARMCPRegInfo *ri,
     CPUState *cs = CPU(cpu);
     uint64_t pageaddr = sextract64(value << 12, 0, 56);
 
-    tlb_flush_page_by_mmuidx(cs, pageaddr, ARMMMUIdxBit_S1E3);
+    tlb_flush_range_by_mmuidx(cs, pageaddr, TARGET_PAGE_SIZE,
+                              ARMMMUIdxBit_S1E3);
 }
 
 static void tlbi_aa64_vae1is_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -3754,13 +3809,15 @@ static void tlbi_aa64_vae1is_write(CPUARMState *env, const ARMCPRegInfo *ri,
     uint64_t pageaddr = sextract64(value << 12, 0, 56);
 
     if (sec) {
-        tlb_flush_page_by_mmuidx_all_cpus_synced(cs, pageaddr,
-                                                 ARMMMUIdxBit_S1SE1 |
-                                                 ARMMMUIdxBit_S1SE0);
+        tlb_flush_range_by_mmuidx_all_cpus_synced(cs, pageaddr,
+                                                  TARGET_PAGE_SIZE,
+                                                  ARMMMUIdxBit_S1SE1 |
+                                                  ARMMMUIdxBit_S1SE0);
     } else {
-        tlb_flush_page_by_mmuidx_all_cpus_synced(cs, pageaddr,
-                                                 ARMMMUIdxBit_S12NSE1 |
-                                                 ARMMMUIdxBit_S12NSE0);
+        tlb_flush_range_by_mmuidx_all_cpus_synced(cs, pageaddr,
+                                                  TARGET_PAGE_SIZE,
+                                                  ARMMMUIdxBit_S12NSE1 |
+                                                  ARMMMUIdxBit_S12NSE0);
     }
 }
 
@@ -3770,8 +3827,8 @@ static void tlbi_aa64_vae2is_write(CPUARMState *env, const ARMCPRegInfo *ri,
     CPUState *cs = ENV_GET_CPU(env);
     uint64_t pageaddr = sextract64(value << 12, 0, 56);
 
-    tlb_flush_page_by_mmuidx_all_cpus_synced(cs, pageaddr,
-                                             ARMMMUIdxBit_S1E2);
+    tlb_flush_range_by_mmuidx_all_cpus_synced(cs, pageaddr, TARGET_PAGE_SIZE,
+                                              ARMMMUIdxBit_S1E2);
 }
 
 static void tlbi_aa64_vae3is_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -3780,8 +3837,8 @@ static void tlbi_aa64_vae3is_write(CPUARMState *env, const ARMCPRegInfo *ri,
     CPUState *cs = ENV_GET_CPU(env);
     uint64_t pageaddr = sextract64(value << 12, 0, 56);
 
-    tlb_flush_page_by_mmuidx_all_cpus_synced(cs, pageaddr,
-                                             ARMMMUIdxBit_S1E3);
+    tlb_flush_range_by_mmuidx_all_cpus_synced(cs, pageaddr, TARGET_PAGE_SIZE,
+                                              ARMMMUIdxBit_S1E3);
 }
 
 static void tlbi_aa64_ipas2e1_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -3990,7 +4047,7 @@ static const ARMCPRegInfo v8_cp_reginfo[] = {
     { .name = "TLBI_ASIDE1IS", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 3, .opc2 = 2,
       .access = PL1_W, .type = ARM_CP_NO_RAW,
-      .writefn = tlbi_aa64_vmalle1is_write },
+      .writefn = tlbi_aa64_aside1is_write },
     { .name = "TLBI_VAAE1IS", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 3, .opc2 = 3,
       .access = PL1_W, .type = ARM_CP_NO_RAW,
@@ -4014,7 +4071,7 @@ static const ARMCPRegInfo v8_cp_reginfo[] = {
     { .name = "TLBI_ASIDE1", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 7, .opc2 = 2,
       .access = PL1_W, .type = ARM_CP_NO_RAW,
-      .writefn = tlbi_aa64_vmalle1_write },
+      .writefn = tlbi_aa64_aside1_write },
     { .name = "TLBI_VAAE1", .state = ARM_CP_STATE_AA64,
       .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 7, .opc2 = 3,
       .access = PL1_W, .type = ARM_CP_NO_RAW,
@@ -9201,6 +9258,62 @@ bool arm_s1_regime_using_lpae_format(CPUARMState *env, ARMMMUIdx mmu_idx)
     return regime_using_lpae_format(env, mmu_idx);
 }
 
+/* Return the ASID of the stage 1 regime of MMU_IDX, as programmed in
+ * the TTBR selected by TCR.A1 or, for the short-descriptor format,
+ * in CONTEXTIDR.
+ */
+static uint32_t regime_asid(CPUARMState *env, ARMMMUIdx mmu_idx)
+{
+    if (regime_using_lpae_format(env, mmu_idx)) {
+        uint64_t tcr = regime_tcr(env, mmu_idx)->raw_tcr;
+        uint64_t ttbr = regime_ttbr(env, mmu_idx, extract64(tcr, 22, 1));
+
+        /* Only AArch64 has TCR.AS, selecting 16 bit ASIDs */
+        return extract64(ttbr, 48, extract64(tcr, 36, 1) ? 16 : 8);
+    }
+    return extract64(env->cp15.contextidr_el[regime_el(env, mmu_idx)], 0, 8);
+}
+
+void arm_update_tlb_asid(CPUARMState *env)
+{
+    CPUState *cs = ENV_GET_CPU(env);
+    uint32_t vmid = 0;
+
+    if (arm_feature(env, ARM_FEATURE_M) || arm_feature(env, ARM_FEATURE_PMSA)) {
+        return;
+    }
+
+    /* The NS EL1&0 translations are tagged by VMID and ASID, the
+     * stage 2 ones by VMID only.  EL2 and AArch64 EL3 have no ASID.
+     */
+    if (arm_feature(env, ARM_FEATURE_EL2)) {
+        vmid = extract64(env->cp15.vttbr_el2, 48, 8);
+        tlb_set_asid_for_mmuidx(cs, vmid, ARMMMUIdxBit_S2NS);
+    }
+    tlb_set_asid_for_mmuidx(cs, vmid << 16 | regime_asid(env, ARMMMUIdx_S1NSE1),
+                            ARMMMUIdxBit_S12NSE1 | ARMMMUIdxBit_S12NSE0);
+
+    if (!arm_feature(env, ARM_FEATURE_EL3)) {
+        return;
+    }
+    if (arm_el_is_aa64(env, 3)) {
+        tlb_set_asid_for_mmuidx(cs, regime_asid(env, ARMMMUIdx_S1SE1),
+                                ARMMMUIdxBit_S1SE1 | ARMMMUIdxBit_S1SE0);
+    } else {
+        /* Secure PL1 runs at EL3 when that is AArch32 */
+        tlb_set_asid_for_mmuidx(cs, regime_asid(env, ARMMMUIdx_S1E3),
+                                ARMMMUIdxBit_S1E3 | ARMMMUIdxBit_S1SE0);
+    }
+}
+
+uint32_t arm_tlb_asid(CPUARMState *env, uint32_t asid)
+{
+    if (arm_is_secure(env) || !arm_feature(env, ARM_FEATURE_EL2)) {
+        return asid;
+    }
+    return extract64(env->cp15.vttbr_el2, 48, 8) << 16 | asid;
+}
+
 static inline bool regime_is_user(CPUARMState *env, ARMMMUIdx mmu_idx)
 {
     switch (mmu_idx) {
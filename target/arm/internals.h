@@ -480,6 +480,26 @@ vaddr arm_adjust_watchpoint_address(CPUState *cs, vaddr addr, int len);
 /* Callback function for when a watchpoint or breakpoint triggers. */
 void arm_debug_excp_handler(CPUState *cs);
 
+#ifdef CONFIG_USER_ONLY
+static inline void arm_update_tlb_asid(CPUARMState *env)
+{
+}
+
+static inline uint32_t arm_tlb_asid(CPUARMState *env, uint32_t asid)
+{
+    return asid;
+}
+#else
+/* Tag the EL1&0 TLBs with the ASID and VMID currently programmed.  Must
+ * be called whenever these may have changed.
+ */
+void arm_update_tlb_asid(CPUARMState *env);
+/* Return the TLB tag of ASID in the current EL1&0 regime, for TLB
+ * invalidation by ASID.
+ */
+uint32_t arm_tlb_asid(CPUARMState *env, uint32_t asid);
+#endif
+
 #ifdef CONFIG_USER_ONLY
 static inline bool arm_is_psci_call(ARMCPU *cpu, int excp_type)
 {
@@ -0,0 +1,842 @@
+/*
+ * Generic vector operation expansion
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "tcg.h"
+#include "tcg-op.h"
+#include "tcg-op-gvec.h"
+#include "tcg-gvec-desc.h"
+
+#define MAX_UNROLL  4
+
+/* Verify vector size and alignment rules.  OFS should be the OR of all
+   of the operand offsets so that we can check them all at once.  */
+static void check_size_align(uint32_t oprsz, uint32_t maxsz, uint32_t ofs)
+{
+    tcg_debug_assert(oprsz > 0 && oprsz <= maxsz && maxsz <= 256);
+    tcg_debug_assert(((oprsz | maxsz | ofs) & 7) == 0);
+}
+
+/* Verify vector overlap rules for two operands.  */
+static void check_overlap_2(uint32_t d, uint32_t a, uint32_t s)
+{
+    tcg_debug_assert(d == a || d + s <= a || a + s <= d);
+}
+
+/* Verify vector overlap rules for three operands.  */
+static void check_overlap_3(uint32_t d, uint32_t a, uint32_t b, uint32_t s)
+{
+    check_overlap_2(d, a, s);
+    check_overlap_2(d, b, s);
+    check_overlap_2(a, b, s);
+}
+
+/* Verify vector overlap rules for four operands.  */
+static void check_overlap_4(uint32_t d, uint32_t a, uint32_t b,
+                            uint32_t c, uint32_t s)
+{
+    check_overlap_2(d, a, s);
+    check_overlap_2(d, b, s);
+    check_overlap_2(d, c, s);
+    check_overlap_2(a, b, s);
+    check_overlap_2(a, c, s);
+    check_overlap_2(b, c, s);
+}
+
+/* Create a descriptor from components.  */
+uint32_t simd_desc(uint32_t oprsz, uint32_t maxsz, int32_t data)
+{
+    uint32_t desc = 0;
+
+    assert(oprsz % 8 == 0 && oprsz <= (8 << SIMD_OPRSZ_BITS));
+    assert(maxsz % 8 == 0 && maxsz <= (8 << SIMD_MAXSZ_BITS));
+    assert(data == sextract32(data, 0, SIMD_DATA_BITS));
+
+    oprsz = (oprsz / 8) - 1;
+    maxsz = (maxsz / 8) - 1;
+    desc = deposit32(desc, SIMD_OPRSZ_SHIFT, SIMD_OPRSZ_BITS, oprsz);
+    desc = deposit32(desc, SIMD_MAXSZ_SHIFT, SIMD_MAXSZ_BITS, maxsz);
+    desc = deposit32(desc, SIMD_DATA_SHIFT, SIMD_DATA_BITS, data);
+
+    return desc;
+}
+
+/* Generate a call to a gvec-style helper with two vector operands.  */
+void tcg_gen_gvec_2_ool(uint32_t dofs, uint32_t aofs,
+                        uint32_t oprsz, uint32_t maxsz, int32_t data,
+                        gen_helper_gvec_2 *fn)
+{
+    TCGv_ptr a0, a1;
+    TCGv_i32 desc = tcg_const_i32(simd_desc(oprsz, maxsz, data));
+
+    a0 = tcg_temp_new_ptr();
+    a1 = tcg_temp_new_ptr();
+
+    tcg_gen_addi_ptr(a0, cpu_env, dofs);
+    tcg_gen_addi_ptr(a1, cpu_env, aofs);
+
+    fn(a0, a1, desc);
+
+    tcg_temp_free_ptr(a0);
+    tcg_temp_free_ptr(a1);
+    tcg_temp_free_i32(desc);
+}
+
+/* Generate a call to a gvec-style helper with three vector operands.  */
+void tcg_gen_gvec_3_ool(uint32_t dofs, uint32_t aofs, uint32_t bofs,
+                        uint32_t oprsz, uint32_t maxsz, int32_t data,
+                        gen_helper_gvec_3 *fn)
+{
+    TCGv_ptr a0, a1, a2;
+    TCGv_i32 desc = tcg_const_i32(simd_desc(oprsz, maxsz, data));
+
+    a0 = tcg_temp_new_ptr();
+    a1 = tcg_temp_new_ptr();
+    a2 = tcg_temp_new_ptr();
+
+    tcg_gen_addi_ptr(a0, cpu_env, dofs);
+    tcg_gen_addi_ptr(a1, cpu_env, aofs);
+    tcg_gen_addi_ptr(a2, cpu_env, bofs);
+
+    fn(a0, a1, a2, desc);
+
+    tcg_temp_free_ptr(a0);
+    tcg_temp_free_ptr(a1);
+    tcg_temp_free_ptr(a2);
+    tcg_temp_free_i32(desc);
+}
+
+/* Generate a call to a gvec-style helper with four vector operands.  */
+void tcg_gen_gvec_4_ool(uint32_t dofs, uint32_t aofs, uint32_t bofs,
+                        uint32_t cofs, uint32_t oprsz, uint32_t maxsz,
+                        int32_t data, gen_helper_gvec_4 *fn)
+{
+    TCGv_ptr a0, a1, a2, a3;
+    TCGv_i32 desc = tcg_const_i32(simd_desc(oprsz, maxsz, data));
+
+    a0 = tcg_temp_new_ptr();
+    a1 = tcg_temp_new_ptr();
+    a2 = tcg_temp_new_ptr();
+    a3 = tcg_temp_new_ptr();
+
+    tcg_gen_addi_ptr(a0, cpu_env, dofs);
+    tcg_gen_addi_ptr(a1, cpu_env, aofs);
+    tcg_gen_addi_ptr(a2, cpu_env, bofs);
+    tcg_gen_addi_ptr(a3, cpu_env, cofs);
+
+    fn(a0, a1, a2, a3, desc);
+
+    tcg_temp_free_ptr(a0);
+    tcg_temp_free_ptr(a1);
+    tcg_temp_free_ptr(a2);
+    tcg_temp_free_ptr(a3);
+    tcg_temp_free_i32(desc);
+}
+
+/* Return true if the operation should be expanded inline with 64-bit
+   integer ops rather than with a call to its helper.  */
+static bool use_fni8(bool have_fni8, bool have_fno, bool swar,
+                     uint32_t oprsz)
+{
+    if (!have_fni8) {
+        return false;
+    }
+    if (!have_fno) {
+        return true;
+    }
+    if (oprsz > MAX_UNROLL * 8) {
+        return false;
+    }
+#ifdef CONFIG_VECTOR16
+    /* The helper processes 16 bytes per host vector op, which beats
+       emulating the lanes within 64-bit integers.  */
+    if (swar && oprsz >= 16) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/* Clear MAXSZ - OPRSZ bytes at DOFS + OPRSZ.  */
+static void expand_clr(uint32_t dofs, uint32_t oprsz, uint32_t maxsz)
+{
+    TCGv_i64 zero;
+    uint32_t i;
+
+    if (maxsz == oprsz) {
+        return;
+    }
+
+    zero = tcg_const_i64(0);
+    for (i = oprsz; i < maxsz; i += 8) {
+        tcg_gen_st_i64(zero, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(zero);
+}
+
+/* Store the 64-bit value IN to OPRSZ bytes at DOFS.  */
+static void expand_dup_i64(uint32_t dofs, uint32_t oprsz, TCGv_i64 in)
+{
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_st_i64(in, cpu_env, dofs + i);
+    }
+}
+
+/* Expand OPRSZ bytes worth of two-operand operations using i64 elements.  */
+static void expand_2_i64(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t oprsz,
+                         void (*fni)(unsigned, TCGv_i64, TCGv_i64))
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + i);
+        fni(vece, t0, t0);
+        tcg_gen_st_i64(t0, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(t0);
+}
+
+static void expand_2i_i64(unsigned vece, uint32_t dofs, uint32_t aofs,
+                          uint32_t oprsz, int64_t c,
+                          void (*fni)(unsigned, TCGv_i64, TCGv_i64, int64_t))
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + i);
+        fni(vece, t0, t0, c);
+        tcg_gen_st_i64(t0, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(t0);
+}
+
+/* Expand OPRSZ bytes worth of three-operand operations using i64 elements.  */
+static void expand_3_i64(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t bofs, uint32_t oprsz,
+                         void (*fni)(unsigned, TCGv_i64, TCGv_i64, TCGv_i64))
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + i);
+        tcg_gen_ld_i64(t1, cpu_env, bofs + i);
+        fni(vece, t2, t0, t1);
+        tcg_gen_st_i64(t2, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+}
+
+/* Expand OPRSZ bytes worth of four-operand operations using i64 elements.  */
+static void expand_4_i64(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t bofs, uint32_t cofs, uint32_t oprsz,
+                         void (*fni)(unsigned, TCGv_i64, TCGv_i64,
+                                     TCGv_i64, TCGv_i64))
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+    TCGv_i64 t3 = tcg_temp_new_i64();
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t1, cpu_env, aofs + i);
+        tcg_gen_ld_i64(t2, cpu_env, bofs + i);
+        tcg_gen_ld_i64(t3, cpu_env, cofs + i);
+        fni(vece, t0, t1, t2, t3);
+        tcg_gen_st_i64(t0, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+}
+
+/* Expand a vector two-operand operation.  */
+void tcg_gen_gvec_2(unsigned vece, uint32_t dofs, uint32_t aofs,
+                    uint32_t oprsz, uint32_t maxsz, const GVecGen2 *g)
+{
+    check_size_align(oprsz, maxsz, dofs | aofs);
+    check_overlap_2(dofs, aofs, maxsz);
+
+    if (use_fni8(g->fni8 != NULL, g->fno != NULL, g->swar, oprsz)) {
+        expand_2_i64(vece, dofs, aofs, oprsz, g->fni8);
+        expand_clr(dofs, oprsz, maxsz);
+    } else {
+        /* The helper clears the tail itself.  */
+        tcg_gen_gvec_2_ool(dofs, aofs, oprsz, maxsz, 0, g->fno);
+    }
+}
+
+/* Expand a vector operation with two vectors and an immediate.  */
+void tcg_gen_gvec_2i(unsigned vece, uint32_t dofs, uint32_t aofs,
+                     uint32_t oprsz, uint32_t maxsz, int64_t c,
+                     const GVecGen2i *g)
+{
+    check_size_align(oprsz, maxsz, dofs | aofs);
+    check_overlap_2(dofs, aofs, maxsz);
+
+    if (use_fni8(g->fni8 != NULL, g->fno != NULL, g->swar, oprsz)) {
+        expand_2i_i64(vece, dofs, aofs, oprsz, c, g->fni8);
+        expand_clr(dofs, oprsz, maxsz);
+    } else {
+        tcg_gen_gvec_2_ool(dofs, aofs, oprsz, maxsz, c, g->fno);
+    }
+}
+
+/* Expand a vector three-operand operation.  */
+void tcg_gen_gvec_3(unsigned vece, uint32_t dofs, uint32_t aofs,
+                    uint32_t bofs, uint32_t oprsz, uint32_t maxsz,
+                    const GVecGen3 *g)
+{
+    check_size_align(oprsz, maxsz, dofs | aofs | bofs);
+    check_overlap_3(dofs, aofs, bofs, maxsz);
+
+    if (use_fni8(g->fni8 != NULL, g->fno != NULL, g->swar, oprsz)) {
+        expand_3_i64(vece, dofs, aofs, bofs, oprsz, g->fni8);
+        expand_clr(dofs, oprsz, maxsz);
+    } else {
+        tcg_gen_gvec_3_ool(dofs, aofs, bofs, oprsz, maxsz, 0, g->fno);
+    }
+}
+
+/* Expand a vector four-operand operation.  */
+void tcg_gen_gvec_4(unsigned vece, uint32_t dofs, uint32_t aofs,
+                    uint32_t bofs, uint32_t cofs, uint32_t oprsz,
+                    uint32_t maxsz, const GVecGen4 *g)
+{
+    check_size_align(oprsz, maxsz, dofs | aofs | bofs | cofs);
+    check_overlap_4(dofs, aofs, bofs, cofs, maxsz);
+
+    if (use_fni8(g->fni8 != NULL, g->fno != NULL, g->swar, oprsz)) {
+        expand_4_i64(vece, dofs, aofs, bofs, cofs, oprsz, g->fni8);
+        expand_clr(dofs, oprsz, maxsz);
+    } else {
+        tcg_gen_gvec_4_ool(dofs, aofs, bofs, cofs, oprsz, maxsz, 0, g->fno);
+    }
+}
+
+/*
+ * Expand specific vector operations.
+ */
+
+uint64_t dup_const(unsigned vece, uint64_t c)
+{
+    switch (vece) {
+    case MO_8:
+        return 0x0101010101010101ull * (uint8_t)c;
+    case MO_16:
+        return 0x0001000100010001ull * (uint16_t)c;
+    case MO_32:
+        return 0x0000000100000001ull * (uint32_t)c;
+    case MO_64:
+        return c;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* The sign bit of each element, which is also where carries between
+   the emulated lanes would cross.  */
+static uint64_t lane_sign_mask(unsigned vece)
+{
+    return dup_const(vece, 1ull << ((8 << vece) - 1));
+}
+
+static void gen_mov_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a)
+{
+    tcg_gen_mov_i64(d, a);
+}
+
+void tcg_gen_gvec_mov(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen2 g = {
+        .fni8 = gen_mov_i64,
+        .fno = gen_helper_gvec_mov,
+    };
+
+    if (dofs != aofs) {
+        tcg_gen_gvec_2(vece, dofs, aofs, oprsz, maxsz, &g);
+    } else {
+        check_size_align(oprsz, maxsz, dofs);
+        expand_clr(dofs, oprsz, maxsz);
+    }
+}
+
+static void gen_not_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a)
+{
+    tcg_gen_not_i64(d, a);
+}
+
+void tcg_gen_gvec_not(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen2 g = {
+        .fni8 = gen_not_i64,
+        .fno = gen_helper_gvec_not,
+    };
+    tcg_gen_gvec_2(vece, dofs, aofs, oprsz, maxsz, &g);
+}
+
+/* Lane-wise a + b within 64 bits: add with the sign bits masked off so
+   that no carry crosses into the next lane, then fix up the sign bits.  */
+static void gen_add_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, t3, m;
+
+    if (vece == MO_64) {
+        tcg_gen_add_i64(d, a, b);
+        return;
+    }
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+    m = tcg_const_i64(lane_sign_mask(vece));
+
+    tcg_gen_andc_i64(t1, a, m);
+    tcg_gen_andc_i64(t2, b, m);
+    tcg_gen_xor_i64(t3, a, b);
+    tcg_gen_add_i64(d, t1, t2);
+    tcg_gen_and_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(m);
+}
+
+/* Lane-wise a - b within 64 bits: subtract with the sign bits forced
+   on in A and off in B so that no borrow crosses lanes.  */
+static void gen_sub_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, t3, m;
+
+    if (vece == MO_64) {
+        tcg_gen_sub_i64(d, a, b);
+        return;
+    }
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+    m = tcg_const_i64(lane_sign_mask(vece));
+
+    tcg_gen_or_i64(t1, a, m);
+    tcg_gen_andc_i64(t2, b, m);
+    tcg_gen_eqv_i64(t3, a, b);
+    tcg_gen_sub_i64(d, t1, t2);
+    tcg_gen_and_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(m);
+}
+
+static void gen_neg_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a)
+{
+    TCGv_i64 zero;
+
+    if (vece == MO_64) {
+        tcg_gen_neg_i64(d, a);
+        return;
+    }
+
+    zero = tcg_const_i64(0);
+    gen_sub_i64(vece, d, zero, a);
+    tcg_temp_free_i64(zero);
+}
+
+void tcg_gen_gvec_neg(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    static gen_helper_gvec_2 * const fns[4] = {
+        gen_helper_gvec_neg8, gen_helper_gvec_neg16,
+        gen_helper_gvec_neg32, gen_helper_gvec_neg64,
+    };
+    GVecGen2 g = {
+        .fni8 = gen_neg_i64,
+        .fno = fns[vece],
+        .swar = vece != MO_64,
+    };
+    tcg_gen_gvec_2(vece, dofs, aofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_add(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static gen_helper_gvec_3 * const fns[4] = {
+        gen_helper_gvec_add8, gen_helper_gvec_add16,
+        gen_helper_gvec_add32, gen_helper_gvec_add64,
+    };
+    GVecGen3 g = {
+        .fni8 = gen_add_i64,
+        .fno = fns[vece],
+        .swar = vece != MO_64,
+    };
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_sub(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static gen_helper_gvec_3 * const fns[4] = {
+        gen_helper_gvec_sub8, gen_helper_gvec_sub16,
+        gen_helper_gvec_sub32, gen_helper_gvec_sub64,
+    };
+    GVecGen3 g = {
+        .fni8 = gen_sub_i64,
+        .fno = fns[vece],
+        .swar = vece != MO_64,
+    };
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+static void gen_and_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_and_i64(d, a, b);
+}
+
+static void gen_or_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_or_i64(d, a, b);
+}
+
+static void gen_xor_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_xor_i64(d, a, b);
+}
+
+static void gen_andc_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_andc_i64(d, a, b);
+}
+
+static void gen_orc_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_orc_i64(d, a, b);
+}
+
+void tcg_gen_gvec_and(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = gen_and_i64,
+        .fno = gen_helper_gvec_and,
+    };
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_or(unsigned vece, uint32_t dofs, uint32_t aofs,
+                     uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = gen_or_i64,
+        .fno = gen_helper_gvec_or,
+    };
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_xor(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = gen_xor_i64,
+        .fno = gen_helper_gvec_xor,
+    };
+
+    if (aofs == bofs) {
+        tcg_gen_gvec_dupi(MO_64, dofs, oprsz, maxsz, 0);
+    } else {
+        tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+    }
+}
+
+void tcg_gen_gvec_andc(unsigned vece, uint32_t dofs, uint32_t aofs,
+                       uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = gen_andc_i64,
+        .fno = gen_helper_gvec_andc,
+    };
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_orc(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = gen_orc_i64,
+        .fno = gen_helper_gvec_orc,
+    };
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+static void gen_bitsel_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a,
+                           TCGv_i64 b, TCGv_i64 c)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    /* d = c ^ ((b ^ c) & a) */
+    tcg_gen_xor_i64(t, b, c);
+    tcg_gen_and_i64(t, t, a);
+    tcg_gen_xor_i64(d, c, t);
+    tcg_temp_free_i64(t);
+}
+
+void tcg_gen_gvec_bitsel(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t bofs, uint32_t cofs,
+                         uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen4 g = {
+        .fni8 = gen_bitsel_i64,
+        .fno = gen_helper_gvec_bitsel,
+    };
+    tcg_gen_gvec_4(vece, dofs, aofs, bofs, cofs, oprsz, maxsz, &g);
+}
+
+static void gen_shli_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, int64_t c)
+{
+    uint64_t mask = dup_const(vece, 0xffffffffffffffffull << c);
+
+    tcg_gen_shli_i64(d, a, c);
+    if (vece != MO_64) {
+        tcg_gen_andi_i64(d, d, mask);
+    }
+}
+
+static void gen_shri_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, int64_t c)
+{
+    uint64_t mask = dup_const(vece, (0xffffffffffffffffull >> (64 - (8 << vece)))
+                                    >> c);
+
+    tcg_gen_shri_i64(d, a, c);
+    if (vece != MO_64) {
+        tcg_gen_andi_i64(d, d, mask);
+    }
+}
+
+static void gen_sari_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, int64_t c)
+{
+    uint64_t s_mask = lane_sign_mask(vece) >> c;
+    uint64_t c_mask = dup_const(vece, (0xffffffffffffffffull
+                                       >> (64 - (8 << vece))) >> c);
+    TCGv_i64 s;
+
+    if (vece == MO_64) {
+        tcg_gen_sari_i64(d, a, c);
+        return;
+    }
+
+    s = tcg_temp_new_i64();
+    tcg_gen_shri_i64(d, a, c);
+    tcg_gen_andi_i64(s, d, s_mask);             /* isolate shifted sign bits */
+    tcg_gen_muli_i64(s, s, (2ull << c) - 2);    /* replicate them upwards */
+    tcg_gen_andi_i64(d, d, c_mask);             /* clear bits from above */
+    tcg_gen_or_i64(d, d, s);                    /* include sign extension */
+    tcg_temp_free_i64(s);
+}
+
+void tcg_gen_gvec_shli(unsigned vece, uint32_t dofs, uint32_t aofs,
+                       int64_t shift, uint32_t oprsz, uint32_t maxsz)
+{
+    static gen_helper_gvec_2 * const fns[4] = {
+        gen_helper_gvec_shl8, gen_helper_gvec_shl16,
+        gen_helper_gvec_shl32, gen_helper_gvec_shl64,
+    };
+    GVecGen2i g = {
+        .fni8 = gen_shli_i64,
+        .fno = fns[vece],
+        .swar = vece != MO_64,
+    };
+
+    tcg_debug_assert(shift >= 0 && shift < (8 << vece));
+    if (shift == 0) {
+        tcg_gen_gvec_mov(vece, dofs, aofs, oprsz, maxsz);
+    } else {
+        tcg_gen_gvec_2i(vece, dofs, aofs, oprsz, maxsz, shift, &g);
+    }
+}
+
+void tcg_gen_gvec_shri(unsigned vece, uint32_t dofs, uint32_t aofs,
+                       int64_t shift, uint32_t oprsz, uint32_t maxsz)
+{
+    static gen_helper_gvec_2 * const fns[4] = {
+        gen_helper_gvec_shr8, gen_helper_gvec_shr16,
+        gen_helper_gvec_shr32, gen_helper_gvec_shr64,
+    };
+    GVecGen2i g = {
+        .fni8 = gen_shri_i64,
+        .fno = fns[vece],
+        .swar = vece != MO_64,
+    };
+
+    tcg_debug_assert(shift >= 0 && shift < (8 << vece));
+    if (shift == 0) {
+        tcg_gen_gvec_mov(vece, dofs, aofs, oprsz, maxsz);
+    } else {
+        tcg_gen_gvec_2i(vece, dofs, aofs, oprsz, maxsz, shift, &g);
+    }
+}
+
+void tcg_gen_gvec_sari(unsigned vece, uint32_t dofs, uint32_t aofs,
+                       int64_t shift, uint32_t oprsz, uint32_t maxsz)
+{
+    static gen_helper_gvec_2 * const fns[4] = {
+        gen_helper_gvec_sar8, gen_helper_gvec_sar16,
+        gen_helper_gvec_sar32, gen_helper_gvec_sar64,
+    };
+    GVecGen2i g = {
+        .fni8 = gen_sari_i64,
+        .fno = fns[vece],
+        .swar = vece != MO_64,
+    };
+
+    tcg_debug_assert(shift >= 0 && shift < (8 << vece));
+    if (shift == 0) {
+        tcg_gen_gvec_mov(vece, dofs, aofs, oprsz, maxsz);
+    } else {
+        tcg_gen_gvec_2i(vece, dofs, aofs, oprsz, maxsz, shift, &g);
+    }
+}
+
+static void gen_cmp_i64(TCGCond cond, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_setcond_i64(cond, d, a, b);
+    tcg_gen_neg_i64(d, d);
+}
+
+#define GEN_CMP64(NAME, COND)                                            \
+static void NAME(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)     \
+{                                                                       \
+    gen_cmp_i64(COND, d, a, b);                                         \
+}
+
+GEN_CMP64(gen_eq_i64, TCG_COND_EQ)
+GEN_CMP64(gen_ne_i64, TCG_COND_NE)
+GEN_CMP64(gen_lt_i64, TCG_COND_LT)
+GEN_CMP64(gen_le_i64, TCG_COND_LE)
+GEN_CMP64(gen_ltu_i64, TCG_COND_LTU)
+GEN_CMP64(gen_leu_i64, TCG_COND_LEU)
+
+#undef GEN_CMP64
+
+void tcg_gen_gvec_cmp(TCGCond cond, unsigned vece, uint32_t dofs,
+                      uint32_t aofs, uint32_t bofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    /* Only the 64-bit elements have an inline expansion; the helpers do
+       the narrower ones.  */
+#define CMP_GEN(NAME) {                                                 \
+        { .fno = gen_helper_gvec_##NAME##8 },                           \
+        { .fno = gen_helper_gvec_##NAME##16 },                          \
+        { .fno = gen_helper_gvec_##NAME##32 },                          \
+        { .fni8 = gen_##NAME##_i64, .fno = gen_helper_gvec_##NAME##64 }, \
+    }
+    static const GVecGen3 eq_gen[4] = CMP_GEN(eq);
+    static const GVecGen3 ne_gen[4] = CMP_GEN(ne);
+    static const GVecGen3 lt_gen[4] = CMP_GEN(lt);
+    static const GVecGen3 le_gen[4] = CMP_GEN(le);
+    static const GVecGen3 ltu_gen[4] = CMP_GEN(ltu);
+    static const GVecGen3 leu_gen[4] = CMP_GEN(leu);
+#undef CMP_GEN
+    const GVecGen3 *g;
+
+    switch (cond) {
+    case TCG_COND_NEVER:
+    case TCG_COND_ALWAYS:
+        tcg_gen_gvec_dupi(MO_64, dofs, oprsz, maxsz,
+                          cond == TCG_COND_ALWAYS ? -1 : 0);
+        return;
+    case TCG_COND_GT:
+    case TCG_COND_GE:
+    case TCG_COND_GTU:
+    case TCG_COND_GEU:
+        /* Only the "less than" forms exist, swap the operands.  */
+        tcg_gen_gvec_cmp(tcg_swap_cond(cond), vece, dofs, bofs, aofs,
+                         oprsz, maxsz);
+        return;
+    case TCG_COND_EQ:
+        g = &eq_gen[vece];
+        break;
+    case TCG_COND_NE:
+        g = &ne_gen[vece];
+        break;
+    case TCG_COND_LT:
+        g = &lt_gen[vece];
+        break;
+    case TCG_COND_LE:
+        g = &le_gen[vece];
+        break;
+    case TCG_COND_LTU:
+        g = &ltu_gen[vece];
+        break;
+    case TCG_COND_LEU:
+        g = &leu_gen[vece];
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    tcg_gen_gvec_3(vece, dofs, aofs, bofs, oprsz, maxsz, g);
+}
+
+void tcg_gen_gvec_dup_i64(unsigned vece, uint32_t dofs, uint32_t oprsz,
+                          uint32_t maxsz, TCGv_i64 in)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    check_size_align(oprsz, maxsz, dofs);
+    switch (vece) {
+    case MO_8:
+        tcg_gen_ext8u_i64(t, in);
+        tcg_gen_muli_i64(t, t, 0x0101010101010101ull);
+        break;
+    case MO_16:
+        tcg_gen_ext16u_i64(t, in);
+        tcg_gen_muli_i64(t, t, 0x0001000100010001ull);
+        break;
+    case MO_32:
+        tcg_gen_deposit_i64(t, in, in, 32, 32);
+        break;
+    case MO_64:
+        tcg_gen_mov_i64(t, in);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    expand_dup_i64(dofs, oprsz, t);
+    expand_clr(dofs, oprsz, maxsz);
+    tcg_temp_free_i64(t);
+}
+
+void tcg_gen_gvec_dupi(unsigned vece, uint32_t dofs, uint32_t oprsz,
+                       uint32_t maxsz, uint64_t x)
+{
+    TCGv_i64 t = tcg_const_i64(dup_const(vece, x));
+
+    check_size_align(oprsz, maxsz, dofs);
+    expand_dup_i64(dofs, oprsz, t);
+    expand_clr(dofs, oprsz, maxsz);
+    tcg_temp_free_i64(t);
+}
@@ -31,6 +31,7 @@
 #include "tcg-mo.h"
 #include "trace-tcg.h"
 #include "trace/mem.h"
+#include "qemu/etrace.h"
 
 /* Reduce the number of ifdefs below.  This assumes that all uses of
    TCGV_HIGH and TCGV_LOW are properly protected by a conditional that
@@ -2644,13 +2645,141 @@ static void tcg_gen_req_mo(TCGBar type)
     }
 }
 
+#define ETRACE_MEM_OFS(field) \
+    (-ENV_OFFSET + offsetof(CPUState, etrace_mem.field))
+
+void tcg_gen_etrace_mem_tb_start(void)
+{
+    TCGLabel *skip;
+    TCGv_i32 used, n;
+
+    tcg_ctx->etrace_mem_recs = 0;
+    tcg_ctx->etrace_mem_insn_idx = -1;
+    if (!qemu_etrace_mask(ETRACE_F_MEM_LD | ETRACE_F_MEM_ST)) {
+        return;
+    }
+
+    skip = gen_new_label();
+    used = tcg_temp_new_i32();
+    n = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(used, cpu_env, ETRACE_MEM_OFS(head));
+    tcg_gen_ld_i32(n, cpu_env, ETRACE_MEM_OFS(tail));
+    tcg_gen_sub_i32(used, used, n);
+    /* The number of records in this TB is not known yet, emit a movi
+       with a dummy immediate and patch it in tcg_gen_etrace_mem_tb_end.  */
+    tcg_ctx->etrace_mem_insn_idx = tcg_op_buf_count();
+    tcg_gen_movi_i32(n, 0xdeadbeef);
+    tcg_gen_add_i32(used, used, n);
+    tcg_gen_brcondi_i32(TCG_COND_LEU, used, ETRACE_MEM_RING_SIZE, skip);
+    gen_helper_etrace_mem_flush(cpu_env);
+    gen_set_label(skip);
+
+    tcg_temp_free_i32(used);
+    tcg_temp_free_i32(n);
+}
+
+void tcg_gen_etrace_mem_tb_end(void)
+{
+    if (tcg_ctx->etrace_mem_insn_idx >= 0) {
+        tcg_set_insn_param(tcg_ctx->etrace_mem_insn_idx, 1,
+                           tcg_ctx->etrace_mem_recs);
+    }
+}
+
+static bool etrace_mem_inline(bool is_store)
+{
+    return qemu_etrace_mask(is_store ? ETRACE_F_MEM_ST : ETRACE_F_MEM_LD)
+           && tcg_ctx->etrace_mem_insn_idx >= 0;
+}
+
+/*
+ * Append a record for a guest access to the vCPU's etrace memory ring.
+ * This is straight line code so that it can sit between any two guest
+ * ops. Accesses outside of the mem-range window still get written to
+ * the ring but don't advance head, so the next record overwrites them.
+ * This costs about 20 ops per access. Only the virtual address is
+ * known here, paddr ends up as 0 in the TYPE_MEM records.
+ */
+static void gen_etrace_mem(TCGv addr, TCGv_i64 val, TCGMemOp memop,
+                           bool is_store)
+{
+    uint64_t start = qemu_etracer.mem_range_start;
+    uint64_t last = MIN(qemu_etracer.mem_range_end,
+                        (target_ulong) UINT64_MAX);
+    uint32_t info = 1 << (memop & MO_SIZE);
+    TCGv_i32 head = tcg_temp_new_i32();
+    TCGv_i32 t32 = tcg_temp_new_i32();
+    TCGv_i64 t64 = tcg_temp_new_i64();
+    TCGv_ptr rec = tcg_temp_new_ptr();
+    TCGv_ptr base = tcg_temp_new_ptr();
+
+    if (is_store) {
+        info |= ETRACE_MEM_REC_F_STORE;
+    }
+
+    tcg_gen_ld_i32(head, cpu_env, ETRACE_MEM_OFS(head));
+    tcg_gen_andi_i32(t32, head, ETRACE_MEM_RING_SIZE - 1);
+    tcg_gen_shli_i32(t32, t32, ETRACE_MEM_REC_SHIFT);
+    tcg_gen_ext_i32_ptr(rec, t32);
+    tcg_gen_ld_ptr(base, cpu_env, ETRACE_MEM_OFS(buf));
+    tcg_gen_add_ptr(rec, rec, base);
+
+    tcg_gen_extu_tl_i64(t64, addr);
+    tcg_gen_st_i64(t64, rec, offsetof(struct etrace_mem_rec, vaddr));
+    tcg_gen_st_i64(val, rec, offsetof(struct etrace_mem_rec, value));
+    tcg_gen_movi_i32(t32, info);
+    tcg_gen_st_i32(t32, rec, offsetof(struct etrace_mem_rec, info));
+
+    if (start == 0 && last == (target_ulong) UINT64_MAX) {
+        tcg_gen_addi_i32(head, head, 1);
+    } else {
+        TCGv in_range = tcg_temp_new();
+
+        tcg_gen_subi_tl(in_range, addr, start);
+        tcg_gen_setcondi_tl(TCG_COND_LEU, in_range, in_range, last - start);
+        tcg_gen_trunc_tl_i32(t32, in_range);
+        tcg_gen_add_i32(head, head, t32);
+        tcg_temp_free(in_range);
+    }
+    tcg_gen_st_i32(head, cpu_env, ETRACE_MEM_OFS(head));
+    tcg_ctx->etrace_mem_recs++;
+
+    tcg_temp_free_i32(head);
+    tcg_temp_free_i32(t32);
+    tcg_temp_free_i64(t64);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(base);
+}
+
+static void gen_etrace_mem_i32(TCGv addr, TCGv_i32 val, TCGMemOp memop,
+                               bool is_store)
+{
+    TCGv_i64 val64 = tcg_temp_new_i64();
+
+    tcg_gen_extu_i32_i64(val64, val);
+    gen_etrace_mem(addr, val64, memop, is_store);
+    tcg_temp_free_i64(val64);
+}
+
 void tcg_gen_qemu_ld_i32(TCGv_i32 val, TCGv addr, TCGArg idx, TCGMemOp memop)
 {
+    TCGv etrace_addr = NULL;
+
     tcg_gen_req_mo(TCG_MO_LD_LD | TCG_MO_ST_LD);
     memop = tcg_canonicalize_memop(memop, 0, 0);
     trace_guest_mem_before_tcg(tcg_ctx->cpu, cpu_env,
                                addr, trace_mem_get_info(memop, 0));
+    if (etrace_mem_inline(false)) {
+        /* val may be the same as addr.  */
+        etrace_addr = tcg_temp_new();
+        tcg_gen_mov_tl(etrace_addr, addr);
+    }
     gen_ldst_i32(INDEX_op_qemu_ld_i32, val, addr, memop, idx);
+    if (etrace_addr) {
+        gen_etrace_mem_i32(etrace_addr, val, memop, false);
+        tcg_temp_free(etrace_addr);
+    }
 }
 
 void tcg_gen_qemu_st_i32(TCGv_i32 val, TCGv addr, TCGArg idx, TCGMemOp memop)
@@ -2660,10 +2789,15 @@ void tcg_gen_qemu_st_i32(TCGv_i32 val, TCGv addr, TCGArg idx, TCGMemOp memop)
     trace_guest_mem_before_tcg(tcg_ctx->cpu, cpu_env,
                                addr, trace_mem_get_info(memop, 1));
     gen_ldst_i32(INDEX_op_qemu_st_i32, val, addr, memop, idx);
+    if (etrace_mem_inline(true)) {
+        gen_etrace_mem_i32(addr, val, memop, true);
+    }
 }
 
 void tcg_gen_qemu_ld_i64(TCGv_i64 val, TCGv addr, TCGArg idx, TCGMemOp memop)
 {
+    TCGv etrace_addr = NULL;
+
     tcg_gen_req_mo(TCG_MO_LD_LD | TCG_MO_ST_LD);
     if (TCG_TARGET_REG_BITS == 32 && (memop & MO_SIZE) < MO_64) {
         tcg_gen_qemu_ld_i32(TCGV_LOW(val), addr, idx, memop);
@@ -2678,7 +2812,16 @@ void tcg_gen_qemu_ld_i64(TCGv_i64 val, TCGv addr, TCGArg idx, TCGMemOp memop)
     memop = tcg_canonicalize_memop(memop, 1, 0);
     trace_guest_mem_before_tcg(tcg_ctx->cpu, cpu_env,
                                addr, trace_mem_get_info(memop, 0));
+    if (etrace_mem_inline(false)) {
+        /* val may be the same as addr.  */
+        etrace_addr = tcg_temp_new();
+        tcg_gen_mov_tl(etrace_addr, addr);
+    }
     gen_ldst_i64(INDEX_op_qemu_ld_i64, val, addr, memop, idx);
+    if (etrace_addr) {
+        gen_etrace_mem(etrace_addr, val, memop, false);
+        tcg_temp_free(etrace_addr);
+    }
 }
 
 void tcg_gen_qemu_st_i64(TCGv_i64 val, TCGv addr, TCGArg idx, TCGMemOp memop)
@@ -2693,6 +2836,9 @@ void tcg_gen_qemu_st_i64(TCGv_i64 val, TCGv addr, TCGArg idx, TCGMemOp memop)
     trace_guest_mem_before_tcg(tcg_ctx->cpu, cpu_env,
                                addr, trace_mem_get_info(memop, 1));
     gen_ldst_i64(INDEX_op_qemu_st_i64, val, addr, memop, idx);
+    if (etrace_mem_inline(true)) {
+        gen_etrace_mem(addr, val, memop, true);
+    }
 }
 
 void tcg_gen_ext_i32(TCGv_i32 ret, TCGv_i32 val, TCGMemOp opc)
@@ -801,6 +801,17 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_etrace_mem_tb_start() - flush the inline etrace memory ring if
+ * the records of this TB may not fit.
+ * tcg_gen_etrace_mem_tb_end() - fill in the number of records of this TB.
+ *
+ * Emitted by gen_tb_start and gen_tb_end, no-ops unless the mem-ld or
+ * mem-st etrace flags are set.
+ */
+void tcg_gen_etrace_mem_tb_start(void);
+void tcg_gen_etrace_mem_tb_end(void);
+
 #if TARGET_LONG_BITS == 32
 #define tcg_temp_new() tcg_temp_new_i32()
 #define tcg_global_reg_new tcg_global_reg_new_i32
@@ -680,6 +680,11 @@ struct TCGContext {
 
     TCGLabel *exitreq_label;
 
+    /* Inline etrace memory records emitted into the current TB and the
+       op whose immediate gets patched with that count.  */
+    int etrace_mem_recs;
+    int etrace_mem_insn_idx;
+
     TCGTempSet free_temps[TCG_TYPE_COUNT * 2];
     TCGTemp temps[TCG_MAX_TEMPS]; /* globals first, temps after */
 